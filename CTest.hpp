@@ -60,7 +60,16 @@ namespace CT
             CTestError m_ErrType;
     };
 
-    void TestFunction(const std::string &Name, std::function<void()> fn)
+    /**
+     * @return Returns the count of failed test functions.
+     */
+    inline int &Failures()
+    {
+        static int Count = 0;
+        return Count;
+    }
+
+    inline bool TestFunction(const std::string &Name, std::function<void()> fn)
     {
         std::cout << "Begin Testing Function: '" << Name << "'" << std::endl;
         bool Error = true;
@@ -81,13 +90,17 @@ namespace CT
 
         std::cout << "Finished Testing Function: '" << Name << "'";
         if(Error)
+        {
             std::cout << " Function failed";
+            Failures()++;
+        }
         
         std::cout << std::endl;
+        return !Error;
     }
 
     template<class T>
-    void Check(const std::string &Name, T val, T expected, std::function<std::string(T)> Converter = nullptr)
+    inline void Check(const std::string &Name, T val, T expected, std::function<std::string(T)> Converter = nullptr)
     {
         if(val != expected)
         {
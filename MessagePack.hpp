@@ -32,8 +32,25 @@
 #include <type_traits>
 #include <map>
 #include <unordered_map>
+#include <array>
+#include <tuple>
+#include <utility>
 #include <memory>
 #include <stdexcept>
+#include <algorithm>
+#include <chrono>
+#include <limits>
+
+#if __cplusplus >= 201703L
+#include <optional>
+#include <variant>
+#define MSGPACK_HAS_OPTIONAL_VARIANT
+#endif
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/uio.h>
+#define MSGPACK_HAS_IOVEC
+#endif
 
 enum MsgFormats : unsigned char
 {
@@ -84,7 +101,42 @@ enum class MsgPackErrorType
     INVALID_CAST,       //!< Occurred if a type couldn't cast to the given one.
     EMPTY_STREAM,       //!< Occurred if now data is loaded.
     INVALID_FLOATING_POINT, //!< Occured if a float number is not completed.
-    UNKNOWN_TYPE            //!< Occured if the type is unknown.
+    UNKNOWN_TYPE,           //!< Occured if the type is unknown.
+    BUFFER_TOO_SMALL,       //!< Occured if an output buffer can't hold the stream.
+    NESTING_TOO_DEEP,       //!< Occured if arrays or maps are nested deeper than supported.
+    INVALID_JSON,           //!< Occured if a JSON text is malformed.
+    INVALID_REFERENCE,      //!< Occured if an interned string reference points to an unknown dictionary entry.
+    INVALID_COMPRESSION,    //!< Occured if compressed or packed data is malformed or uses an unknown codec.
+    INVALID_DELTA           //!< Occured if a delta is malformed or doesn't match its base document.
+};
+
+//First ext type used by this library. Change it, if the types collide with your own ext types.
+#ifndef MSGPACK_EXT_TYPE_BASE
+#define MSGPACK_EXT_TYPE_BASE 0x60
+#endif
+
+/**
+ * @brief Application ext types written by this library.
+ */
+enum MsgPackExtTypes : int8_t
+{
+    INTERNED_STRING_DEF     = MSGPACK_EXT_TYPE_BASE,        //!< Payload is a string, which gets the next index of the dictionary of the stream.
+    INTERNED_STRING_REF     = MSGPACK_EXT_TYPE_BASE + 1,    //!< Payload is the big endian dictionary index (1, 2 or 4 bytes) of a string.
+    COMPRESSED_HEADER       = MSGPACK_EXT_TYPE_BASE + 2,    //!< First value of a compressed stream, see MessagePackCompress.hpp.
+    COMPRESSED_CHUNK        = MSGPACK_EXT_TYPE_BASE + 3,    //!< Independently compressed part of a stream, see MessagePackCompress.hpp.
+    PACKED_INT_ARRAY        = MSGPACK_EXT_TYPE_BASE + 4,    //!< Delta encoded and bit packed integer array, see CMessagePack::SetIntegerPacking().
+    PACKED_FLOAT_ARRAY      = MSGPACK_EXT_TYPE_BASE + 5,    //!< XOR compressed float or double array, see CMessagePack::SetFloatPacking().
+    ABSENT_FIELD            = MSGPACK_EXT_TYPE_BASE + 6     //!< Empty payload, cell of a record without the field, see MessagePackColumns.hpp.
+};
+
+/**
+ * @brief Lossless narrowing of floating point values, see CMessagePack::SetFloatNarrowing().
+ */
+enum class MsgPackFloatNarrowing
+{
+    NONE,       //!< Every double is written as FLOAT64.
+    FLOAT32,    //!< Doubles which are exact floats are written as FLOAT32.
+    INTEGER     //!< Like FLOAT32, additionally whole numbers which fit 32 bits are written as integers.
 };
 
 class CMsgPackException : public std::exception
@@ -109,151 +161,1389 @@ class CMsgPackException : public std::exception
         MsgPackErrorType m_ErrType;
 };
 
-class CMessagePack
+//Byte order helpers shared by the codecs. Messagepack stores everything in big endian.
+namespace MsgPackDetail
 {
-    /**-----------------------------------------Blackmagic for SFINAE-----------------------------------------**/
+    template<size_t N>
+    struct Bits;
+
+    template<> struct Bits<1> { using type = uint8_t; };
+    template<> struct Bits<2> { using type = uint16_t; };
+    template<> struct Bits<4> { using type = uint32_t; };
+    template<> struct Bits<8> { using type = uint64_t; };
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    static constexpr bool LITTLE_ENDIAN_HOST = false;
+#else
+    static constexpr bool LITTLE_ENDIAN_HOST = true;
+#endif
+
+    //The shift patterns are compiled to a single bswap instruction.
+    inline uint8_t ByteSwap(uint8_t val)
+    {
+        return val;
+    }
+
+    inline uint16_t ByteSwap(uint16_t val)
+    {
+        return (uint16_t)((val >> 8) | (val << 8));
+    }
+
+    inline uint32_t ByteSwap(uint32_t val)
+    {
+        return ((val >> 24) & 0xFF) | ((val >> 8) & 0xFF00) | ((val << 8) & 0xFF0000) | (val << 24);
+    }
+
+    inline uint64_t ByteSwap(uint64_t val)
+    {
+        return ((uint64_t)ByteSwap((uint32_t)val) << 32) | ByteSwap((uint32_t)(val >> 32));
+    }
 
-    //Concept from https://dev.krzaq.cc/post/checking-whether-a-class-has-a-member-function-with-a-given-signature/
     template<class T>
-    struct has_push_back
+    inline void Store(const T &val, char *Out)
     {
-        private:
-            using Type = typename std::remove_pointer<T>::type;
+        typename Bits<sizeof(T)>::type Tmp;
+        memcpy(&Tmp, &val, sizeof(T));
 
-            template<class C> static auto Test(typename C::value_type *p) -> decltype(std::declval<C>().push_back(*p), std::true_type()) { return std::true_type(); }
-            template<class> static std::false_type Test(...) { return std::false_type(); }
-        public:
-            static const bool value = std::is_same<std::true_type, decltype(Test<Type>(nullptr))>::value;
-    };
+        if(LITTLE_ENDIAN_HOST)
+            Tmp = ByteSwap(Tmp);
+
+        memcpy(Out, &Tmp, sizeof(T));
+    }
 
     template<class T>
-    struct has_push_front
+    inline void Load(const char *In, T &val)
     {
-        private:
-            using Type = typename std::remove_pointer<T>::type;
+        typename Bits<sizeof(T)>::type Tmp;
+        memcpy(&Tmp, In, sizeof(T));
 
-            template<class C> static auto Test(typename C::value_type *p) -> decltype(std::declval<C>().push_front(*p), std::true_type()) { return std::true_type(); }
-            template<class> static std::false_type Test(...) { return std::false_type(); }
+        if(LITTLE_ENDIAN_HOST)
+            Tmp = ByteSwap(Tmp);
+
+        memcpy(&val, &Tmp, sizeof(T));
+    }
+
+    /**
+     * @brief Dictionary of the interned strings of a stream. The entries point into the stream, so lookups don't allocate.
+     */
+    class CStringDictionary
+    {
         public:
-            static const bool value = std::is_same<std::true_type, decltype(Test<Type>(nullptr))>::value;
+            /**
+             * @brief Registers the payload of an INTERNED_STRING_DEF. Definitions are only added once, even if the stream is read several times.
+             *
+             * @param Offset: Position of the string inside the stream.
+             * @param Size: Length of the string.
+             */
+            inline void Define(size_t Offset, uint32_t Size)
+            {
+                if(m_Entries.empty() || Offset > m_Entries.back().Offset)
+                    m_Entries.push_back({Offset, Size});
+            }
+
+            /**
+             * @brief Resolves the payload of an INTERNED_STRING_REF.
+             *
+             * @return Returns false if the payload or the index is invalid.
+             */
+            inline bool Resolve(const char *Payload, uint32_t PayloadSize, size_t &Offset, uint32_t &Size) const
+            {
+                uint32_t Index;
+                switch (PayloadSize)
+                {
+                    case 1: { uint8_t v; Load(Payload, v); Index = v; } break;
+                    case 2: { uint16_t v; Load(Payload, v); Index = v; } break;
+                    case 4: { Load(Payload, Index); } break;
+                    default: return false;
+                }
+
+                if(Index >= m_Entries.size())
+                    return false;
+
+                Offset = m_Entries[Index].Offset;
+                Size = m_Entries[Index].Size;
+                return true;
+            }
+
+            inline void Clear()
+            {
+                m_Entries.clear();
+            }
+
+        private:
+            struct SEntry
+            {
+                size_t Offset;
+                uint32_t Size;
+            };
+
+            std::vector<SEntry> m_Entries;
     };
 
+    /**
+     * Payload of a PACKED_INT_ARRAY:
+     *  varint  Count
+     *  varint  First value, zigzag encoded
+     *  Blocks of up to PACKED_BLOCK_SIZE zigzag encoded deltas between neighbours:
+     *      uint8   Width in bits
+     *      varint  Base, the smallest delta of the block
+     *      Delta - Base of every value with "Width" bits, LSB first
+     * Sorted or regular series like timestamps get deltas with few or zero bits.
+     */
+    static constexpr size_t PACKED_BLOCK_SIZE = 128;
+
+    inline uint64_t ZigZag(int64_t val)
+    {
+        return ((uint64_t)val << 1) ^ (uint64_t)(val >> 63);
+    }
+
+    inline int64_t UnZigZag(uint64_t val)
+    {
+        return (int64_t)(val >> 1) ^ -(int64_t)(val & 1);
+    }
+
+    inline void PutVarint(std::vector<char> &Out, uint64_t val)
+    {
+        while (val >= 0x80)
+        {
+            Out.push_back((char)(val | 0x80));
+            val >>= 7;
+        }
+
+        Out.push_back((char)val);
+    }
+
+    inline bool GetVarint(const char *&In, const char *End, uint64_t &val)
+    {
+        val = 0;
+        for (unsigned Shift = 0; Shift < 64 && In != End; Shift += 7)
+        {
+            uint8_t c = (uint8_t)*In++;
+            val |= (uint64_t)(c & 0x7F) << Shift;
+            if(c < 0x80)
+                return true;
+        }
+
+        return false;
+    }
+
+    inline void PackBlock(std::vector<char> &Out, const uint64_t *Deltas, size_t Count)
+    {
+        uint64_t Base = *std::min_element(Deltas, Deltas + Count);
+        uint64_t Bits = 0;
+        for (size_t i = 0; i < Count; i++)
+            Bits |= Deltas[i] - Base;
+
+        uint8_t Width = 0;
+        while (Width < 64 && (Bits >> Width) != 0)
+            Width++;
+
+        Out.push_back((char)Width);
+        PutVarint(Out, Base);
+
+        size_t Start = Out.size();
+        Out.resize(Start + (Count * Width + 7) / 8, 0);
+        uint8_t *Packed = (uint8_t*)Out.data() + Start;
+
+        size_t Pos = 0;
+        for (size_t i = 0; i < Count; i++)
+        {
+            uint64_t val = Deltas[i] - Base;
+            for (unsigned Done = 0; Done < Width;)
+            {
+                unsigned Offset = Pos & 7;
+                unsigned Take = std::min<unsigned>(8 - Offset, Width - Done);
+                Packed[Pos >> 3] |= (uint8_t)(((val >> Done) & ((1u << Take) - 1)) << Offset);
+                Done += Take;
+                Pos += Take;
+            }
+        }
+    }
+
+    /**
+     * @brief Encodes the integers of a container as PACKED_INT_ARRAY payload.
+     */
     template<class T>
-    struct has_begin_end
+    inline void PackIntegers(const T &Values, std::vector<char> &Out)
+    {
+        uint64_t Deltas[PACKED_BLOCK_SIZE];
+        size_t Count = 0;
+
+        auto It = Values.begin();
+        uint64_t Prev = (uint64_t)(int64_t)*It;
+        PutVarint(Out, Values.size());
+        PutVarint(Out, ZigZag((int64_t)Prev));
+
+        //Wrapping arithmetic, so every delta fits into 64 bits.
+        for (++It; It != Values.end(); ++It)
+        {
+            uint64_t Cur = (uint64_t)(int64_t)*It;
+            Deltas[Count++] = ZigZag((int64_t)(Cur - Prev));
+            Prev = Cur;
+
+            if(Count == PACKED_BLOCK_SIZE)
+            {
+                PackBlock(Out, Deltas, Count);
+                Count = 0;
+            }
+        }
+
+        if(Count != 0)
+            PackBlock(Out, Deltas, Count);
+    }
+
+    /**
+     * @brief Decodes a PACKED_INT_ARRAY payload. Calls "OnCount(Count)" once and "OnValue(Index, Value)" for every value.
+     *
+     * @return Returns false if the payload is malformed.
+     */
+    template<class C, class V>
+    inline bool UnpackIntegers(const char *In, size_t Size, C &&OnCount, V &&OnValue)
+    {
+        const char *End = In + Size;
+        uint64_t Count, First;
+        if(!GetVarint(In, End, Count) || Count == 0 || !GetVarint(In, End, First))
+            return false;
+
+        //Every block needs at least two bytes.
+        if(Count - 1 > (uint64_t)(End - In) / 2 * PACKED_BLOCK_SIZE)
+            return false;
+
+        OnCount(Count);
+
+        uint64_t Acc = (uint64_t)UnZigZag(First);
+        OnValue(0, (int64_t)Acc);
+
+        for (uint64_t i = 1; i < Count;)
+        {
+            uint64_t Base;
+            if(In == End)
+                return false;
+
+            uint8_t Width = (uint8_t)*In++;
+            size_t Block = (size_t)std::min<uint64_t>(PACKED_BLOCK_SIZE, Count - i);
+            if(Width > 64 || !GetVarint(In, End, Base) || (size_t)(End - In) < (Block * Width + 7) / 8)
+                return false;
+
+            const uint8_t *Packed = (const uint8_t*)In;
+            size_t Pos = 0;
+            for (size_t j = 0; j < Block; j++, i++)
+            {
+                uint64_t val = 0;
+                for (unsigned Done = 0; Done < Width;)
+                {
+                    unsigned Offset = Pos & 7;
+                    unsigned Take = std::min<unsigned>(8 - Offset, Width - Done);
+                    val |= (uint64_t)((Packed[Pos >> 3] >> Offset) & ((1u << Take) - 1)) << Done;
+                    Done += Take;
+                    Pos += Take;
+                }
+
+                Acc += (uint64_t)UnZigZag(val + Base);
+                OnValue(i, (int64_t)Acc);
+            }
+
+            In += (Block * Width + 7) / 8;
+        }
+
+        return In == End;
+    }
+
+    inline unsigned LeadingZeros(uint64_t val)
+    {
+#if defined(__GNUC__) || defined(__clang__)
+        return val == 0 ? 64 : (unsigned)__builtin_clzll(val);
+#else
+        unsigned Count = 0;
+        for (unsigned Step = 32; Step != 0; Step >>= 1)
+        {
+            if((val >> (64 - Step)) == 0)
+            {
+                Count += Step;
+                val <<= Step;
+            }
+        }
+
+        return val == 0 ? 64 : Count;
+#endif
+    }
+
+    inline unsigned TrailingZeros(uint64_t val)
+    {
+#if defined(__GNUC__) || defined(__clang__)
+        return val == 0 ? 64 : (unsigned)__builtin_ctzll(val);
+#else
+        unsigned Count = 0;
+        for (unsigned Step = 32; Step != 0; Step >>= 1)
+        {
+            if((val & (~0ull >> (64 - Step))) == 0)
+            {
+                Count += Step;
+                val >>= Step;
+            }
+        }
+
+        return val == 0 ? 64 : Count;
+#endif
+    }
+
+    /**
+     * @brief Appends bits MSB first.
+     */
+    class CBitWriter
     {
+        public:
+            CBitWriter(std::vector<char> &Out) : m_Out(Out), m_Acc(0), m_Used(0) {}
+
+            inline void Put(uint64_t val, unsigned Bits)
+            {
+                if(Bits > 32)
+                {
+                    PutShort(val >> 32, Bits - 32);
+                    Bits = 32;
+                }
+
+                if(Bits != 0)
+                    PutShort(val & (~0ull >> (64 - Bits)), Bits);
+            }
+
+            inline void Flush()
+            {
+                if(m_Used != 0)
+                    m_Out.push_back((char)(m_Acc << (8 - m_Used)));
+
+                m_Used = 0;
+            }
+
         private:
-            using Type = typename std::remove_pointer<T>::type;
+            std::vector<char> &m_Out;
+            uint64_t m_Acc;
+            unsigned m_Used;
 
-            template<class C> static auto TestBegin(typename C::const_iterator *) -> decltype(static_cast<typename C::const_iterator>(std::declval<C>().begin()), std::true_type())  { return std::true_type(); }
-            template<class> static std::false_type TestBegin(...) { return std::false_type(); }
+            //At most 7 pending bits, so 32 new bits always fit.
+            inline void PutShort(uint64_t val, unsigned Bits)
+            {
+                m_Acc = (m_Acc << Bits) | val;
+                m_Used += Bits;
+                while (m_Used >= 8)
+                {
+                    m_Used -= 8;
+                    m_Out.push_back((char)(m_Acc >> m_Used));
+                }
+            }
+    };
 
-            template<class C> static auto TestEnd(typename C::const_iterator *) -> decltype(static_cast<typename C::const_iterator>(std::declval<C>().end()), std::true_type())  { return std::true_type(); }
-            template<class> static std::false_type TestEnd(...) { return std::false_type(); }
+    class CBitReader
+    {
         public:
-            static const bool value = std::is_same<std::true_type, decltype(TestBegin<Type>(nullptr))>::value && std::is_same<std::true_type, decltype(TestEnd<Type>(nullptr))>::value;
-    }; 
+            CBitReader(const char *Data, size_t Size) : m_Data((const uint8_t*)Data), m_Bits(Size * 8), m_Pos(0) {}
 
-    template<class T>
-    struct is_map : std::false_type {};
+            /**
+             * @return Returns false if less than "Bits" bits are left.
+             */
+            inline bool Get(unsigned Bits, uint64_t &val)
+            {
+                if(Bits > m_Bits - m_Pos)
+                    return false;
 
-    template<class k, class v>
-    struct is_map<std::map<k, v>> : std::true_type {};
+                //One unaligned word covers up to 57 bits from any bit offset.
+                if(Bits - 1 < 56 && m_Pos + 64 <= m_Bits)
+                {
+                    uint64_t Word;
+                    Load((const char*)m_Data + (m_Pos >> 3), Word);
+                    val = (Word << (m_Pos & 7)) >> (64 - Bits);
+                    m_Pos += Bits;
+                    return true;
+                }
 
-    template<class k, class v>
-    struct is_map<std::unordered_map<k, v>> : std::true_type {};
+                val = 0;
+                while (Bits != 0)
+                {
+                    unsigned Offset = m_Pos & 7;
+                    unsigned Take = std::min(8 - Offset, Bits);
+                    val = (val << Take) | ((m_Data[m_Pos >> 3] >> (8 - Offset - Take)) & ((1u << Take) - 1));
+                    Bits -= Take;
+                    m_Pos += Take;
+                }
 
-    template<class T>
-    struct is_multimap : std::false_type {};
+                return true;
+            }
 
-    template<class k, class v>
-    struct is_multimap<std::multimap<k, v>> : std::true_type {};
+            inline size_t GetBytePos() const
+            {
+                return (m_Pos + 7) / 8;
+            }
 
-    template<class k, class v>
-    struct is_multimap<std::unordered_multimap<k, v>> : std::true_type {};
+            inline size_t GetRemaining() const
+            {
+                return m_Bits - m_Pos;
+            }
 
-    template<class T>
-    struct is_shared_ptr : std::false_type {};
+        private:
+            const uint8_t *m_Data;
+            size_t m_Bits;
+            size_t m_Pos;
+    };
 
     template<class T>
-    struct is_shared_ptr<std::shared_ptr<T>> : std::true_type {};
-
+    inline uint64_t FloatBits(T val)
+    {
+        typename std::conditional<sizeof(T) == sizeof(float), uint32_t, uint64_t>::type Bits;
+        memcpy(&Bits, &val, sizeof(Bits));
+        return Bits;
+    }
+
+    /**
+     * Payload of a PACKED_FLOAT_ARRAY:
+     *  varint  Count
+     *  uint8   Width of a value in bits, 32 for float, 64 for double
+     *  Bit stream, MSB first, starting with the first value as it is. Every further value is XORed with its predecessor:
+     *      0                                   Same value.
+     *      10 <Bits>                           The XOR fits the window of leading and trailing zeros of the last written XOR.
+     *      11 <6 Bits Leading> <6 Bits Length - 1> <Bits>  New window.
+     * Slowly changing series share sign, exponent and high mantissa bits, so their XORs are short.
+     */
     template<class T>
-    struct is_pointer_type
+    inline void PackFloats(const T &Values, std::vector<char> &Out)
     {
-        static const bool value = std::is_pointer<T>::value || is_shared_ptr<T>::value;
-    };
+        using Type = typename std::decay<decltype(*Values.begin())>::type;
+        const unsigned Width = sizeof(Type) == sizeof(float) ? 32 : 64;
 
-    template<class T>
-    struct pointer_type 
+        PutVarint(Out, Values.size());
+        Out.push_back((char)Width);
+        Out.reserve(Out.size() + Values.size() * (Width / 8 + 2));
+
+        CBitWriter Writer(Out);
+        auto It = Values.begin();
+        uint64_t Prev = FloatBits(*It);
+        Writer.Put(Prev, Width);
+
+        unsigned Leading = Width + 1, Trailing = 0;
+        for (++It; It != Values.end(); ++It)
+        {
+            uint64_t Cur = FloatBits(*It);
+            uint64_t Xor = Cur ^ Prev;
+            Prev = Cur;
+
+            if(Xor == 0)
+            {
+                Writer.Put(0, 1);
+                continue;
+            }
+
+            unsigned NewLeading = LeadingZeros(Xor) - (64 - Width);
+            unsigned NewTrailing = TrailingZeros(Xor);
+            if(Leading <= Width && NewLeading >= Leading && NewTrailing >= Trailing)
+            {
+                Writer.Put(2, 2);
+                Writer.Put(Xor >> Trailing, Width - Leading - Trailing);
+            }
+            else
+            {
+                Leading = std::min(NewLeading, 63u);
+                Trailing = NewTrailing;
+
+                unsigned Length = Width - Leading - Trailing;
+                Writer.Put(3, 2);
+                Writer.Put(Leading, 6);
+                Writer.Put(Length - 1, 6);
+                Writer.Put(Xor >> Trailing, Length);
+            }
+        }
+
+        Writer.Flush();
+    }
+
+    /**
+     * @brief Decodes a PACKED_FLOAT_ARRAY payload. Calls "OnCount(Count)" once and "OnValue(Index, Value)" for every value.
+     *
+     * @return Returns false if the payload is malformed.
+     */
+    template<class C, class V>
+    inline bool UnpackFloats(const char *In, size_t Size, C &&OnCount, V &&OnValue)
     {
-        using type = typename std::remove_pointer<T>::type;
-    };
+        const char *End = In + Size;
+        uint64_t Count;
+        if(!GetVarint(In, End, Count) || Count == 0 || In == End)
+            return false;
+
+        unsigned Width = (uint8_t)*In++;
+        if(Width != 32 && Width != 64)
+            return false;
+
+        //Every further value needs at least one bit.
+        CBitReader Reader(In, End - In);
+        if(Reader.GetRemaining() < Width || Count - 1 > Reader.GetRemaining() - Width)
+            return false;
+
+        OnCount(Count);
+
+        uint64_t Prev, Leading = 0, Length = 0, Control, Xor;
+        Reader.Get(Width, Prev);
+        OnValue(0, Prev, Width);
+
+        for (uint64_t i = 1; i < Count; i++)
+        {
+            if(!Reader.Get(1, Control))
+                return false;
+
+            if(Control != 0)
+            {
+                if(!Reader.Get(1, Control))
+                    return false;
+
+                if(Control != 0)
+                {
+                    if(!Reader.Get(6, Leading) || !Reader.Get(6, Length) || Leading + ++Length > Width)
+                        return false;
+                }
+                else if(Length == 0)
+                    return false;
+
+                if(!Reader.Get((unsigned)Length, Xor))
+                    return false;
+
+                Prev ^= Xor << (Width - Leading - Length);
+            }
+
+            OnValue(i, Prev, Width);
+        }
+
+        return Reader.GetBytePos() == (size_t)(End - In);
+    }
 
     template<class T>
-    struct pointer_type<std::shared_ptr<T>>
+    inline T FloatFromBits(uint64_t Bits, unsigned Width)
     {
-        using type = T;
+        if(Width == 32)
+        {
+            float val;
+            uint32_t Tmp = (uint32_t)Bits;
+            memcpy(&val, &Tmp, sizeof(val));
+            return (T)val;
+        }
+
+        double val;
+        memcpy(&val, &Bits, sizeof(val));
+        return (T)val;
+    }
+
+    //std::index_sequence is C++14, the tuple and variant codecs use this one to stay C++11.
+    template<size_t... I>
+    struct IndexSequence {};
+
+    template<size_t N, size_t... I>
+    struct MakeIndexSequence : MakeIndexSequence<N - 1, N - 1, I...> {};
+
+    template<size_t... I>
+    struct MakeIndexSequence<0, I...>
+    {
+        using type = IndexSequence<I...>;
     };
+} // namespace MsgPackDetail
 
-    /**-----------------------------------------Blackmagic for SFINAE-----------------------------------------**/
+/**
+ * @brief Snapshot of the instrumentation counters of a CMessagePack, see CMessagePack::GetStats().
+ */
+struct SMsgPackStats
+{
+    uint64_t Encoded[256];              //!< Written values per format tag, indexed by MsgFormats (fix formats are counted under their base tag).
+    uint64_t Decoded[256];              //!< Read values per format tag, indexed by MsgFormats. Skipped values are not counted.
+    uint64_t BytesWritten;              //!< Bytes appended to the stream, including referenced payloads.
+    uint64_t BytesRead;                 //!< Bytes consumed by GetValue(), GetFixed(), UnpackArray(), UnpackMap() and SkipValue().
+    uint64_t Reallocations;             //!< Appends which exceeded the capacity of the stream.
+    uint64_t NestedObjects;             //!< Objects serialized into the stream, each one used to need a temporary pack.
+    uint64_t Exceptions;                //!< Thrown CMsgPackExceptions.
+    uint64_t SerializeCalls;            //!< Calls of Serialize(), SerializeWithoutWipe() and SerializeTo().
+    uint64_t SerializeNanoseconds;
+    uint64_t DeserializeCalls;          //!< Calls of Deserialize().
+    uint64_t DeserializeNanoseconds;
+};
 
+/**
+ * @brief Default instrumentation policy of CMessagePack. Every hook is empty, so the compiler removes them completely.
+ */
+class CMsgPackNoStats
+{
     public:
-        CMessagePack(/* args */) : m_Pairs(0), m_StreamPos(0) {}
+        static constexpr bool ENABLED = false;
+
+        struct STimer {};
+
+        inline void OnEncode(MsgFormats) {}
+        inline void OnDecode(MsgFormats) {}
+        inline void OnWrite(size_t) {}
+        inline void OnRead(size_t) {}
+        inline void OnReallocation() {}
+        inline void OnNestedObject() {}
+        inline void OnException(MsgPackErrorType) {}
+        inline STimer StartTimer() const { return STimer(); }
+        inline void OnSerialize(const STimer &) {}
+        inline void OnDeserialize(const STimer &) {}
+
+        inline SMsgPackStats GetSnapshot() const
+        {
+            return SMsgPackStats();
+        }
 
-        /**
-         * @return Returns the serialized data stream.
+        inline void Reset() {}
+};
+
+/**
+ * @brief Instrumentation policy which counts every hook, enabled with MSGPACK_ENABLE_STATS.
+ */
+class CMsgPackCountingStats
+{
+    public:
+        static constexpr bool ENABLED = true;
+
+        using STimer = std::chrono::steady_clock::time_point;
+
+        CMsgPackCountingStats() : m_Stats() {}
+
+        inline void OnEncode(MsgFormats fmt) { m_Stats.Encoded[fmt]++; }
+        inline void OnDecode(MsgFormats fmt) { m_Stats.Decoded[fmt]++; }
+        inline void OnWrite(size_t Size) { m_Stats.BytesWritten += Size; }
+        inline void OnRead(size_t Size) { m_Stats.BytesRead += Size; }
+        inline void OnReallocation() { m_Stats.Reallocations++; }
+        inline void OnNestedObject() { m_Stats.NestedObjects++; }
+        inline void OnException(MsgPackErrorType) { m_Stats.Exceptions++; }
+        inline STimer StartTimer() const { return std::chrono::steady_clock::now(); }
+
+        inline void OnSerialize(const STimer &Start)
+        {
+            m_Stats.SerializeCalls++;
+            m_Stats.SerializeNanoseconds += Elapsed(Start);
+        }
+
+        inline void OnDeserialize(const STimer &Start)
+        {
+            m_Stats.DeserializeCalls++;
+            m_Stats.DeserializeNanoseconds += Elapsed(Start);
+        }
+
+        inline SMsgPackStats GetSnapshot() const
+        {
+            return m_Stats;
+        }
+
+        inline void Reset()
+        {
+            m_Stats = SMsgPackStats();
+        }
+
+    private:
+        SMsgPackStats m_Stats;
+
+        static inline uint64_t Elapsed(const STimer &Start)
+        {
+            return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - Start).count();
+        }
+};
+
+//The policy is part of the class layout and must be the same in every translation unit.
+//Define MSGPACK_ENABLE_STATS for the counting policy or MSGPACK_STATS_POLICY for an own class with the hooks of CMsgPackNoStats.
+#ifndef MSGPACK_STATS_POLICY
+#ifdef MSGPACK_ENABLE_STATS
+#define MSGPACK_STATS_POLICY CMsgPackCountingStats
+#else
+#define MSGPACK_STATS_POLICY CMsgPackNoStats
+#endif
+#endif
+
+/**
+ * @brief How a type is serialized, see MsgPackContainerTraits.
+ */
+enum class MsgPackContainerKind
+{
+    AUTO,       //!< Detected: types with begin() / end() are sequences, maps additionally have a key_type and a mapped_type.
+    NONE,       //!< Not a container, e.g. a class with begin() / end() which serializes itself with Serialize().
+    SEQUENCE,   //!< Written as array.
+    MAP         //!< Written as map, the elements need "first" and "second".
+};
+
+/**
+ * @brief Customization point for containers. Specialize it for containers which aren't detected or need other operations.
+ *        The optional members are used instead of the standard container interface if they exist:
+ *
+ *        static void Reserve(T &Container, size_t Size);
+ *        static void Insert(T &Container, typename T::value_type &&val);                                     //Sequences
+ *        static void Insert(T &Container, typename T::key_type &&key, typename T::mapped_type &&val);        //Maps
+ */
+template<class T>
+struct MsgPackContainerTraits
+{
+    static constexpr MsgPackContainerKind Kind = MsgPackContainerKind::AUTO;
+};
+
+class CMessagePack
+{
+    /**-----------------------------------------Blackmagic for SFINAE-----------------------------------------**/
+
+    //Concept from https://dev.krzaq.cc/post/checking-whether-a-class-has-a-member-function-with-a-given-signature/
+    template<class T>
+    struct has_push_back
+    {
+        private:
+            using Type = typename std::remove_pointer<T>::type;
+
+            template<class C> static auto Test(typename C::value_type *p) -> decltype(std::declval<C>().push_back(*p), std::true_type()) { return std::true_type(); }
+            template<class> static std::false_type Test(...) { return std::false_type(); }
+        public:
+            static const bool value = std::is_same<std::true_type, decltype(Test<Type>(nullptr))>::value;
+    };
+
+    template<class T>
+    struct has_push_front
+    {
+        private:
+            using Type = typename std::remove_pointer<T>::type;
+
+            template<class C> static auto Test(typename C::value_type *p) -> decltype(std::declval<C>().push_front(*p), std::true_type()) { return std::true_type(); }
+            template<class> static std::false_type Test(...) { return std::false_type(); }
+        public:
+            static const bool value = std::is_same<std::true_type, decltype(Test<Type>(nullptr))>::value;
+    };
+
+    template<class T>
+    struct has_reserve
+    {
+        private:
+            template<class C> static auto Test(C *p) -> decltype(p->reserve(size_t()), std::true_type()) { return std::true_type(); }
+            template<class> static std::false_type Test(...) { return std::false_type(); }
+        public:
+            static const bool value = std::is_same<std::true_type, decltype(Test<T>(nullptr))>::value;
+    };
+
+    //Sets and other sorted or hashed containers.
+    template<class T>
+    struct has_emplace_hint
+    {
+        private:
+            template<class C> static auto Test(typename C::value_type *p) -> decltype(std::declval<C&>().emplace_hint(std::declval<C&>().end(), std::move(*p)), std::true_type()) { return std::true_type(); }
+            template<class> static std::false_type Test(...) { return std::false_type(); }
+        public:
+            static const bool value = std::is_same<std::true_type, decltype(Test<T>(nullptr))>::value;
+    };
+
+    template<class T>
+    struct is_std_array : std::false_type {};
+
+    template<class T, size_t N>
+    struct is_std_array<std::array<T, N>> : std::true_type {};
+
+    template<class T>
+    struct has_begin_end
+    {
+        private:
+            using Type = typename std::remove_pointer<T>::type;
+
+            template<class C> static auto TestBegin(typename C::const_iterator *) -> decltype(static_cast<typename C::const_iterator>(std::declval<C>().begin()), std::true_type())  { return std::true_type(); }
+            template<class> static std::false_type TestBegin(...) { return std::false_type(); }
+
+            template<class C> static auto TestEnd(typename C::const_iterator *) -> decltype(static_cast<typename C::const_iterator>(std::declval<C>().end()), std::true_type())  { return std::true_type(); }
+            template<class> static std::false_type TestEnd(...) { return std::false_type(); }
+        public:
+            static const bool value = std::is_same<std::true_type, decltype(TestBegin<Type>(nullptr))>::value && std::is_same<std::true_type, decltype(TestEnd<Type>(nullptr))>::value;
+    }; 
+
+    template<class T>
+    struct has_key_mapped
+    {
+        private:
+            template<class C> static auto Test(typename C::key_type *, typename C::mapped_type *) -> std::true_type { return std::true_type(); }
+            template<class> static std::false_type Test(...) { return std::false_type(); }
+        public:
+            static const bool value = std::is_same<std::true_type, decltype(Test<T>(nullptr, nullptr))>::value;
+    };
+
+    //Matches every map, multimap and third-party map regardless of its comparator, hasher or allocator.
+    template<class T>
+    struct is_map
+    {
+        private:
+            using Type = typename std::remove_cv<typename std::remove_pointer<T>::type>::type;
+            static constexpr MsgPackContainerKind Kind = MsgPackContainerTraits<Type>::Kind;
+        public:
+            static const bool value = !std::is_pointer<T>::value && (Kind == MsgPackContainerKind::MAP || (Kind == MsgPackContainerKind::AUTO && has_begin_end<Type>::value && has_key_mapped<Type>::value));
+    };
+
+    template<class T>
+    struct is_sequence
+    {
+        private:
+            using Type = typename std::remove_cv<typename std::remove_pointer<T>::type>::type;
+            static constexpr MsgPackContainerKind Kind = MsgPackContainerTraits<Type>::Kind;
+        public:
+            static const bool value = !std::is_pointer<T>::value && (Kind == MsgPackContainerKind::SEQUENCE || (Kind == MsgPackContainerKind::AUTO && has_begin_end<Type>::value && !has_key_mapped<Type>::value));
+    };
+
+    template<class T>
+    struct is_container
+    {
+        static const bool value = is_map<T>::value || is_sequence<T>::value;
+    };
+
+    template<class T>
+    struct has_traits_reserve
+    {
+        private:
+            template<class C> static auto Test(C *p) -> decltype(MsgPackContainerTraits<C>::Reserve(*p, size_t()), std::true_type()) { return std::true_type(); }
+            template<class> static std::false_type Test(...) { return std::false_type(); }
+        public:
+            static const bool value = std::is_same<std::true_type, decltype(Test<T>(nullptr))>::value;
+    };
+
+    template<class T>
+    struct has_traits_insert
+    {
+        private:
+            template<class C> static auto Test(typename C::value_type *p) -> decltype(MsgPackContainerTraits<C>::Insert(std::declval<C&>(), std::move(*p)), std::true_type()) { return std::true_type(); }
+            template<class> static std::false_type Test(...) { return std::false_type(); }
+        public:
+            static const bool value = std::is_same<std::true_type, decltype(Test<T>(nullptr))>::value;
+    };
+
+    template<class T>
+    struct has_traits_insert_pair
+    {
+        private:
+            template<class C> static auto Test(typename C::key_type *k, typename C::mapped_type *v) -> decltype(MsgPackContainerTraits<C>::Insert(std::declval<C&>(), std::move(*k), std::move(*v)), std::true_type()) { return std::true_type(); }
+            template<class> static std::false_type Test(...) { return std::false_type(); }
+        public:
+            static const bool value = std::is_same<std::true_type, decltype(Test<T>(nullptr, nullptr))>::value;
+    };
+
+    template<class T>
+    struct is_shared_ptr : std::false_type {};
+
+    template<class T>
+    struct is_shared_ptr<std::shared_ptr<T>> : std::true_type {};
+
+    template<class T>
+    struct is_unique_ptr : std::false_type {};
+
+    template<class T, class D>
+    struct is_unique_ptr<std::unique_ptr<T, D>> : std::true_type {};
+
+    template<class T>
+    struct is_pointer_type
+    {
+        static const bool value = std::is_pointer<T>::value || is_shared_ptr<T>::value || is_unique_ptr<T>::value;
+    };
+
+    template<class T>
+    struct pointer_type 
+    {
+        using type = typename std::remove_pointer<T>::type;
+    };
+
+    template<class T>
+    struct pointer_type<std::shared_ptr<T>>
+    {
+        using type = T;
+    };
+
+    template<class T, class D>
+    struct pointer_type<std::unique_ptr<T, D>>
+    {
+        using type = T;
+    };
+
+    template<class T>
+    struct is_char_pointer
+    {
+        static const bool value = std::is_pointer<T>::value && std::is_same<typename std::remove_cv<typename std::remove_pointer<T>::type>::type, char>::value;
+    };
+
+    //Pairs and tuples are written as arrays with a fixed size.
+    template<class T>
+    struct is_tuple : std::false_type {};
+
+    template<class... Ts>
+    struct is_tuple<std::tuple<Ts...>> : std::true_type {};
+
+    template<class a, class b>
+    struct is_tuple<std::pair<a, b>> : std::true_type {};
+
+    template<class T>
+    struct is_optional : std::false_type {};
+
+    template<class T>
+    struct is_variant : std::false_type {};
+
+#ifdef MSGPACK_HAS_OPTIONAL_VARIANT
+    template<class T>
+    struct is_optional<std::optional<T>> : std::true_type {};
+
+    template<class... Ts>
+    struct is_variant<std::variant<Ts...>> : std::true_type {};
+#endif
+
+    template<class T>
+    struct has_deserialize
+    {
+        private:
+            template<class C> static auto Test(C *p) -> decltype(p->Deserialize(std::declval<CMessagePack&>()), std::true_type()) { return std::true_type(); }
+            template<class> static std::false_type Test(...) { return std::false_type(); }
+        public:
+            static const bool value = std::is_same<std::true_type, decltype(Test<T>(nullptr))>::value;
+    };
+
+    //Classes which serialize themselves with Serialize() / Deserialize().
+    template<class T>
+    struct is_object
+    {
+        static const bool value = std::is_class<T>::value && !std::is_same<T, std::string>::value && !is_pointer_type<T>::value && !is_container<T>::value
+            && !is_tuple<T>::value && !is_optional<T>::value && !is_variant<T>::value;
+    };
+
+    //Arrays are passed as pointers to the serializer, like they would be if passed by value.
+    template<class T>
+    static inline const T &Decay(const T &val)
+    {
+        return val;
+    }
+
+    template<class T, size_t N>
+    static inline const T *Decay(const T (&val)[N])
+    {
+        return val;
+    }
+
+    /**-----------------------------------------Blackmagic for SFINAE-----------------------------------------**/
+
+    public:
+        CMessagePack(/* args */) : m_Pairs(0), m_StreamPos(0), m_ReferenceThreshold(0), m_Measuring(false), m_MeasuredSize(0), m_OpenContainers(0), m_FirstPatchRef(0), m_InternLimit(0), m_FixedWidth(false), m_Canonical(false), m_PackMin(0), m_FloatPackMin(0), m_Narrowing(MsgPackFloatNarrowing::NONE) {}
+
+        /**
+         * @return Returns the serialized data stream.
+         */
+        inline std::vector<char> Serialize()
+        {
+            auto Ret = SerializeWithoutWipe();
+            Clear();
+            return Ret;
+        }
+
+        inline std::vector<char> SerializeWithoutWipe() const
+        {
+            auto Timer = m_Stats.StartTimer();
+            if(m_References.empty())
+            {
+                std::vector<char> Ret = m_Data;
+                m_Stats.OnSerialize(Timer);
+                return Ret;
+            }
+
+            std::vector<char> Ret;
+            Ret.reserve(GetSerializedSize());
+
+            size_t Pos = 0;
+            for (auto &&r : m_References)
+            {
+                Ret.insert(Ret.end(), m_Data.begin() + Pos, m_Data.begin() + r.Offset);
+                Ret.insert(Ret.end(), r.Data, r.Data + r.Size);
+                Pos = r.Offset;
+            }
+
+            Ret.insert(Ret.end(), m_Data.begin() + Pos, m_Data.end());
+            m_Stats.OnSerialize(Timer);
+            return Ret;
+        }
+
+        /**
+         * @return Returns the internal stream without copying it. Referenced payloads are not included.
+         */
+        inline const std::vector<char> &GetData() const
+        {
+            return m_Data;
+        }
+
+        /**
+         * @brief Uses the given buffer as stream. The content is cleared but the capacity is kept, so no reallocation happens until it is exceeded.
+         * 
+         * @param Buffer: Buffer to take over.
+         */
+        inline void Attach(std::vector<char> &&Buffer)
+        {
+            Clear();
+            m_Data = std::move(Buffer);
+            m_Data.clear();
+        }
+
+        /**
+         * @return Hands out the internal stream including its capacity and clears the pack.
+         */
+        inline std::vector<char> Detach()
+        {
+            std::vector<char> Ret = std::move(m_Data);
+            m_Data = std::vector<char>();
+            Clear();
+            return Ret;
+        }
+
+        /**
+         * @brief Writes the serialized stream, including referenced payloads, into a preallocated memory area.
+         * 
+         * @param Buffer: Destination, e.g. a shared memory slot.
+         * @param Size: Size of the destination.
+         * 
+         * @return Returns the count of written bytes.
+         * 
+         * @throw CMsgPackException If the destination is too small.
+         */
+        inline size_t SerializeTo(char *Buffer, size_t Size) const
+        {
+            if(GetSerializedSize() > Size)
+                Throw(MsgPackErrorType::BUFFER_TOO_SMALL);
+
+            auto Timer = m_Stats.StartTimer();
+            size_t Pos = 0;
+            char *Out = Buffer;
+            for (auto &&r : m_References)
+            {
+                memcpy(Out, m_Data.data() + Pos, r.Offset - Pos);
+                Out += r.Offset - Pos;
+                memcpy(Out, r.Data, r.Size);
+                Out += r.Size;
+                Pos = r.Offset;
+            }
+
+            if(m_Data.size() > Pos)
+            {
+                memcpy(Out, m_Data.data() + Pos, m_Data.size() - Pos);
+                Out += m_Data.size() - Pos;
+            }
+
+            m_Stats.OnSerialize(Timer);
+            return Out - Buffer;
+        }
+
+        /**
+         * @return Returns the size of the serialized stream, including referenced payloads.
+         */
+        inline size_t GetSerializedSize() const
+        {
+            size_t Ret = m_Data.size();
+            for (auto &&r : m_References)
+                Ret += r.Size;
+
+            return Ret;
+        }
+
+        /**
+         * @brief Enables the scatter-gather mode. Str and bin payloads with at least "Threshold" bytes are not copied
+         *        into the pack, only referenced. The referenced memory must stay valid until the output is written.
+         * 
+         * @param Threshold: Minimum payload size to reference. 0 disables the mode.
+         */
+        inline void SetReferenceThreshold(size_t Threshold)
+        {
+            m_ReferenceThreshold = Threshold;
+        }
+
+        /**
+         * @brief Enables the dictionary mode. The first occurrence of a string is written as INTERNED_STRING_DEF ext,
+         *        every further occurrence only as INTERNED_STRING_REF with the index of the definition.
+         *        The dictionary belongs to the stream and is reset by Clear() and Serialize(), so every stream stays self-contained.
+         *        Only strings with 3 to "MaxSize" characters are interned, shorter ones wouldn't get smaller.
+         * 
+         * @param MaxSize: Maximum length of an interned string. 0 disables the mode.
+         */
+        inline void SetStringInterning(size_t MaxSize)
+        {
+            m_InternLimit = MaxSize;
+        }
+
+        /**
+         * @brief Writes every number with 9 bytes (INT64, UINT64 or FLOAT64), instead of the smallest format.
+         *        Numbers can then always be patched in place, see MessagePackPatch.hpp.
+         * 
+         * @param Enable: True to enable the fixed width.
+         */
+        inline void SetFixedWidth(bool Enable)
+        {
+            m_FixedWidth = Enable;
+        }
+
+        /**
+         * @brief Enables the canonical mode. Equal values are then always written with the same bytes, so streams can be hashed or compared directly.
+         *        Map entries are sorted by the encoded bytes of their keys, positive integers always use the unsigned formats
+         *        and empty strings are written as empty str instead of NIL. SetFixedWidth() is ignored in this mode.
+         * 
+         * @param Enable: True to enable the canonical mode.
+         */
+        inline void SetCanonical(bool Enable)
+        {
+            m_Canonical = Enable;
+        }
+
+        /**
+         * @brief Writes integer sequences with at least "MinCount" elements as PACKED_INT_ARRAY ext.
+         *        The differences between neighbours are bit packed in blocks, so sorted or regular series like timestamps
+         *        shrink to a few bits per element. Other implementations see an ext value instead of an array.
+         *        Integer, float and double sequences can be read from it, like from a plain array.
+         * 
+         * @param MinCount: Minimum number of elements, 0 disables the packing.
+         */
+        inline void SetIntegerPacking(size_t MinCount)
+        {
+            m_PackMin = MinCount;
+        }
+
+        /**
+         * @brief Writes float and double sequences with at least "MinCount" elements as PACKED_FLOAT_ARRAY ext.
+         *        Every value is XORed with its predecessor and only the changed bits are written, so slowly changing
+         *        series need far less than 9 bytes per element. The values stay bit exact.
+         * 
+         * @param MinCount: Minimum number of elements, 0 disables the packing.
+         */
+        inline void SetFloatPacking(size_t MinCount)
+        {
+            m_FloatPackMin = MinCount;
+        }
+
+        /**
+         * @brief Writes floating point values with a smaller format if they keep their exact value.
+         *        The decoder reads FLOAT32 and integers into float and double, so no change is needed on the reading side.
+         *        NaNs keep their format and -0.0 never becomes an integer. SetFixedWidth() takes precedence.
+         * 
+         * @param Mode: Allowed narrowing, MsgPackFloatNarrowing::NONE by default.
+         */
+        inline void SetFloatNarrowing(MsgPackFloatNarrowing Mode)
+        {
+            m_Narrowing = Mode;
+        }
+
+#ifdef MSGPACK_HAS_IOVEC
+        /**
+         * @return Returns the stream as io vectors for writev / sendmsg. Referenced payloads are not copied.
+         *         The vectors are invalidated if the pack is modified.
+         */
+        inline std::vector<iovec> GetIOVec() const
+        {
+            std::vector<iovec> Ret;
+            Ret.reserve(m_References.size() * 2 + 1);
+
+            size_t Pos = 0;
+            for (auto &&r : m_References)
+            {
+                if(r.Offset > Pos)
+                    Ret.push_back({(void*)(m_Data.data() + Pos), r.Offset - Pos});
+
+                Ret.push_back({(void*)r.Data, r.Size});
+                Pos = r.Offset;
+            }
+
+            if(Pos < m_Data.size())
+                Ret.push_back({(void*)(m_Data.data() + Pos), m_Data.size() - Pos});
+
+            return Ret;
+        }
+#endif
+
+        /**
+         * @brief Loads a stream for deserialization.
+         * 
+         * @param Data: Stream to load.
+         */
+        inline void Deserialize(const std::vector<char> &Data)
+        {
+            auto Timer = m_Stats.StartTimer();
+            m_Data = Data;
+            m_References.clear();
+            m_Dictionary.Clear();
+            m_StreamPos = 0;
+            m_Stats.OnDeserialize(Timer);
+        }
+
+        /**
+         * @brief Loads a stream for deserialization without copying it.
+         * 
+         * @param Data: Stream to load.
+         */
+        inline void Deserialize(std::vector<char> &&Data)
+        {
+            auto Timer = m_Stats.StartTimer();
+            m_Data = std::move(Data);
+            m_References.clear();
+            m_Dictionary.Clear();
+            m_StreamPos = 0;
+            m_Stats.OnDeserialize(Timer);
+        }
+
+        /**
+         * @brief Clears the messagepack.
+         */
+        void Clear()
+        {
+            m_Data.clear();
+            m_References.clear();
+            m_Patches.clear();
+            m_OpenContainers = 0;
+            m_StreamPos = 0;
+            m_Pairs = 0;
+            m_InternTable.clear();
+            m_Dictionary.Clear();
+        }
+
+        /**
+         * @brief Resets the position of the to the beginning of the stream.
+         */
+        void Reset()
+        {
+            m_StreamPos = 0;
+        }
+
+        /**
+         * @return Returns the read position inside the stream.
+         */
+        inline size_t GetStreamPos() const
+        {
+            return m_StreamPos;
+        }
+
+        /**
+         * @brief Adds a value to the messagepack.
+         * 
+         * @param val: Value to add.
+         */
+        template<class T>
+        inline void AddValue(const T &val)
+        {
+            ValueToMsgPack(val);
+        }
+
+        /**
+         * @brief Calculates the exact size "val" would take in the stream, without writing anything.
+         *        Uses the same serializers as AddValue().
+         * 
+         * @param val: Value to measure.
+         * 
+         * @return Returns the encoded size in bytes.
+         */
+        template<class T>
+        inline size_t MeasureValue(const T &val)
+        {
+            uint32_t Pairs = m_Pairs;
+            size_t Interned = m_InternTable.size();
+            m_Measuring = true;
+            m_MeasuredSize = 0;
+
+            try
+            {
+                ValueToMsgPack(Decay(val));
+            }
+            catch(...)
+            {
+                m_Measuring = false;
+                m_Pairs = Pairs;
+                ForgetInterned(Interned);
+                throw;
+            }
+
+            m_Measuring = false;
+            m_Pairs = Pairs;
+            ForgetInterned(Interned);
+            return m_MeasuredSize;
+        }
+
+        /**
+         * @return Returns the encoded size of "val" in bytes.
          */
-        inline std::vector<char> Serialize()
+        template<class T>
+        static inline size_t EncodedSize(const T &val)
         {
-            auto Ret = m_Data;
-            Clear();
-            return Ret;
+            CMessagePack Tmp;
+            return Tmp.MeasureValue(val);
         }
 
-        inline std::vector<char> SerializeWithoutWipe()
+        /**
+         * @brief Reserves space for "Size" more bytes, e.g. the result of MeasureValue().
+         */
+        inline void Reserve(size_t Size)
         {
-            auto Ret = m_Data;
-            return Ret;
+            m_Data.reserve(m_Data.size() + Size);
         }
 
         /**
-         * @brief Loads a stream for deserialization.
+         * @brief Adds a value with a fixed layout codec, see MessagePackFixed.hpp.
          * 
-         * @param Data: Stream to load.
+         * @param Obj: Value to add.
          */
-        inline void Deserialize(const std::vector<char> &Data)
+        template<class Codec>
+        inline void AddFixed(const typename Codec::Type &Obj)
         {
-            m_Data = Data;
-            m_StreamPos = 0;
+            if(m_Measuring)
+            {
+                m_MeasuredSize += Codec::Size;
+                return;
+            }
+
+            m_Stats.OnEncode(MsgFormats::FIXARRAY);
+            CountWrite(Codec::Size);
+
+            size_t Pos = m_Data.size();
+            m_Data.resize(Pos + Codec::Size);
+            Codec::Encode(Obj, m_Data.data() + Pos);
         }
 
         /**
-         * @brief Clears the messagepack.
+         * @brief Get the next value of the stream with a fixed layout codec, see MessagePackFixed.hpp.
+         * 
+         * @throw CMsgPackException If the stream doesn't match the layout of the codec.
          */
-        void Clear()
+        template<class Codec>
+        inline typename Codec::Type GetFixed()
         {
-            m_Data.clear();
-            m_StreamPos = 0;
-            m_Pairs = 0;
+            ReadNextType();
+
+            typename Codec::Type Ret;
+            if(!Codec::Decode(m_Data.data() + m_StreamPos, m_Data.size() - m_StreamPos, Ret))
+                Throw(MsgPackErrorType::INVALID_CAST);
+
+            m_StreamPos += Codec::Size;
+            m_Stats.OnRead(Codec::Size);
+            return Ret;
         }
 
         /**
-         * @brief Resets the position of the to the beginning of the stream.
+         * @brief Adds a struct as map of its fields, see MessagePackSchema.hpp.
+         * 
+         * @param Schema: Schema of the struct.
+         * @param Obj: Value to add.
          */
-        void Reset()
+        template<class SchemaType>
+        inline void AddSchema(const SchemaType &Schema, const typename SchemaType::Type &Obj)
         {
-            m_StreamPos = 0;
+            Schema.Encode(*this, Obj);
         }
 
         /**
-         * @brief Adds a value to the messagepack.
+         * @brief Get the next value of the stream with the decoder of a schema, see MessagePackSchema.hpp.
+         *        Messages, which don't have the declared shape, are read with the generic decoder.
          * 
-         * @param val: Value to add.
+         * @throw CMsgPackException If the next value isn't a map or a value doesn't match the type of its field.
          */
-        template<class T>
-        inline void AddValue(const T &val)
+        template<class SchemaType>
+        inline typename SchemaType::Type GetSchema(const SchemaType &Schema)
         {
-            ValueToMsgPack(val);
+            CheckStreamPos();
+
+            typename SchemaType::Type Ret;
+            size_t Size = Schema.Decode(m_Data.data() + m_StreamPos, m_Data.size() - m_StreamPos, Ret);
+            if(Size != 0)
+            {
+                m_Stats.OnDecode(GetNextType());
+                m_StreamPos += Size;
+                m_Stats.OnRead(Size);
+                return Ret;
+            }
+
+            Ret = typename SchemaType::Type();
+            Schema.DecodeGeneric(*this, Ret);
+            return Ret;
         }
 
         /**
@@ -266,16 +1556,16 @@ class CMessagePack
             if (Size <= FIXARRAY_MAX)
             {
                 uint8_t Tmp = MsgFormats::FIXARRAY | (uint8_t)(FIXARRAY_MAX & Size); 
-                m_Data.push_back((char)Tmp);
+                PutTag(Tmp);
             }
             else if(Size <= UINT16_MAX)
             {
-                m_Data.push_back(MsgFormats::ARRAY16);
+                PutTag(MsgFormats::ARRAY16);
                 AddBytes((uint16_t)Size);
             }
             else if(Size <= UINT32_MAX)
             {
-                m_Data.push_back(MsgFormats::ARRAY32);
+                PutTag(MsgFormats::ARRAY32);
                 AddBytes(Size);
             }
         }
@@ -290,20 +1580,67 @@ class CMessagePack
             if (Pairs <= FIXMAP_MAX)
             {
                 uint8_t Tmp = MsgFormats::FIXMAP | (uint8_t)(FIXMAP_MAX & Pairs); 
-                m_Data.push_back((char)Tmp);
+                PutTag(Tmp);
             }
             else if(Pairs <= UINT16_MAX)
             {
-                m_Data.push_back(MsgFormats::MAP16);
+                PutTag(MsgFormats::MAP16);
                 AddBytes((uint16_t)Pairs);
             }
             else if(Pairs <= UINT32_MAX)
             {
-                m_Data.push_back(MsgFormats::MAP32);
+                PutTag(MsgFormats::MAP32);
                 AddBytes(Pairs);
             }
         }
 
+        /**
+         * @brief Starts an array or a map whose size isn't known yet. Space for the largest header is reserved
+         *        and shrunk to the smallest header once the outermost container is closed, with a single pass over the stream.
+         * 
+         * @return Returns the handle for EndContainer().
+         */
+        inline size_t BeginContainer()
+        {
+            m_Patches.push_back({m_Measuring ? m_MeasuredSize : m_Data.size(), 0, false});
+            if(m_Patches.size() == 1)
+                m_FirstPatchRef = m_References.size();
+
+            m_OpenContainers++;
+            PutBytes("\0\0\0\0\0", CONTAINER_PLACEHOLDER);
+            return m_Patches.size() - 1;
+        }
+
+        /**
+         * @brief Closes a container which was started with BeginContainer().
+         * 
+         * @param Handle: Handle of BeginContainer().
+         * @param Count: Count of elements for an array or pairs for a map.
+         * @param Map: True for a map.
+         */
+        inline void EndContainer(size_t Handle, uint32_t Count, bool Map)
+        {
+            m_Patches[Handle].Count = Count;
+            m_Patches[Handle].Map = Map;
+
+            if(!m_Measuring)
+                m_Stats.OnEncode(Count <= FIXMAP_MAX ? (Map ? MsgFormats::FIXMAP : MsgFormats::FIXARRAY) : Count <= UINT16_MAX ? (Map ? MsgFormats::MAP16 : MsgFormats::ARRAY16) : (Map ? MsgFormats::MAP32 : MsgFormats::ARRAY32));
+
+            if(--m_OpenContainers == 0)
+                ShrinkContainerHeaders();
+        }
+
+        /**
+         * @brief Adds an already encoded value, e.g. a view of CMsgPackReader. The bytes are copied without checking them.
+         * 
+         * @param Data: Encoded value.
+         * @param Size: Size of the value in bytes.
+         */
+        inline void AddEncoded(const char *Data, size_t Size)
+        {
+            PutBytes(Data, Size);
+        }
+
         /**
          * @brief Adds raw binary data to the output.
          * 
@@ -324,22 +1661,113 @@ class CMessagePack
         {
             if(Size <= UINT8_MAX)
             {
-                m_Data.push_back(MsgFormats::BIN8);
+                PutTag(MsgFormats::BIN8);
+                AddBytes((uint8_t)Size);
+            }
+            else if(Size <= UINT16_MAX)
+            {
+                PutTag(MsgFormats::BIN16);
+                AddBytes((uint16_t)Size);
+            }
+            else if(Size <= UINT32_MAX)
+            {
+                PutTag(MsgFormats::BIN32);
+                AddBytes((uint32_t)Size);
+            }
+
+            AddPayload(Data, Size);
+        }
+
+        /**
+         * @brief Adds a string to the output, without the need of a std::string.
+         * 
+         * @param Str: Characters to add.
+         * @param Size: Count of characters.
+         * @param Copy: True to copy the characters even if SetReferenceThreshold() is set, e.g. for a reused buffer.
+         */
+        inline void AddString(const char *Str, size_t Size, bool Copy = false)
+        {
+            if(Size == 0 && !m_Canonical)
+            {
+                ValueToMsgPack(nullptr);
+                return;
+            }
+
+            if(Size >= INTERN_MIN_SIZE && Size <= m_InternLimit && AddInterned(Str, Size, Copy))
+                return;
+
+            if(Size <= FIXSTR_MAX)
+            {
+                uint8_t Tmp = MsgFormats::FIXSTR | (uint8_t)(FIXSTR_MAX & Size);
+                PutTag(Tmp);
+            }
+            else if(Size <= UINT8_MAX)
+            {
+                PutTag(MsgFormats::STR8);
                 AddBytes((uint8_t)Size);
             }
             else if(Size <= UINT16_MAX)
             {
-                m_Data.push_back(MsgFormats::BIN16);
+                PutTag(MsgFormats::STR16);
                 AddBytes((uint16_t)Size);
             }
             else if(Size <= UINT32_MAX)
             {
-                m_Data.push_back(MsgFormats::BIN32);
+                PutTag(MsgFormats::STR32);
                 AddBytes((uint32_t)Size);
             }
 
-            for (uint32_t i = 0; i < Size; i++)
-                m_Data.push_back(Data[i]);
+            AddPayload(Str, Size, Copy);
+        }
+
+        /**
+         * @brief Adds a zero-length str. AddString() writes empty strings as NIL outside the canonical mode.
+         */
+        inline void AddEmptyString()
+        {
+            PutTag(MsgFormats::FIXSTR);
+        }
+
+        /**
+         * @brief Adds an ext value. Uses the fixext formats if the size allows it.
+         * 
+         * @param Type: Application type of the value.
+         * @param Data: Payload of the value.
+         * @param Size: Size of the payload.
+         * @param Copy: True to copy the payload even if SetReferenceThreshold() is set, e.g. for a reused buffer.
+         */
+        inline void AddExt(int8_t Type, const char *Data, uint32_t Size, bool Copy = false)
+        {
+            switch (Size)
+            {
+                case 1: PutTag(MsgFormats::FIXEXT1); break;
+                case 2: PutTag(MsgFormats::FIXEXT2); break;
+                case 4: PutTag(MsgFormats::FIXEXT4); break;
+                case 8: PutTag(MsgFormats::FIXEXT8); break;
+                case 16: PutTag(MsgFormats::FIXEXT16); break;
+
+                default:
+                {
+                    if(Size <= UINT8_MAX)
+                    {
+                        PutTag(MsgFormats::EXT8);
+                        AddBytes((uint8_t)Size);
+                    }
+                    else if(Size <= UINT16_MAX)
+                    {
+                        PutTag(MsgFormats::EXT16);
+                        AddBytes((uint16_t)Size);
+                    }
+                    else
+                    {
+                        PutTag(MsgFormats::EXT32);
+                        AddBytes(Size);
+                    }
+                }break;
+            }
+
+            PutByte((char)Type);
+            AddPayload(Data, Size, Copy);
         }
 
         /**
@@ -349,11 +1777,11 @@ class CMessagePack
          * @param value: Value of the pair.
          */
         template<class k, class v>
-        inline void AddPair(k key, v value)
+        inline void AddPair(const k &key, const v &value)
         {
             m_Pairs++;
-            ValueToMsgPack(key);
-            ValueToMsgPack(value);
+            ValueToMsgPack(Decay(key));
+            ValueToMsgPack(Decay(value));
         }
 
         /**
@@ -364,7 +1792,27 @@ class CMessagePack
         template<class T>
         inline T GetValue()
         {
-            return MsgPackToValue<T>();
+            size_t Pos = m_StreamPos;
+            T Ret = MsgPackToValue<T>();
+            m_Stats.OnRead(m_StreamPos - Pos);
+            return Ret;
+        }
+
+        /**
+         * @brief Reads the next str, bin or interned string without copying it.
+         * 
+         * @param Length: Receives the byte count.
+         * 
+         * @return Returns a pointer into the stream, which is valid until the pack is modified.
+         * 
+         * @throw CMsgPackException If the next value isn't a string or is truncated.
+         */
+        inline const char *GetStr(uint32_t &Length)
+        {
+            size_t Pos = m_StreamPos;
+            const char *Ret = ReadString(Length);
+            m_Stats.OnRead(m_StreamPos - Pos);
+            return Ret;
         }
 
         /**
@@ -373,21 +1821,7 @@ class CMessagePack
         inline MsgFormats GetNextType()
         {
             if(m_StreamPos < m_Data.size())
-            {
-                uint8_t c = m_Data[m_StreamPos];
-                if((c & 0x80) == MsgFormats::POSITIVE_FIXINT)
-                    return MsgFormats::POSITIVE_FIXINT;
-                else if((c & 0xF0) == MsgFormats::FIXARRAY)
-                    return MsgFormats::FIXARRAY;
-                else if((c & 0xF0) == MsgFormats::FIXMAP)
-                    return MsgFormats::FIXMAP;
-                else if((c & 0xE0) == MsgFormats::FIXSTR)
-                    return MsgFormats::FIXSTR;
-                else if((c & 0xE0) == MsgFormats::NEGATIVE_FIXINT)
-                    return MsgFormats::NEGATIVE_FIXINT;
-                else
-                    return (MsgFormats)c;
-            }
+                return FormatOf(m_Data[m_StreamPos]);
 
             return MsgFormats::RESERVED;
         }
@@ -397,9 +1831,7 @@ class CMessagePack
          */
         uint32_t UnpackArray()
         {
-            CheckStreamPos();
-            
-            auto fmt = GetNextType();
+            auto fmt = ReadNextType();
 
             switch (fmt)
             {
@@ -407,15 +1839,17 @@ class CMessagePack
                 case MsgFormats::ARRAY16:
                 case MsgFormats::ARRAY32:
                 {
+                    size_t Pos = m_StreamPos;
                     auto Size = GetSize();
                     SkipHeader();
 
+                    m_Stats.OnRead(m_StreamPos - Pos);
                     return Size;
                 }break;
             
                 default:
                 {
-                    throw CMsgPackException(MsgPackErrorType::INVALID_CAST);
+                    Throw(MsgPackErrorType::INVALID_CAST);
                 }break;
             }
         }
@@ -425,9 +1859,7 @@ class CMessagePack
          */
         uint32_t UnpackMap()
         {
-            CheckStreamPos();
-            
-            auto fmt = GetNextType();
+            auto fmt = ReadNextType();
 
             switch (fmt)
             {
@@ -435,15 +1867,17 @@ class CMessagePack
                 case MsgFormats::MAP16:
                 case MsgFormats::MAP32:
                 {
+                    size_t Pos = m_StreamPos;
                     auto Size = GetSize();
                     SkipHeader();
 
+                    m_Stats.OnRead(m_StreamPos - Pos);
                     return Size;
                 }break;
             
                 default:
                 {
-                    throw CMsgPackException(MsgPackErrorType::INVALID_CAST);
+                    Throw(MsgPackErrorType::INVALID_CAST);
                 }break;
             }
         }
@@ -457,90 +1891,338 @@ class CMessagePack
          */
         inline void SkipValue(size_t Count = 1)
         {
-            if(m_StreamPos < m_Data.size())
+            size_t Pos = m_StreamPos;
+            SkipValues(Count);
+            m_Stats.OnRead(m_StreamPos - Pos);
+        }
+
+        /**
+         * @brief The counters are collected by the policy MSGPACK_STATS_POLICY. Clear() keeps them, so they accumulate over pooled packs.
+         * 
+         * @return Returns a snapshot of the instrumentation counters. All counters are zero if the instrumentation is disabled.
+         */
+        inline SMsgPackStats GetStats() const
+        {
+            return m_Stats.GetSnapshot();
+        }
+
+        /**
+         * @brief Sets all instrumentation counters to zero.
+         */
+        inline void ResetStats()
+        {
+            m_Stats.Reset();
+        }
+
+        ~CMessagePack() {}
+    private:
+        //Counts the pending values instead of recursing into containers, so deeply nested streams can't overflow the stack.
+        inline void SkipValues(size_t Count)
+        {
+            uint64_t Pending = Count;
+            while (Pending > 0 && m_StreamPos < m_Data.size())
             {
-                for (size_t i = 0; i < Count; i++)
+                MsgFormats fmt = GetNextType();
+                Pending--;
+
+                switch (fmt)
                 {
-                    MsgFormats fmt = GetNextType();
+                    case MsgFormats::POSITIVE_FIXINT:
+                    case MsgFormats::NEGATIVE_FIXINT:
+                    case MsgFormats::NIL:
+                    case MsgFormats::FALSE:
+                    case MsgFormats::TRUE:
+                    {
+                        SkipHeader();
+                    }break;
 
-                    switch (fmt)
+                    case MsgFormats::FIXARRAY:
+                    case MsgFormats::ARRAY16:
+                    case MsgFormats::ARRAY32:
                     {
-                        case MsgFormats::POSITIVE_FIXINT:
-                        case MsgFormats::NEGATIVE_FIXINT:
-                        case MsgFormats::NIL:
-                        case MsgFormats::FALSE:
-                        case MsgFormats::TRUE:
-                        {
-                            SkipHeader();
-                        }break;
-
-                        case MsgFormats::FIXARRAY:
-                        case MsgFormats::ARRAY16:
-                        case MsgFormats::ARRAY32:
-                        {
-                            uint32_t Size = GetSize();
-                            SkipHeader();
-
-                            SkipValue(Size);
-                        } break;
-
-                        case MsgFormats::FIXMAP:
-                        case MsgFormats::MAP16:
-                        case MsgFormats::MAP32:
-                        {
-                            uint32_t Size = GetSize();
-                            SkipHeader();
-
-                            for (uint32_t i = 0; i < Size; i++)
-                                SkipValue(2);   //Skips the next pairs.
-                        } break;
-
-                        case MsgFormats::FIXSTR:  
-                        case MsgFormats::STR8:
-                        case MsgFormats::STR16:
-                        case MsgFormats::STR32:
-                        case MsgFormats::UINT8:
-                        case MsgFormats::UINT16:
-                        case MsgFormats::UINT32:
-                        case MsgFormats::UINT64:
-                        case MsgFormats::INT8:
-                        case MsgFormats::INT16:
-                        case MsgFormats::INT32:
-                        case MsgFormats::INT64:
-                        case MsgFormats::FLOAT32:
-                        case MsgFormats::FLOAT64:
-                        case MsgFormats::BIN8:
-                        case MsgFormats::BIN16:
-                        case MsgFormats::BIN32:
-                        {
-                            m_StreamPos += GetSize();
-                            SkipHeader();
-                        }break;
-
-                        default:
-                        {
-                            throw CMsgPackException(MsgPackErrorType::UNKNOWN_TYPE);
-                        } break;
-                    }
+                        uint32_t Size = GetSize();
+                        SkipHeader();
+
+                        Pending += Size;
+                    } break;
+
+                    case MsgFormats::FIXMAP:
+                    case MsgFormats::MAP16:
+                    case MsgFormats::MAP32:
+                    {
+                        uint32_t Size = GetSize();
+                        SkipHeader();
+
+                        Pending += (uint64_t)Size * 2;   //Keys and values.
+                    } break;
+
+                    case MsgFormats::FIXSTR:  
+                    case MsgFormats::STR8:
+                    case MsgFormats::STR16:
+                    case MsgFormats::STR32:
+                    case MsgFormats::UINT8:
+                    case MsgFormats::UINT16:
+                    case MsgFormats::UINT32:
+                    case MsgFormats::UINT64:
+                    case MsgFormats::INT8:
+                    case MsgFormats::INT16:
+                    case MsgFormats::INT32:
+                    case MsgFormats::INT64:
+                    case MsgFormats::FLOAT32:
+                    case MsgFormats::FLOAT64:
+                    case MsgFormats::BIN8:
+                    case MsgFormats::BIN16:
+                    case MsgFormats::BIN32:
+                    {
+                        uint32_t Size = GetSize();
+                        SkipHeader();
+                        m_StreamPos += Size;
+                    }break;
+
+                    case MsgFormats::FIXEXT1:
+                    case MsgFormats::FIXEXT2:
+                    case MsgFormats::FIXEXT4:
+                    case MsgFormats::FIXEXT8:
+                    case MsgFormats::FIXEXT16:
+                    case MsgFormats::EXT8:
+                    case MsgFormats::EXT16:
+                    case MsgFormats::EXT32:
+                    {
+                        uint32_t Size = GetSize();
+                        SkipHeader();
+
+                        //Skipped definitions are still needed by later references.
+                        if(m_StreamPos <= m_Data.size() && Size <= RemainingBytes() && (int8_t)m_Data[m_StreamPos - 1] == MsgPackExtTypes::INTERNED_STRING_DEF)
+                            m_Dictionary.Define(m_StreamPos, Size);
 
-                    if(m_StreamPos >= m_Data.size())
-                        break;
-                }  
+                        m_StreamPos += Size;
+                    }break;
+
+                    default:
+                    {
+                        Throw(MsgPackErrorType::UNKNOWN_TYPE);
+                    } break;
+                }
             }
         }
 
-        ~CMessagePack() {}
-    private:
         const static char POS_FIXINT_MAX = INT8_MAX;
         const static char NEG_FIXINT_MAX = -32;
         const static char FIXARRAY_MAX = 0xF;
         const static char FIXSTR_MAX = 0x1F;
         const static char FIXMAP_MAX = 0xF;
 
+        struct SReference
+        {
+            size_t Offset;      //!< Position inside m_Data where the payload belongs.
+            const char *Data;
+            size_t Size;
+        };
+
         std::vector<char> m_Data;
         uint32_t m_Pairs;
         size_t m_StreamPos;
 
+        size_t m_ReferenceThreshold;
+        std::vector<SReference> m_References;
+
+        bool m_Measuring;           //!< If set, writes only count their bytes.
+        size_t m_MeasuredSize;
+
+        struct SPatch
+        {
+            size_t Pos;
+            uint32_t Count;
+            bool Map;
+        };
+
+        const static size_t CONTAINER_PLACEHOLDER = 5;
+
+        std::vector<SPatch> m_Patches;
+        size_t m_OpenContainers;
+        size_t m_FirstPatchRef;
+
+        mutable MSGPACK_STATS_POLICY m_Stats;
+
+        const static size_t INTERN_MIN_SIZE = 3;                //!< A reference needs 3 bytes, so shorter strings are written as they are.
+        const static size_t INTERN_MAX_ENTRIES = UINT16_MAX + 1;  //!< Keeps the references at 4 bytes at most.
+
+        size_t m_InternLimit;
+        bool m_FixedWidth;
+        bool m_Canonical;
+        size_t m_PackMin;
+        size_t m_FloatPackMin;
+        MsgPackFloatNarrowing m_Narrowing;
+        std::vector<char> m_PackBuffer;                             //!< Payload of packed arrays, reused so packing doesn't allocate.
+        std::unordered_map<std::string, uint32_t> m_InternTable;   //!< Interned strings written so far and their indices.
+        std::string m_InternKey;                                    //!< Lookup key, reused so lookups don't allocate.
+        MsgPackDetail::CStringDictionary m_Dictionary;              //!< Interned strings read so far.
+
+        /**
+         * @brief Writes a string as definition or reference of the dictionary.
+         * 
+         * @return Returns false if the dictionary is full and the string has to be written as it is.
+         */
+        inline bool AddInterned(const char *Str, size_t Size, bool Copy)
+        {
+            m_InternKey.assign(Str, Size);
+            auto It = m_InternTable.find(m_InternKey);
+
+            if(It != m_InternTable.end())
+            {
+                char Index[2];
+                if(It->second <= UINT8_MAX)
+                {
+                    Index[0] = (char)It->second;
+                    AddExt(MsgPackExtTypes::INTERNED_STRING_REF, Index, 1, true);
+                }
+                else
+                {
+                    MsgPackDetail::Store((uint16_t)It->second, Index);
+                    AddExt(MsgPackExtTypes::INTERNED_STRING_REF, Index, 2, true);
+                }
+
+                return true;
+            }
+
+            if(m_InternTable.size() >= INTERN_MAX_ENTRIES)
+                return false;
+
+            m_InternTable.emplace(m_InternKey, (uint32_t)m_InternTable.size());
+            AddExt(MsgPackExtTypes::INTERNED_STRING_DEF, Str, (uint32_t)Size, Copy);
+            return true;
+        }
+
+        /**
+         * @brief Removes the strings which were interned after the first Count ones.
+         */
+        inline void ForgetInterned(size_t Count)
+        {
+            if(m_InternTable.size() == Count)
+                return;
+
+            for (auto It = m_InternTable.begin(); It != m_InternTable.end();)
+            {
+                if(It->second >= Count)
+                    It = m_InternTable.erase(It);
+                else
+                    ++It;
+            }
+        }
+
+        /**
+         * @brief Reads the header of an ext value and checks that its payload is complete.
+         * 
+         * @return Returns the payload size. The stream position is at the payload afterwards.
+         */
+        inline uint32_t ReadExtHeader(int8_t &Type)
+        {
+            uint32_t Size = GetSize();
+            SkipHeader();
+
+            if(m_StreamPos > m_Data.size() || Size > RemainingBytes())
+                Throw(MsgPackErrorType::EMPTY_STREAM);
+
+            Type = (int8_t)m_Data[m_StreamPos - 1];
+            return Size;
+        }
+
+        /**
+         * @brief Reads a str, bin or interned string.
+         * 
+         * @return Returns a pointer to the characters inside the stream.
+         */
+        inline const char *ReadString(uint32_t &Length)
+        {
+            MsgFormats fmt = ReadNextType();
+
+            switch (fmt)
+            {
+                //Empty strings are written as NIL outside the canonical mode.
+                case MsgFormats::NIL:
+                {
+                    m_StreamPos++;
+                    Length = 0;
+                    return m_Data.data() + m_StreamPos;
+                }break;
+
+                case MsgFormats::FIXSTR:
+                case MsgFormats::STR8:
+                case MsgFormats::STR16:
+                case MsgFormats::STR32:
+                case MsgFormats::BIN8:
+                case MsgFormats::BIN16:
+                case MsgFormats::BIN32:
+                {
+                    uint32_t Size = GetSize();
+                    SkipHeader();
+
+                    //Truncated strings return the available bytes.
+                    const char *Ret = m_Data.data() + std::min(m_StreamPos, m_Data.size());
+                    Length = (uint32_t)std::min<size_t>(Size, RemainingBytes());
+                    m_StreamPos += Size;
+                    return Ret;
+                }break;
+
+                case MsgFormats::FIXEXT1:
+                case MsgFormats::FIXEXT2:
+                case MsgFormats::FIXEXT4:
+                case MsgFormats::FIXEXT8:
+                case MsgFormats::FIXEXT16:
+                case MsgFormats::EXT8:
+                case MsgFormats::EXT16:
+                case MsgFormats::EXT32:
+                {
+                    int8_t Type;
+                    uint32_t Size = ReadExtHeader(Type);
+                    size_t Offset = m_StreamPos;
+
+                    if(Type == MsgPackExtTypes::INTERNED_STRING_DEF)
+                    {
+                        m_Dictionary.Define(Offset, Size);
+                        Length = Size;
+                    }
+                    else if(Type != MsgPackExtTypes::INTERNED_STRING_REF)
+                        Throw(MsgPackErrorType::INVALID_CAST);
+                    else if(!m_Dictionary.Resolve(m_Data.data() + Offset, Size, Offset, Length))
+                        Throw(MsgPackErrorType::INVALID_REFERENCE);
+
+                    m_StreamPos += Size;
+                    return m_Data.data() + Offset;
+                }break;
+
+                default:
+                {
+                    Throw(MsgPackErrorType::INVALID_CAST);
+                }break;
+            }
+        }
+
+        /**
+         * @return Returns the format of a tag byte, fix formats are mapped to their base tag.
+         */
+        static inline MsgFormats FormatOf(uint8_t c)
+        {
+            if((c & 0x80) == MsgFormats::POSITIVE_FIXINT)
+                return MsgFormats::POSITIVE_FIXINT;
+            else if((c & 0xF0) == MsgFormats::FIXARRAY)
+                return MsgFormats::FIXARRAY;
+            else if((c & 0xF0) == MsgFormats::FIXMAP)
+                return MsgFormats::FIXMAP;
+            else if((c & 0xE0) == MsgFormats::FIXSTR)
+                return MsgFormats::FIXSTR;
+            else if((c & 0xE0) == MsgFormats::NEGATIVE_FIXINT)
+                return MsgFormats::NEGATIVE_FIXINT;
+
+            return (MsgFormats)c;
+        }
+
+        [[noreturn]] inline void Throw(MsgPackErrorType Type) const
+        {
+            m_Stats.OnException(Type);
+            throw CMsgPackException(Type);
+        }
+
         inline uint32_t GetSize()
         {
             MsgFormats fmt = GetNextType();
@@ -595,7 +2277,7 @@ class CMessagePack
                 case MsgFormats::STR8:
                 case MsgFormats::BIN8:
                 {
-                    Ret = (uint8_t)m_Data[++Pos];
+                    Ret = ReadInt<uint8_t>(++Pos, 1);
                 }break;
 
                 case MsgFormats::STR16:
@@ -603,15 +2285,32 @@ class CMessagePack
                 case MsgFormats::ARRAY16:
                 case MsgFormats::MAP16:
                 {
-                    Ret = ReadInt<short>(++Pos, 2);
+                    Ret = ReadInt<uint16_t>(++Pos, 2);
                 }break;
 
                 case MsgFormats::STR32:
                 case MsgFormats::BIN32:
                 case MsgFormats::ARRAY32:
                 case MsgFormats::MAP32:
+                case MsgFormats::EXT32:
+                {
+                    Ret = ReadInt<uint32_t>(++Pos, 4);
+                }break;
+
+                case MsgFormats::FIXEXT1: return 1;
+                case MsgFormats::FIXEXT2: return 2;
+                case MsgFormats::FIXEXT4: return 4;
+                case MsgFormats::FIXEXT8: return 8;
+                case MsgFormats::FIXEXT16: return 16;
+
+                case MsgFormats::EXT8:
+                {
+                    Ret = ReadInt<uint8_t>(++Pos, 1);
+                }break;
+
+                case MsgFormats::EXT16:
                 {
-                    Ret = ReadInt<int>(++Pos, 4);
+                    Ret = ReadInt<uint16_t>(++Pos, 2);
                 }break;
             }
 
@@ -666,50 +2365,83 @@ class CMessagePack
                 {
                     m_StreamPos += 5;
                 }break;
+
+                //Ext headers end with the type byte.
+                case MsgFormats::FIXEXT1:
+                case MsgFormats::FIXEXT2:
+                case MsgFormats::FIXEXT4:
+                case MsgFormats::FIXEXT8:
+                case MsgFormats::FIXEXT16:
+                {
+                    m_StreamPos += 2;
+                }break;
+
+                case MsgFormats::EXT8:
+                {
+                    m_StreamPos += 3;
+                }break;
+
+                case MsgFormats::EXT16:
+                {
+                    m_StreamPos += 4;
+                }break;
+
+                case MsgFormats::EXT32:
+                {
+                    m_StreamPos += 6;
+                }break;
             }
         }
 
         template<class T>
         inline T ReadInt(size_t Pos, char Count)
         {
-            T Ret = 0;
+            uint64_t Ret = 0;
 
             for (size_t i = Pos; i < Pos + Count; i++)
             {
+                Ret <<= 8;
                 if(i < m_Data.size())
-                    Ret |= ((uint8_t)m_Data[i] << (8 * (i - Pos)));
+                    Ret |= (uint8_t)m_Data[i];
             }
 
-            return ChangeEndianess(Ret, Count);
+            return (T)Ret;
         }
 
-        template <class T>
-        inline T ReadFloat(size_t Pos, size_t n)
+        /**
+         * @brief Reads the payload of an int or uint format, sign extended by the width of the format.
+         */
+        inline int64_t ReadTypedInt(MsgFormats fmt, size_t Pos)
         {
-            T ret = 0;
-            char *fc = (char*)&ret;
-            std::vector<char> Float = ReadBytes(Pos, n);
-
-            if(Float.size() < sizeof(T))
-                throw CMsgPackException(MsgPackErrorType::INVALID_FLOATING_POINT);
-
-            for (size_t i = 0; i < sizeof(T); i++)
-                fc[i] = Float[i];
-            
-            return ChangeEndianess(ret, n);
+            switch (fmt)
+            {
+                case MsgFormats::INT8: return ReadInt<int8_t>(Pos, 1);
+                case MsgFormats::INT16: return ReadInt<int16_t>(Pos, 2);
+                case MsgFormats::INT32: return ReadInt<int32_t>(Pos, 4);
+                case MsgFormats::UINT8: return ReadInt<uint8_t>(Pos, 1);
+                case MsgFormats::UINT16: return ReadInt<uint16_t>(Pos, 2);
+                case MsgFormats::UINT32: return ReadInt<uint32_t>(Pos, 4);
+                default: return ReadInt<int64_t>(Pos, 8);
+            }
         }
 
-        inline std::vector<char> ReadBytes(size_t Pos, size_t n)
+        //Reads a float32 or float64 payload of "n" bytes and converts it to "T".
+        template <class T>
+        inline T ReadFloat(size_t Pos, size_t n)
         {
-            std::vector<char> Ret;
+            if(Pos > m_Data.size() || m_Data.size() - Pos < n)
+                Throw(MsgPackErrorType::INVALID_FLOATING_POINT);
 
-            for (size_t i = Pos; i < Pos + n; i++)
+            if(n == sizeof(float))
             {
-                if(i < m_Data.size())
-                    Ret.push_back(m_Data[i]);
+                float Ret;
+                MsgPackDetail::Load(m_Data.data() + Pos, Ret);
+                return (T)Ret;
             }
 
-            return Ret;
+            double Ret;
+            MsgPackDetail::Load(m_Data.data() + Pos, Ret);
+            return (T)Ret;
         }
 
         inline bool IsLittleEndian()
@@ -754,14 +2486,241 @@ class CMessagePack
             return ret;
         }
 
+        /**
+         * @brief Informs the instrumentation about "Size" bytes which are appended to the stream.
+         */
+        inline void CountWrite(size_t Size)
+        {
+            m_Stats.OnWrite(Size);
+            if(MSGPACK_STATS_POLICY::ENABLED && m_Data.capacity() - m_Data.size() < Size)
+                m_Stats.OnReallocation();
+        }
+
+        inline void PutByte(char c)
+        {
+            if(m_Measuring)
+                m_MeasuredSize++;
+            else
+            {
+                CountWrite(1);
+                m_Data.push_back(c);
+            }
+        }
+
+        inline void PutBytes(const char *Data, size_t Size)
+        {
+            if(m_Measuring)
+                m_MeasuredSize += Size;
+            else
+            {
+                CountWrite(Size);
+                m_Data.insert(m_Data.end(), Data, Data + Size);
+            }
+        }
+
+        /**
+         * @brief Writes the format tag of a value.
+         */
+        inline void PutTag(uint8_t Tag)
+        {
+            if(!m_Measuring)
+                m_Stats.OnEncode(FormatOf(Tag));
+
+            PutByte((char)Tag);
+        }
+
+        /**
+         * @return Returns the format of the next value, which is going to be read.
+         * 
+         * @throw CMsgPackException If the stream is at its end.
+         */
+        inline MsgFormats ReadNextType()
+        {
+            CheckStreamPos();
+
+            MsgFormats fmt = GetNextType();
+            m_Stats.OnDecode(fmt);
+            return fmt;
+        }
+
+        /**
+         * @return Returns true and skips the value, if the next value is NIL.
+         * 
+         * @throw CMsgPackException If the stream is at its end.
+         */
+        inline bool ReadNil()
+        {
+            CheckStreamPos();
+            if(GetNextType() != MsgFormats::NIL)
+                return false;
+
+            m_Stats.OnDecode(MsgFormats::NIL);
+            m_StreamPos++;
+            return true;
+        }
+
+        /**
+         * @return Reads an array header and returns the element count. Unlike UnpackArray() the bytes aren't counted, since the caller counts them.
+         * 
+         * @throw CMsgPackException If the next value isn't an array.
+         */
+        inline uint32_t ReadArraySize()
+        {
+            switch (ReadNextType())
+            {
+                case MsgFormats::FIXARRAY:
+                case MsgFormats::ARRAY16:
+                case MsgFormats::ARRAY32:
+                {
+                    uint32_t Size = GetSize();
+                    SkipHeader();
+                    return Size;
+                }break;
+
+                default:
+                {
+                    Throw(MsgPackErrorType::INVALID_CAST);
+                }break;
+            }
+        }
+
+        /**
+         * @brief Replaces the placeholders of BeginContainer() with the smallest headers and moves the following data to the front.
+         */
+        inline void ShrinkContainerHeaders()
+        {
+            if(m_Measuring)
+            {
+                for (auto &&p : m_Patches)
+                    m_MeasuredSize -= CONTAINER_PLACEHOLDER - HeaderSize(p.Count);
+
+                m_Patches.clear();
+                return;
+            }
+
+            size_t Write = m_Patches.front().Pos;
+            size_t Read = Write;
+            size_t Ref = m_FirstPatchRef;
+            char *Data = m_Data.data();
+
+            for (size_t i = 0; i <= m_Patches.size(); i++)
+            {
+                size_t End = i < m_Patches.size() ? m_Patches[i].Pos : m_Data.size();
+
+                //References between two headers move by the same distance as the data.
+                for (; Ref < m_References.size() && m_References[Ref].Offset <= End; Ref++)
+                    m_References[Ref].Offset -= Read - Write;
+
+                memmove(Data + Write, Data + Read, End - Read);
+                Write += End - Read;
+
+                if(i < m_Patches.size())
+                {
+                    Write += WriteContainerHeader(Data + Write, m_Patches[i].Count, m_Patches[i].Map);
+                    Read = End + CONTAINER_PLACEHOLDER;
+                }
+            }
+
+            m_Data.resize(Write);
+            m_Patches.clear();
+        }
+
+        static inline size_t HeaderSize(uint32_t Count)
+        {
+            return Count <= (uint32_t)FIXMAP_MAX ? 1 : Count <= UINT16_MAX ? 3 : 5;
+        }
+
+        static inline size_t WriteContainerHeader(char *Out, uint32_t Count, bool Map)
+        {
+            if(Count <= FIXMAP_MAX)
+            {
+                Out[0] = (char)((Map ? MsgFormats::FIXMAP : MsgFormats::FIXARRAY) | Count);
+                return 1;
+            }
+            else if(Count <= UINT16_MAX)
+            {
+                Out[0] = (char)(Map ? MsgFormats::MAP16 : MsgFormats::ARRAY16);
+                MsgPackDetail::Store((uint16_t)Count, Out + 1);
+                return 3;
+            }
+
+            Out[0] = (char)(Map ? MsgFormats::MAP32 : MsgFormats::ARRAY32);
+            MsgPackDetail::Store(Count, Out + 1);
+            return 5;
+        }
+
+        inline void AddPayload(const char *Data, size_t Size, bool Copy = false)
+        {
+            if(m_Measuring)
+                m_MeasuredSize += Size;
+            else if(m_ReferenceThreshold != 0 && Size >= m_ReferenceThreshold && !Copy)
+            {
+                m_Stats.OnWrite(Size);
+                m_References.push_back({m_Data.size(), Data, Size});
+            }
+            else
+            {
+                CountWrite(Size);
+                m_Data.insert(m_Data.end(), Data, Data + Size);
+            }
+        }
+
+        /**
+         * @brief Serializes an object directly into this stream and inserts the map header in front of its pairs afterwards.
+         */
+        template<class T>
+        inline void SerializeObject(const T &Obj)
+        {
+            uint32_t Pairs = m_Pairs;
+            size_t Start = m_Data.size();
+            size_t FirstRef = m_References.size();
+            size_t MeasuredSize = m_MeasuredSize;
+            size_t OpenContainers = m_OpenContainers;
+            size_t Patches = m_Patches.size();
+            size_t Interned = m_InternTable.size();
+
+            if(!m_Measuring)
+                m_Stats.OnNestedObject();
+
+            m_Pairs = 0;
+            try
+            {
+                Obj.Serialize(*this);
+            }
+            catch(...)
+            {
+                //Drops the partial object, so the pack is usable again.
+                m_Pairs = Pairs;
+                m_MeasuredSize = MeasuredSize;
+                m_OpenContainers = OpenContainers;
+                m_Patches.resize(Patches);
+                m_References.resize(FirstRef);
+                ForgetInterned(Interned);
+                if(!m_Measuring)
+                    m_Data.resize(Start);
+
+                throw;
+            }
+
+            uint32_t Count = m_Pairs;
+            m_Pairs = Pairs;
+
+            size_t End = m_Data.size();
+            AddMap(Count);
+            if(m_Measuring)
+                return;
+
+            std::rotate(m_Data.begin() + Start, m_Data.begin() + End, m_Data.end());
+
+            for (size_t i = FirstRef; i < m_References.size(); i++)
+                m_References[i].Offset += m_Data.size() - End;
+        }
+
         template<class T>
         inline void AddBytes(T val)
         {
             val = ChangeEndianess(val, sizeof(T));
-
-            char *CVal = (char*)&val;
-            for (char i = 0; i < sizeof(T); i++)
-                m_Data.push_back(CVal[i]);
+            PutBytes((const char*)&val, sizeof(T));
         }
 
         //----------------------------------------Serialization----------------------------------------
@@ -769,204 +2728,536 @@ class CMessagePack
         template <class T, typename std::enable_if<std::is_integral<T>::value && !std::is_same<T, bool>::value && !std::is_unsigned<T>::value>::type* =nullptr>
         inline void ValueToMsgPack(T val)
         {
-            if (val >= 0 && val <= POS_FIXINT_MAX)
+            if (m_FixedWidth && !m_Canonical)
+            {
+                PutTag(MsgFormats::INT64);
+                AddBytes((int64_t)val);
+            }
+            else if (m_Canonical && val >= 0)
+                ValueToMsgPack((typename std::make_unsigned<T>::type)val);
+            else if (val >= 0 && val <= POS_FIXINT_MAX)
             {
                 uint8_t Tmp = MsgFormats::POSITIVE_FIXINT | (uint8_t)(0xFF & val);
-                m_Data.push_back((char)Tmp);
+                PutTag(Tmp);
             }
             else if(val < 0 && val >= NEG_FIXINT_MAX)
             {
                 uint8_t Tmp = MsgFormats::NEGATIVE_FIXINT | (uint8_t)(0x1F & val);
-                m_Data.push_back((char)Tmp);
+                PutTag(Tmp);
             }
             else if (val >= INT8_MIN && val <= INT8_MAX)
             {
-                m_Data.push_back(MsgFormats::INT8);
-                m_Data.push_back((char)val);
+                PutTag(MsgFormats::INT8);
+                PutByte((char)val);
             }
             else if (val >= INT16_MIN && val <= INT16_MAX)
             {
-                m_Data.push_back(MsgFormats::INT16);
+                PutTag(MsgFormats::INT16);
                 AddBytes((short)val);
             }
             else if (val >= INT32_MIN && val <= INT32_MAX)
             {
-                m_Data.push_back(MsgFormats::INT32);
+                PutTag(MsgFormats::INT32);
                 AddBytes((int)val);
             }
             else if (val >= INT64_MIN && val <= INT64_MAX)
             {
-                m_Data.push_back(MsgFormats::INT64);
+                PutTag(MsgFormats::INT64);
                 AddBytes((int64_t)val);
             }
         }
 
-        template <class T, typename std::enable_if<std::is_integral<T>::value && !std::is_same<T, bool>::value && std::is_unsigned<T>::value>::type* =nullptr>
+        template <class T, typename std::enable_if<std::is_integral<T>::value && !std::is_same<T, bool>::value && std::is_unsigned<T>::value>::type* =nullptr>
+        inline void ValueToMsgPack(T val)
+        {
+            if (m_FixedWidth && !m_Canonical)
+            {
+                PutTag(MsgFormats::UINT64);
+                AddBytes((uint64_t)val);
+            }
+            else if (val <= POS_FIXINT_MAX)
+            {
+                uint8_t Tmp = MsgFormats::POSITIVE_FIXINT | (uint8_t)(0xFF & val);
+                PutTag(Tmp);
+            }
+            else if (val <= UINT8_MAX)
+            {
+                PutTag(MsgFormats::UINT8);
+                PutByte((char)val);
+            }
+            else if (val <= UINT16_MAX)
+            {
+                PutTag(MsgFormats::UINT16);
+                AddBytes((uint16_t)val);
+            }
+            else if (val <= UINT32_MAX)
+            {
+                PutTag(MsgFormats::UINT32);
+                AddBytes((uint32_t)val);
+            }
+            else if (val <= UINT64_MAX)
+            {
+                PutTag(MsgFormats::UINT64);
+                AddBytes((uint64_t)val);
+            }
+        }
+
+        template<class T, typename std::enable_if<std::is_pointer<T>::value && std::is_same<typename std::remove_cv<typename std::remove_pointer<T>::type>::type, char>::value>::type* = nullptr>
+        inline void ValueToMsgPack(T val)
+        {
+            if(val)
+                AddString(val, strlen(val));
+            else
+                ValueToMsgPack(nullptr);
+        }
+        
+        inline void ValueToMsgPack(const std::string &Val)
+        {
+            AddString(Val.data(), Val.size());
+        }
+
+        template<class T, typename std::enable_if<std::is_null_pointer<T>::value>::type* = nullptr>
+        inline void ValueToMsgPack(T val)
+        {
+            PutTag(MsgFormats::NIL);
+        }
+
+        template<class T, typename std::enable_if<std::is_floating_point<T>::value>::type * = nullptr>
+        inline void ValueToMsgPack(T val)
+        {
+            if(m_Narrowing != MsgPackFloatNarrowing::NONE && !(m_FixedWidth && !m_Canonical) && 
+               (sizeof(T) == sizeof(float) || sizeof(T) == sizeof(double)) && AddNarrowed((double)val, sizeof(T) == sizeof(double)))
+                return;
+
+            if(m_FixedWidth && !m_Canonical && sizeof(T) == sizeof(float))
+            {
+                PutTag(MsgFormats::FLOAT64);
+                AddBytes((double)val);
+            }
+            else if(sizeof(T) == sizeof(float))
+            {
+                PutTag(MsgFormats::FLOAT32);
+                AddBytes(val);
+            }
+            else if(sizeof(T) == sizeof(double) || (sizeof(double) == sizeof(float) && sizeof(T) == sizeof(long double)))
+            {
+                PutTag(MsgFormats::FLOAT64);
+                AddBytes(val);
+            }
+        }
+
+        /**
+         * @brief Writes "val" as integer or FLOAT32 if the value stays exact.
+         * 
+         * @param Wide: True if "val" is a double, only doubles can be narrowed to FLOAT32.
+         * @return Returns false if "val" needs its own format.
+         */
+        inline bool AddNarrowed(double val, bool Wide)
+        {
+            //INT32 and UINT32 are never larger than a FLOAT32. The comparisons fail for NaN, so the casts are defined.
+            bool Whole = val >= (double)INT32_MIN && val <= (double)UINT32_MAX && (double)(int64_t)val == val;
+            bool NegativeZero = MsgPackDetail::FloatBits(val) == (1ull << 63);
+            if(m_Narrowing == MsgPackFloatNarrowing::INTEGER && Whole && !NegativeZero)
+            {
+                //The signed overload would write [2^31, 2^32) as INT64.
+                if(val >= 0)
+                    ValueToMsgPack((uint64_t)val);
+                else
+                    ValueToMsgPack((int64_t)val);
+
+                return true;
+            }
+
+            const double Max = std::numeric_limits<float>::max(), Inf = std::numeric_limits<double>::infinity();
+            bool Single = (val >= -Max && val <= Max && (double)(float)val == val) || val == Inf || val == -Inf;
+            if(Wide && Single)
+            {
+                PutTag(MsgFormats::FLOAT32);
+                AddBytes((float)val);
+                return true;
+            }
+
+            return false;
+        }
+
+        template<class T, typename std::enable_if<is_sequence<T>::value && !std::is_same<T, std::string>::value>::type* = nullptr>
+        inline void ValueToMsgPack(const T &val)
+        {
+            if(PackSequence(val))
+                return;
+
+            AddArray(val.size());
+            for (auto &&e : val)
+                ValueToMsgPack(e);            
+        }
+
+        template<class T>
+        struct is_packable
+        {
+            using Type = typename std::decay<decltype(*std::declval<const T&>().begin())>::type;
+            static const bool value = std::is_integral<Type>::value && !std::is_same<Type, bool>::value && !std::is_same<Type, char>::value;
+        };
+
+        template<class T>
+        struct is_float_packable
+        {
+            using Type = typename std::decay<decltype(*std::declval<const T&>().begin())>::type;
+            static const bool value = std::is_floating_point<Type>::value && (sizeof(Type) == sizeof(float) || sizeof(Type) == sizeof(double));
+        };
+
+        template<class T, typename std::enable_if<is_packable<T>::value>::type* = nullptr>
+        inline bool PackSequence(const T &val)
+        {
+            if(m_PackMin == 0 || val.size() < m_PackMin)
+                return false;
+
+            m_PackBuffer.clear();
+            MsgPackDetail::PackIntegers(val, m_PackBuffer);
+            return AddPacked(MsgPackExtTypes::PACKED_INT_ARRAY);
+        }
+
+        template<class T, typename std::enable_if<is_float_packable<T>::value>::type* = nullptr>
+        inline bool PackSequence(const T &val)
+        {
+            if(m_FloatPackMin == 0 || val.size() < m_FloatPackMin)
+                return false;
+
+            m_PackBuffer.clear();
+            MsgPackDetail::PackFloats(val, m_PackBuffer);
+            return AddPacked(MsgPackExtTypes::PACKED_FLOAT_ARRAY);
+        }
+
+        template<class T, typename std::enable_if<!is_packable<T>::value && !is_float_packable<T>::value>::type* = nullptr>
+        inline bool PackSequence(const T &)
+        {
+            return false;
+        }
+
+        inline bool AddPacked(MsgPackExtTypes Type)
+        {
+            if(m_PackBuffer.size() > UINT32_MAX)
+                return false;
+
+            AddExt((int8_t)Type, m_PackBuffer.data(), (uint32_t)m_PackBuffer.size(), true);
+            return true;
+        }
+
+        template <class T, typename std::enable_if<std::is_integral<T>::value && std::is_same<T, bool>::value>::type* =nullptr>
         inline void ValueToMsgPack(T val)
         {
-            if (val <= POS_FIXINT_MAX)
+            PutTag(val ? MsgFormats::TRUE : MsgFormats::FALSE);
+        }
+
+        template<class T, typename std::enable_if<!is_pointer_type<T>::value && is_map<T>::value>::type* = nullptr>
+        inline void ValueToMsgPack(const T &val)
+        {
+            AddMap(val.size());
+            if(m_Canonical && val.size() > 1)
             {
-                uint8_t Tmp = MsgFormats::POSITIVE_FIXINT | (uint8_t)(0xFF & val);
-                m_Data.push_back((char)Tmp);
+                SortedMapToMsgPack(val);
+                return;
             }
-            else if (val <= UINT8_MAX)
+
+            for (auto &&e : val)
             {
-                m_Data.push_back(MsgFormats::UINT8);
-                m_Data.push_back((char)val);
+                ValueToMsgPack(e.first);
+                ValueToMsgPack(e.second);
             }
-            else if (val <= UINT16_MAX)
+        }
+
+        /**
+         * @brief Writes the entries of a map ordered by the encoded bytes of their keys.
+         *        Maps, which already iterate in this order, e.g. std::map with unsigned keys, are only checked and not sorted.
+         *        Equal keys of multimaps keep their order.
+         */
+        template<class T>
+        inline void SortedMapToMsgPack(const T &val)
+        {
+            using Iterator = decltype(val.begin());
+
+            CMessagePack Keys;
+            Keys.m_Canonical = true;
+
+            std::vector<Iterator> Entries;
+            std::vector<size_t> Offsets;
+            Entries.reserve(val.size());
+            Offsets.reserve(val.size() + 1);
+
+            for (auto It = val.begin(); It != val.end(); ++It)
             {
-                m_Data.push_back(MsgFormats::UINT16);
-                AddBytes((uint16_t)val);
+                Entries.push_back(It);
+                Offsets.push_back(Keys.m_Data.size());
+                Keys.ValueToMsgPack(It->first);
             }
-            else if (val <= UINT32_MAX)
+            Offsets.push_back(Keys.m_Data.size());
+
+            const uint8_t *KeyData = (const uint8_t*)Keys.m_Data.data();
+            auto Less = [&](size_t a, size_t b)
             {
-                m_Data.push_back(MsgFormats::UINT32);
-                AddBytes((uint32_t)val);
-            }
-            else if (val <= UINT64_MAX)
+                return std::lexicographical_compare(KeyData + Offsets[a], KeyData + Offsets[a + 1], KeyData + Offsets[b], KeyData + Offsets[b + 1]);
+            };
+
+            std::vector<size_t> Order(Entries.size());
+            for (size_t i = 0; i < Order.size(); i++)
+                Order[i] = i;
+
+            if(!std::is_sorted(Order.begin(), Order.end(), Less))
+                std::stable_sort(Order.begin(), Order.end(), Less);
+
+            for (size_t i : Order)
             {
-                m_Data.push_back(MsgFormats::UINT64);
-                AddBytes((uint64_t)val);
+                ValueToMsgPack(Entries[i]->first);
+                ValueToMsgPack(Entries[i]->second);
             }
         }
 
-        template<class T, typename std::enable_if<std::is_pointer<T>::value && std::is_same<typename std::remove_pointer<T>::type, char>::value>::type* = nullptr>
-        inline void ValueToMsgPack(T val)
+        template<class T, typename std::enable_if<is_object<T>::value>::type* = nullptr>
+        inline void ValueToMsgPack(const T &Obj)
+        {
+            static_assert(std::is_class<T>::value, "Please use structs or objects!");
+            SerializeObject(Obj);
+        }
+
+        //Raw and smart pointers are written as NIL or as the value they point to.
+        template<class T, typename std::enable_if<is_pointer_type<T>::value && !is_char_pointer<T>::value>::type* = nullptr>
+        inline void ValueToMsgPack(const T &obj)
+        {
+            if(!obj)
+                ValueToMsgPack(nullptr);
+            else
+                EngagedToMsgPack(*obj);
+        }
+
+        //The value of a pointer or optional must not be NIL, otherwise it would be read back as empty.
+        template<class T>
+        inline void EngagedToMsgPack(const T &val)
+        {
+            ValueToMsgPack(val);
+        }
+
+        inline void EngagedToMsgPack(const std::string &val)
+        {
+            if(val.empty())
+                AddEmptyString();
+            else
+                ValueToMsgPack(val);
+        }
+
+        template<class T, typename std::enable_if<is_tuple<T>::value>::type* = nullptr>
+        inline void ValueToMsgPack(const T &val)
+        {
+            AddArray(std::tuple_size<T>::value);
+            TupleToMsgPack(val, typename MsgPackDetail::MakeIndexSequence<std::tuple_size<T>::value>::type());
+        }
+
+        template<class T, size_t... I>
+        inline void TupleToMsgPack(const T &val, MsgPackDetail::IndexSequence<I...>)
+        {
+            //The braced list keeps the order of the elements.
+            int Unused[] = {0, (ValueToMsgPack(std::get<I>(val)), 0)...};
+            (void)Unused;
+        }
+
+#ifdef MSGPACK_HAS_OPTIONAL_VARIANT
+        template<class T, typename std::enable_if<is_optional<T>::value>::type* = nullptr>
+        inline void ValueToMsgPack(const T &val)
         {
             if(val)
-                ValueToMsgPack(std::string(val));
+                EngagedToMsgPack(*val);
             else
                 ValueToMsgPack(nullptr);
         }
-        
-        inline void ValueToMsgPack(const std::string &Val)
+
+        //Written as [index, value]. A variant without a value is written as NIL.
+        template<class T, typename std::enable_if<is_variant<T>::value>::type* = nullptr>
+        inline void ValueToMsgPack(const T &val)
         {
-            if(Val.empty())
+            if(val.valueless_by_exception())
             {
                 ValueToMsgPack(nullptr);
                 return;
             }
 
-            if(Val.size() <= FIXSTR_MAX)
-            {
-                uint8_t Tmp = MsgFormats::FIXSTR | (uint8_t)(FIXSTR_MAX & Val.size());
-                m_Data.push_back((char)Tmp);
-            }
-            else if(Val.size() <= UINT8_MAX)
+            AddArray(2);
+            ValueToMsgPack((uint32_t)val.index());
+            std::visit([this](const auto &v) { ValueToMsgPack(v); }, val);
+        }
+#endif
+
+        //----------------------------------------Deserialization----------------------------------------
+
+        /**
+         * @brief Reserves space for "Size" elements. "Size" comes from the stream, so it is limited by the remaining bytes.
+         * 
+         * @param MinBytes: Minimum encoded size of one element.
+         */
+        template<class T, typename std::enable_if<has_traits_reserve<T>::value>::type * = nullptr>
+        inline void ReserveElements(T &Container, uint32_t Size, size_t MinBytes)
+        {
+            MsgPackContainerTraits<T>::Reserve(Container, std::min<size_t>(Size, RemainingBytes() / MinBytes));
+        }
+
+        template<class T, typename std::enable_if<!has_traits_reserve<T>::value && has_reserve<T>::value>::type * = nullptr>
+        inline void ReserveElements(T &Container, uint32_t Size, size_t MinBytes)
+        {
+            Container.reserve(std::min<size_t>(Size, RemainingBytes() / MinBytes));
+        }
+
+        template<class T, typename std::enable_if<!has_traits_reserve<T>::value && !has_reserve<T>::value && !is_std_array<T>::value>::type * = nullptr>
+        inline void ReserveElements(T &, uint32_t, size_t) {}
+
+        template<class T, typename std::enable_if<is_std_array<T>::value>::type * = nullptr>
+        inline void ReserveElements(T &Container, uint32_t Size, size_t)
+        {
+            if(Size != Container.size())
+                Throw(MsgPackErrorType::INVALID_CAST);
+        }
+
+        /**
+         * @brief Reads a PACKED_INT_ARRAY into an integer sequence.
+         */
+        template<class T, typename std::enable_if<is_packable<T>::value>::type * = nullptr>
+        inline void UnpackSequence(T &Container)
+        {
+            uint32_t Size = ReadPackedHeader(MsgPackExtTypes::PACKED_INT_ARRAY);
+            bool Valid = MsgPackDetail::UnpackIntegers(m_Data.data() + m_StreamPos, Size, 
+                [&](uint64_t Count)
+                {
+                    ReservePacked(Container, Count);
+                },
+                [&](size_t Index, int64_t val)
+                {
+                    AddElement(Container, Index, (typename T::value_type)val);
+                });
+
+            if(!Valid)
+                Throw(MsgPackErrorType::INVALID_COMPRESSION);
+
+            m_StreamPos += Size;
+        }
+
+        /**
+         * @brief Reads a PACKED_FLOAT_ARRAY or, like plain arrays of integers, a PACKED_INT_ARRAY into a float or double sequence.
+         */
+        template<class T, typename std::enable_if<is_float_packable<T>::value>::type * = nullptr>
+        inline void UnpackSequence(T &Container)
+        {
+            int8_t Type;
+            uint32_t Size = ReadExtHeader(Type);
+            auto Reserve = [&](uint64_t Count)
             {
-                m_Data.push_back(MsgFormats::STR8);
-                AddBytes((uint8_t)Val.size());
-            }
-            else if(Val.size() <= UINT16_MAX)
+                ReservePacked(Container, Count);
+            };
+
+            bool Valid = false;
+            if(Type == (int8_t)MsgPackExtTypes::PACKED_INT_ARRAY)
             {
-                m_Data.push_back(MsgFormats::STR16);
-                AddBytes((uint16_t)Val.size());
+                Valid = MsgPackDetail::UnpackIntegers(m_Data.data() + m_StreamPos, Size, Reserve,
+                    [&](size_t Index, int64_t val)
+                    {
+                        AddElement(Container, Index, (typename T::value_type)val);
+                    });
             }
-            else if(Val.size() <= UINT32_MAX)
+            else if(Type == (int8_t)MsgPackExtTypes::PACKED_FLOAT_ARRAY)
             {
-                m_Data.push_back(MsgFormats::STR32);
-                AddBytes((uint32_t)Val.size());
+                Valid = MsgPackDetail::UnpackFloats(m_Data.data() + m_StreamPos, Size, Reserve,
+                    [&](size_t Index, uint64_t Bits, unsigned Width)
+                    {
+                        AddElement(Container, Index, MsgPackDetail::FloatFromBits<typename T::value_type>(Bits, Width));
+                    });
             }
+            else
+                Throw(MsgPackErrorType::INVALID_CAST);
 
-            for (uint32_t i = 0; i < (uint32_t)Val.size(); i++)
-                m_Data.push_back(Val[i]);
+            if(!Valid)
+                Throw(MsgPackErrorType::INVALID_COMPRESSION);
+
+            m_StreamPos += Size;
         }
 
-        template<class T, typename std::enable_if<std::is_null_pointer<T>::value>::type* = nullptr>
-        inline void ValueToMsgPack(T val)
+        template<class T, typename std::enable_if<!is_packable<T>::value && !is_float_packable<T>::value>::type * = nullptr>
+        inline void UnpackSequence(T &)
         {
-            m_Data.push_back(MsgFormats::NIL);
+            Throw(MsgPackErrorType::INVALID_CAST);
         }
 
-        template<class T, typename std::enable_if<std::is_floating_point<T>::value>::type * = nullptr>
-        inline void ValueToMsgPack(T val)
+        inline uint32_t ReadPackedHeader(MsgPackExtTypes Expected)
         {
-            if(sizeof(T) == sizeof(float))
-            {
-                m_Data.push_back(MsgFormats::FLOAT32);
-                AddBytes(val);
-            }
-            else if(sizeof(T) == sizeof(double) || (sizeof(double) == sizeof(float) && sizeof(T) == sizeof(long double)))
-            {
-                m_Data.push_back(MsgFormats::FLOAT64);
-                AddBytes(val);
-            }
+            int8_t Type;
+            uint32_t Size = ReadExtHeader(Type);
+            if(Type != (int8_t)Expected)
+                Throw(MsgPackErrorType::INVALID_CAST);
+
+            return Size;
         }
 
-        template<class T, typename std::enable_if<!is_map<T>::value && !is_multimap<T>::value && has_begin_end<T>::value && !std::is_same<T, std::string>::value>::type* = nullptr>
-        inline void ValueToMsgPack(const T &val)
+        template<class T>
+        inline void ReservePacked(T &Container, uint64_t Count)
         {
-            AddArray(val.size());
-            for (auto &&e : val)
-                ValueToMsgPack(e);            
+            if(Count > UINT32_MAX)
+                Throw(MsgPackErrorType::INVALID_COMPRESSION);
+
+            ReserveElements(Container, (uint32_t)Count, 1);
         }
 
-        template <class T, typename std::enable_if<std::is_integral<T>::value && std::is_same<T, bool>::value>::type* =nullptr>
-        inline void ValueToMsgPack(T val)
+        inline size_t RemainingBytes() const
         {
-            m_Data.push_back(val ? MsgFormats::TRUE : MsgFormats::FALSE);
+            return m_Data.size() - std::min(m_StreamPos, m_Data.size());
         }
 
-        template<class T, typename std::enable_if<!is_pointer_type<T>::value && (is_map<T>::value || is_multimap<T>::value)>::type* = nullptr>
-        inline void ValueToMsgPack(const T &val)
+        template<class T, typename std::enable_if<has_traits_insert<T>::value>::type * = nullptr>
+        inline void AddElement(T &Container, size_t, typename T::value_type &&val)
         {
-            AddMap(val.size());
-            for (auto &&e : val)
-            {
-                ValueToMsgPack(e.first);
-                ValueToMsgPack(e.second);
-            }
+            MsgPackContainerTraits<T>::Insert(Container, std::move(val));
         }
 
-        template<class T, typename std::enable_if<!is_pointer_type<T>::value && !has_begin_end<T>::value && std::is_class<T>::value>::type* = nullptr>
-        inline void ValueToMsgPack(const T &Obj)
+        template<class T, typename std::enable_if<!has_traits_insert<T>::value && has_push_back<T>::value>::type * = nullptr>
+        inline void AddElement(T &Container, size_t, typename T::value_type &&val)
         {
-            static_assert(std::is_class<T>::value, "Please use structs or objects!");
-            CMessagePack Tmp;
-            Obj.Serialize(Tmp);
+            Container.push_back(std::move(val));
+        }
 
-            AddMap(Tmp.m_Pairs);
-            auto Data = Tmp.Serialize();
-            m_Data.insert(m_Data.end(), Data.begin(), Data.end());
+        //Sorted input is inserted in constant time with the end hint.
+        template<class T, typename std::enable_if<!has_traits_insert<T>::value && !has_push_back<T>::value && has_emplace_hint<T>::value>::type * = nullptr>
+        inline void AddElement(T &Container, size_t, typename T::value_type &&val)
+        {
+            Container.emplace_hint(Container.end(), std::move(val));
         }
 
-        template<class T, typename std::enable_if<is_pointer_type<T>::value && !has_begin_end<T>::value && std::is_class<T>::value>::type* = nullptr>
-        inline void ValueToMsgPack(const T Obj)
+        template<class T, typename std::enable_if<is_std_array<T>::value>::type * = nullptr>
+        inline void AddElement(T &Container, size_t Index, typename T::value_type &&val)
         {
-            static_assert(std::is_class<T>::value, "Please use structs or objects!");
-            CMessagePack Tmp;
-            Obj->Serialize(Tmp);
+            Container[Index] = std::move(val);
+        }
 
-            AddMap(Tmp.m_Pairs);
-            auto Data = Tmp.Serialize();
-            m_Data.insert(m_Data.end(), Data.begin(), Data.end());
+        template<class T, typename std::enable_if<has_traits_insert_pair<T>::value>::type * = nullptr>
+        inline void AddMapEntry(T &Container, typename T::key_type &&key, typename T::mapped_type &&val)
+        {
+            MsgPackContainerTraits<T>::Insert(Container, std::move(key), std::move(val));
         }
 
-        template<class T, typename std::enable_if<is_pointer_type<T>::value && !has_begin_end<T>::value && std::is_class<typename pointer_type<T>::type>::value>::type* = nullptr>
-        inline void ValueToMsgPack(const T obj)
+        template<class T, typename std::enable_if<!has_traits_insert_pair<T>::value && has_emplace_hint<T>::value>::type * = nullptr>
+        inline void AddMapEntry(T &Container, typename T::key_type &&key, typename T::mapped_type &&val)
         {
-            static_assert(std::is_class<typename std::remove_pointer<T>::type>::value, "Please use structs or objects!");
-            if(!obj)
-                ValueToMsgPack(nullptr);
-            else
-                ValueToMsgPack(*obj);
+            Container.emplace_hint(Container.end(), std::move(key), std::move(val));
         }
 
-        //----------------------------------------Deserialization----------------------------------------
+        template<class T, typename std::enable_if<!has_traits_insert_pair<T>::value && !has_emplace_hint<T>::value>::type * = nullptr>
+        inline void AddMapEntry(T &Container, typename T::key_type &&key, typename T::mapped_type &&val)
+        {
+            Container.emplace(std::move(key), std::move(val));
+        }
 
         inline void CheckStreamPos()
         {
             if(m_StreamPos >= m_Data.size())
-                throw CMsgPackException(MsgPackErrorType::EMPTY_STREAM);
+                Throw(MsgPackErrorType::EMPTY_STREAM);
         }
 
         template<class T, typename std::enable_if<std::is_integral<T>::value && !std::is_same<T, bool>::value>::type * = nullptr>
         inline T MsgPackToValue()
         {
-            CheckStreamPos();
-
-            MsgFormats fmt = GetNextType();
+            MsgFormats fmt = ReadNextType();
             T Ret = 0;
 
             switch (fmt)
@@ -992,13 +3283,13 @@ class CMessagePack
                 {
                     uint32_t Size = GetSize();
                     SkipHeader();
-                    Ret = ReadInt<T>(m_StreamPos, Size);
+                    Ret = (T)ReadTypedInt(fmt, m_StreamPos);
                     m_StreamPos += Size;
                 }break;
 
                 default:
                 {
-                    throw CMsgPackException(MsgPackErrorType::INVALID_CAST);
+                    Throw(MsgPackErrorType::INVALID_CAST);
                 }break;
             }
 
@@ -1008,9 +3299,7 @@ class CMessagePack
         template<class T, typename std::enable_if<std::is_same<T, bool>::value>::type * = nullptr>
         inline T MsgPackToValue()
         {
-            CheckStreamPos();
-
-            MsgFormats fmt = GetNextType();
+            MsgFormats fmt = ReadNextType();
             T Ret;
 
             switch (fmt)
@@ -1027,7 +3316,7 @@ class CMessagePack
             
                 default:
                 {
-                    throw CMsgPackException(MsgPackErrorType::INVALID_CAST);
+                    Throw(MsgPackErrorType::INVALID_CAST);
                 } break;
             }                
 
@@ -1038,9 +3327,7 @@ class CMessagePack
         template<class T, typename std::enable_if<std::is_floating_point<T>::value>::type * = nullptr>
         inline T MsgPackToValue()
         {
-            CheckStreamPos();
-
-            MsgFormats fmt = GetNextType();
+            MsgFormats fmt = ReadNextType();
             T Ret;
 
             switch (fmt)
@@ -1053,56 +3340,47 @@ class CMessagePack
                     Ret = ReadFloat<T>(m_StreamPos, Size);
                     m_StreamPos += Size;
                 }break;
-            
-                default:
-                {
-                    throw CMsgPackException(MsgPackErrorType::INVALID_CAST);
-                } break;
-            }     
-
-            return Ret;
-        }
-
-        template<class T, typename std::enable_if<std::is_same<T, std::string>::value || (has_begin_end<T>::value && !is_multimap<T>::value && !is_map<T>::value && std::is_same<typename T::value_type, char>::value)>::type * = nullptr>
-        inline T MsgPackToValue()
-        {
-            CheckStreamPos();
 
-            MsgFormats fmt = GetNextType();
-            T Ret;
+                //Written by SetFloatNarrowing() or other implementations.
+                case MsgFormats::POSITIVE_FIXINT:
+                case MsgFormats::NEGATIVE_FIXINT:
+                case MsgFormats::INT8:
+                case MsgFormats::INT16:
+                case MsgFormats::INT32:
+                case MsgFormats::INT64:
+                case MsgFormats::UINT8:
+                case MsgFormats::UINT16:
+                case MsgFormats::UINT32:
+                {
+                    Ret = (T)MsgPackToValue<int64_t>();
+                }break;
 
-            switch (fmt)
-            {
-                case MsgFormats::FIXSTR:
-                case MsgFormats::STR8:
-                case MsgFormats::STR16:
-                case MsgFormats::STR32:
-                case MsgFormats::BIN8:
-                case MsgFormats::BIN16:
-                case MsgFormats::BIN32:
+                case MsgFormats::UINT64:
                 {
-                    uint32_t Size = GetSize();
-                    SkipHeader();
-                    auto bytes = ReadBytes(m_StreamPos, Size);
-                    Ret = T(bytes.begin(), bytes.end());
-                    m_StreamPos += Size;
+                    Ret = (T)MsgPackToValue<uint64_t>();
                 }break;
             
                 default:
                 {
-                    throw CMsgPackException(MsgPackErrorType::INVALID_CAST);
+                    Throw(MsgPackErrorType::INVALID_CAST);
                 } break;
             }     
 
             return Ret;
         }
 
-        template<class T, typename std::enable_if<!std::is_same<T, std::string>::value && (has_begin_end<T>::value && !is_multimap<T>::value && !is_map<T>::value && !std::is_same<typename T::value_type, char>::value)>::type * = nullptr>
+        template<class T, typename std::enable_if<std::is_same<T, std::string>::value || (is_sequence<T>::value && has_push_back<T>::value && std::is_same<typename T::value_type, char>::value)>::type * = nullptr>
         inline T MsgPackToValue()
         {
-            CheckStreamPos();
+            uint32_t Length;
+            const char *Str = ReadString(Length);
+            return T(Str, Str + Length);
+        }
 
-            MsgFormats fmt = GetNextType();
+        template<class T, typename std::enable_if<!std::is_same<T, std::string>::value && (is_sequence<T>::value && (!std::is_same<typename T::value_type, char>::value || !has_push_back<T>::value))>::type * = nullptr>
+        inline T MsgPackToValue()
+        {
+            MsgFormats fmt = ReadNextType();
             T Ret;
 
             switch (fmt)
@@ -1114,25 +3392,36 @@ class CMessagePack
                     uint32_t Size = GetSize();
                     SkipHeader();
 
+                    ReserveElements(Ret, Size, 1);
                     for (size_t i = 0; i < Size; i++)
-                        Ret.push_back(MsgPackToValue<typename T::value_type>());
+                        AddElement(Ret, i, MsgPackToValue<typename T::value_type>());
+                }break;
+
+                case MsgFormats::FIXEXT1:
+                case MsgFormats::FIXEXT2:
+                case MsgFormats::FIXEXT4:
+                case MsgFormats::FIXEXT8:
+                case MsgFormats::FIXEXT16:
+                case MsgFormats::EXT8:
+                case MsgFormats::EXT16:
+                case MsgFormats::EXT32:
+                {
+                    UnpackSequence(Ret);
                 }break;
             
                 default:
                 {
-                    throw CMsgPackException(MsgPackErrorType::INVALID_CAST);
+                    Throw(MsgPackErrorType::INVALID_CAST);
                 } break;
             }     
 
             return Ret;
         }
 
-        template<class T, typename std::enable_if<is_multimap<T>::value || is_map<T>::value>::type * = nullptr>
+        template<class T, typename std::enable_if<is_map<T>::value>::type * = nullptr>
         inline T MsgPackToValue()
         {
-            CheckStreamPos();
-
-            MsgFormats fmt = GetNextType();
+            MsgFormats fmt = ReadNextType();
             T Ret;
 
             switch (fmt)
@@ -1144,18 +3433,19 @@ class CMessagePack
                     uint32_t Size = GetSize();
                     SkipHeader();
 
+                    ReserveElements(Ret, Size, 2);   //Every pair needs at least two bytes.
                     for (size_t i = 0; i < Size; i++)
                     {
                         auto key = MsgPackToValue<typename T::key_type>();
                         auto val = MsgPackToValue<typename T::mapped_type>();
 
-                        Ret.insert(std::pair<typename T::key_type, typename T::mapped_type>(key, val));
+                        AddMapEntry(Ret, std::move(key), std::move(val));
                     }
                 }break;
             
                 default:
                 {
-                    throw CMsgPackException(MsgPackErrorType::INVALID_CAST);
+                    Throw(MsgPackErrorType::INVALID_CAST);
                 } break;
             }     
 
@@ -1165,9 +3455,7 @@ class CMessagePack
         template<class T, typename std::enable_if<std::is_null_pointer<T>::value>::type * = nullptr>
         inline T MsgPackToValue()
         {
-            CheckStreamPos();
-
-            MsgFormats fmt = GetNextType();
+            MsgFormats fmt = ReadNextType();
 
             switch (fmt)
             {
@@ -1179,10 +3467,91 @@ class CMessagePack
             
                 default:
                 {
-                    throw CMsgPackException(MsgPackErrorType::INVALID_CAST);
+                    Throw(MsgPackErrorType::INVALID_CAST);
                 } break;
             }     
         }
+
+        //Smart pointers are NULL for NIL. Raw pointers aren't decoded, since nobody would own the memory.
+        template<class T, typename std::enable_if<is_unique_ptr<T>::value>::type * = nullptr>
+        inline T MsgPackToValue()
+        {
+            if(ReadNil())
+                return T();
+
+            return T(new typename pointer_type<T>::type(MsgPackToValue<typename pointer_type<T>::type>()));
+        }
+
+        template<class T, typename std::enable_if<is_shared_ptr<T>::value>::type * = nullptr>
+        inline T MsgPackToValue()
+        {
+            if(ReadNil())
+                return T();
+
+            return std::make_shared<typename pointer_type<T>::type>(MsgPackToValue<typename pointer_type<T>::type>());
+        }
+
+        template<class T, typename std::enable_if<is_tuple<T>::value>::type * = nullptr>
+        inline T MsgPackToValue()
+        {
+            if(ReadArraySize() != std::tuple_size<T>::value)
+                Throw(MsgPackErrorType::INVALID_CAST);
+
+            return MsgPackToTuple<T>(typename MsgPackDetail::MakeIndexSequence<std::tuple_size<T>::value>::type());
+        }
+
+        template<class T, size_t... I>
+        inline T MsgPackToTuple(MsgPackDetail::IndexSequence<I...>)
+        {
+            //Braced initialization evaluates the elements from left to right.
+            return T{MsgPackToValue<typename std::tuple_element<I, T>::type>()...};
+        }
+
+        template<class T, typename std::enable_if<is_object<T>::value && has_deserialize<T>::value>::type * = nullptr>
+        inline T MsgPackToValue()
+        {
+            T Ret;
+            Ret.Deserialize(*this);
+            return Ret;
+        }
+
+#ifdef MSGPACK_HAS_OPTIONAL_VARIANT
+        template<class T, typename std::enable_if<is_optional<T>::value>::type * = nullptr>
+        inline T MsgPackToValue()
+        {
+            if(ReadNil())
+                return T();
+
+            return T(MsgPackToValue<typename T::value_type>());
+        }
+
+        template<class T, typename std::enable_if<is_variant<T>::value>::type * = nullptr>
+        inline T MsgPackToValue()
+        {
+            if(ReadArraySize() != 2)
+                Throw(MsgPackErrorType::INVALID_CAST);
+
+            return MsgPackToVariant<T>(MsgPackToValue<uint32_t>(), typename MsgPackDetail::MakeIndexSequence<std::variant_size<T>::value>::type());
+        }
+
+        template<class T, size_t... I>
+        inline T MsgPackToVariant(uint32_t Index, MsgPackDetail::IndexSequence<I...>)
+        {
+            using Reader = T (CMessagePack::*)();
+            static const Reader Readers[] = {&CMessagePack::MsgPackToAlternative<T, I>...};
+
+            if(Index >= sizeof...(I))
+                Throw(MsgPackErrorType::INVALID_CAST);
+
+            return (this->*Readers[Index])();
+        }
+
+        template<class T, size_t I>
+        inline T MsgPackToAlternative()
+        {
+            return T(std::in_place_index<I>, MsgPackToValue<std::variant_alternative_t<I, T>>());
+        }
+#endif
 };
 
 #endif //MESSAGEPACK_HPP
\ No newline at end of file
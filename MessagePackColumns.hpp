@@ -0,0 +1,279 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2020 Christian Tost
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef MESSAGEPACKCOLUMNS_HPP
+#define MESSAGEPACKCOLUMNS_HPP
+
+#include <unordered_map>
+#include "MessagePack.hpp"
+#include "MessagePackReader.hpp"
+
+/**
+ * @brief Columnar layout for vectors of objects. Instead of one map per record, a single map from every field name
+ *        to the array of its values is written, e.g. {"id": [1, 2], "price": [9.5, 3.0]}. Field names are the keys
+ *        of the AddPair() calls in Serialize(). A record without a field gets an empty ABSENT_FIELD ext in that column,
+ *        so it can't be confused with values written as NIL, like empty strings or null pointers.
+ *        Values of one type next to each other compress much better, and readers of a few fields only touch their columns.
+ *
+ * Example:
+ *  CMsgPackColumns::Add(Pack, Records);
+ *  std::vector<CRecord> Rows = CMsgPackColumns::Get<CRecord>(Pack);
+ *
+ *  CMsgPackColumns Columns(Data, Size);
+ *  std::vector<double> Prices = Columns.GetColumn<double>("price");
+ */
+class CMsgPackColumns
+{
+    public:
+        /**
+         * @brief Parses the columns of an encoded columnar value. Nothing is copied, "Data" must stay valid.
+         *
+         * @throw CMsgPackException If the value isn't a map of arrays with the same size.
+         */
+        CMsgPackColumns(const char *Data, size_t Size) : m_Rows(0)
+        {
+            CMsgPackReader Reader(Data, Size);
+            Parse(Reader);
+        }
+
+        explicit CMsgPackColumns(const std::vector<char> &Data) : CMsgPackColumns(Data.data(), Data.size()) {}
+
+        /**
+         * @brief Writes "Records" in columnar layout.
+         */
+        template<class T>
+        static inline void Add(CMessagePack &Pack, const std::vector<T> &Records)
+        {
+            CMessagePack Rows;
+            for (auto &&r : Records)
+                Rows.AddValue(r);
+
+            std::vector<SColumn> Columns;
+            std::unordered_map<std::string, size_t> Index;
+            CMsgPackReader Reader(Rows.GetData());
+
+            for (size_t Row = 0; Row < Records.size(); Row++)
+            {
+                uint32_t Pairs = Reader.ReadMap();
+                for (uint32_t i = 0; i < Pairs; i++)
+                {
+                    SMsgPackView Key = View(Reader);
+                    SMsgPackView Value = View(Reader);
+
+                    //Records usually write their fields in the same order, so the hash lookup is mostly skipped.
+                    size_t Column = i;
+                    if(Column >= Columns.size() || !Equal(Columns[Column].Key, Key))
+                    {
+                        auto It = Index.emplace(std::string(Key.Data, Key.Size), Columns.size());
+                        if(It.second)
+                            Columns.push_back({Key, {nullptr, 0}, std::vector<SMsgPackView>(Records.size(), {nullptr, 0})});
+
+                        Column = It.first->second;
+                    }
+
+                    Columns[Column].Values[Row] = Value;
+                }
+            }
+
+            Pack.AddMap(Columns.size());
+            for (auto &&c : Columns)
+            {
+                Pack.AddEncoded(c.Key.Data, c.Key.Size);
+                Pack.AddArray(Records.size());
+
+                for (auto &&v : c.Values)
+                {
+                    if(v.Data)
+                        Pack.AddEncoded(v.Data, v.Size);
+                    else
+                        Pack.AddExt(MsgPackExtTypes::ABSENT_FIELD, nullptr, 0);
+                }
+            }
+        }
+
+        /**
+         * @brief Reads a value written with Add() and rebuilds the records with their Deserialize() method.
+         *        Absent cells are left out of the rebuilt records, so the fields keep their defaults.
+         *
+         * @throw CMsgPackException If the value isn't a map of arrays with the same size or a record can't be decoded.
+         */
+        template<class T>
+        static inline std::vector<T> Get(CMessagePack &Pack)
+        {
+            CMsgPackReader Reader(Pack.GetData());
+            Reader.SetPos(Pack.GetStreamPos());
+
+            CMsgPackColumns Columns;
+            Columns.Parse(Reader);
+            Pack.SkipValue();
+
+            std::vector<CMsgPackReader> Cursors;
+            for (auto &&c : Columns.m_Columns)
+            {
+                Cursors.emplace_back(c.Array.Data, c.Array.Size);
+                Cursors.back().ReadArray();
+            }
+
+            std::vector<T> Ret;
+            Ret.reserve(Columns.m_Rows);
+
+            CMessagePack Row;
+            std::vector<SMsgPackView> Values(Cursors.size());
+            for (size_t r = 0; r < Columns.m_Rows; r++)
+            {
+                uint32_t Pairs = 0;
+                for (size_t c = 0; c < Cursors.size(); c++)
+                {
+                    Values[c] = View(Cursors[c]);
+                    Pairs += !IsAbsent(Values[c]);
+                }
+
+                Row.Clear();
+                Row.AddMap(Pairs);
+                for (size_t c = 0; c < Cursors.size(); c++)
+                {
+                    if(IsAbsent(Values[c]))
+                        continue;
+
+                    Row.AddEncoded(Columns.m_Columns[c].Key.Data, Columns.m_Columns[c].Key.Size);
+                    Row.AddEncoded(Values[c].Data, Values[c].Size);
+                }
+
+                Row.Deserialize(Row.Detach());
+                Ret.push_back(Row.GetValue<T>());
+            }
+
+            return Ret;
+        }
+
+        /**
+         * @return Returns the count of records.
+         */
+        inline size_t GetRowCount() const
+        {
+            return m_Rows;
+        }
+
+        /**
+         * @return Returns the encoded array of a column or an empty view, if no record has the field.
+         */
+        inline SMsgPackView GetColumnView(const std::string &Name) const
+        {
+            CMessagePack Key;
+            Key.AddValue(Name);
+
+            for (auto &&c : m_Columns)
+            {
+                if(Equal(c.Key, {Key.GetData().data(), Key.GetData().size()}))
+                    return c.Array;
+            }
+
+            return {nullptr, 0};
+        }
+
+        /**
+         * @return Returns the values of a column without touching the other columns. Records without the field get "T()".
+         *
+         * @throw CMsgPackException If no record has the field or a value doesn't match "T".
+         */
+        template<class T>
+        inline std::vector<T> GetColumn(const std::string &Name) const
+        {
+            SMsgPackView Column = GetColumnView(Name);
+            if(!Column.Data)
+                throw CMsgPackException(MsgPackErrorType::INVALID_CAST);
+
+            CMessagePack Pack;
+            Pack.Deserialize(std::vector<char>(Column.Data, Column.Data + Column.Size));
+
+            std::vector<T> Ret;
+            uint32_t Rows = Pack.UnpackArray();
+            Ret.reserve(std::min<size_t>(Rows, Column.Size));
+            for (uint32_t i = 0; i < Rows; i++)
+            {
+                const std::vector<char> &Data = Pack.GetData();
+                size_t Pos = std::min(Pack.GetStreamPos(), Data.size());
+                size_t Left = Data.size() - Pos;
+                if(IsAbsent({Data.data() + Pos, Left < ABSENT_SIZE ? Left : ABSENT_SIZE}))
+                {
+                    Pack.SkipValue();
+                    Ret.emplace_back();
+                }
+                else
+                    Ret.push_back(Pack.GetValue<T>());
+            }
+
+            return Ret;
+        }
+
+        ~CMsgPackColumns() {}
+    private:
+        struct SColumn
+        {
+            SMsgPackView Key;
+            SMsgPackView Array;                 //!< Encoded column, only set while reading.
+            std::vector<SMsgPackView> Values;   //!< Value of every record, only set while writing.
+        };
+
+        std::vector<SColumn> m_Columns;
+        size_t m_Rows;
+
+        CMsgPackColumns() : m_Rows(0) {}
+
+        inline void Parse(CMsgPackReader &Reader)
+        {
+            uint32_t Count = Reader.ReadMap();
+            for (uint32_t i = 0; i < Count; i++)
+            {
+                SMsgPackView Key = View(Reader);
+                SMsgPackItem Item = Reader.Peek();
+                if(CMsgPackReader::IsMap(Item.Format) || !CMsgPackReader::IsContainer(Item.Format) || (i != 0 && Item.Length != m_Rows))
+                    throw CMsgPackException(MsgPackErrorType::INVALID_CAST);
+
+                m_Rows = Item.Length;
+                m_Columns.push_back({Key, View(Reader), {}});
+            }
+        }
+
+        static inline SMsgPackView View(CMsgPackReader &Reader)
+        {
+            size_t Start = Reader.GetPos();
+            Reader.SkipValue();
+            return {Reader.GetData() + Start, Reader.GetPos() - Start};
+        }
+
+        static inline bool Equal(const SMsgPackView &a, const SMsgPackView &b)
+        {
+            return a.Size == b.Size && memcmp(a.Data, b.Data, a.Size) == 0;
+        }
+
+        static const size_t ABSENT_SIZE = 3;   //!< EXT8 tag, zero size and type.
+
+        static inline bool IsAbsent(const SMsgPackView &v)
+        {
+            return v.Size == ABSENT_SIZE && (uint8_t)v.Data[0] == MsgFormats::EXT8 && v.Data[1] == 0 && v.Data[2] == (char)MsgPackExtTypes::ABSENT_FIELD;
+        }
+};
+
+#endif //MESSAGEPACKCOLUMNS_HPP
@@ -0,0 +1,634 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2020 Christian Tost
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef MESSAGEPACKCOMPRESS_HPP
+#define MESSAGEPACKCOMPRESS_HPP
+
+#include <ostream>
+#include "MessagePack.hpp"
+#include "MessagePackReader.hpp"
+
+/**
+ * Chunked compression of whole streams. A compressed stream is itself valid messagepack:
+ *
+ *  COMPRESSED_HEADER ext:  [version u8] [chunk size u32]
+ *  COMPRESSED_CHUNK ext:   [method u8] [uncompressed size u32] [data]     (repeated)
+ *
+ * Every chunk is compressed on its own, so chunks can be decompressed in any order.
+ * Method 0 stores the data as it is, every other method is the ID of a codec.
+ *
+ * A codec is a class with the static members:
+ *  ID                                              Method byte of the chunks, 1 - 255.
+ *  size_t MaxCompressedSize(size_t Size)           Output size Compress() needs at most.
+ *  size_t MaxDecompressedSize(size_t Size)         Largest output a valid input of "Size" bytes can have.
+ *  size_t Compress(const char *In, size_t Size, char *Out)
+ *  void Decompress(const char *In, size_t Size, char *Out, size_t OutSize)    Throws if "Out" isn't filled exactly.
+ *
+ * Example:
+ *  std::vector<char> Archive = CMsgPackCompressor<>::Serialize(Pack);
+ *  CMsgPackDecompressor<>::Deserialize(Pack, std::move(Archive));   //Accepts plain streams as well.
+ */
+
+/**
+ * @brief Bundled LZ77 codec without entropy coding, in the spirit of LZ4.
+ *        Sequences are [token] [literal length] [literals] [offset u16 LE] [match length],
+ *        the token holds 4 bits of each length and 255 continues a length.
+ */
+class CMsgPackLZ
+{
+    public:
+        static const uint8_t ID = 1;
+
+        static inline size_t MaxCompressedSize(size_t Size)
+        {
+            return Size + Size / 255 + 16;
+        }
+
+        static inline size_t MaxDecompressedSize(size_t Size)
+        {
+            return Size * 255 + MIN_MATCH;
+        }
+
+        /**
+         * @return Returns the compressed size. "Out" must hold MaxCompressedSize(Size) bytes.
+         */
+        static inline size_t Compress(const char *Input, size_t Size, char *Output)
+        {
+            const uint8_t *In = (const uint8_t*)Input;
+            const uint8_t *End = In + Size;
+            const uint8_t *Anchor = In;
+            uint8_t *Out = (uint8_t*)Output;
+
+            if(Size > MIN_INPUT)
+            {
+                uint32_t Table[1 << HASH_BITS] = {};
+                const uint8_t *Pos = In;
+                const uint8_t *Limit = End - MIN_INPUT;
+
+                while (Pos < Limit)
+                {
+                    uint32_t Seq = Read32(Pos);
+                    uint32_t &Slot = Table[Hash(Seq)];
+                    const uint8_t *Ref = In + Slot;
+                    Slot = (uint32_t)(Pos - In);
+
+                    if(Ref >= Pos || (size_t)(Pos - Ref) > MAX_OFFSET || Read32(Ref) != Seq)
+                    {
+                        //Incompressible data is crossed faster.
+                        Pos += 1 + ((Pos - Anchor) >> SKIP_SHIFT);
+                        continue;
+                    }
+
+                    while (Pos > Anchor && Ref > In && Pos[-1] == Ref[-1])
+                    {
+                        Pos--;
+                        Ref--;
+                    }
+
+                    const uint8_t *MatchEnd = Pos + MIN_MATCH;
+                    const uint8_t *RefEnd = Ref + MIN_MATCH;
+                    while (MatchEnd < End - LAST_LITERALS && *MatchEnd == *RefEnd)
+                    {
+                        MatchEnd++;
+                        RefEnd++;
+                    }
+
+                    uint8_t *Token = Out;
+                    Out = WriteSequence(Out, Anchor, Pos - Anchor);
+                    *Out++ = (uint8_t)(Pos - Ref);
+                    *Out++ = (uint8_t)((Pos - Ref) >> 8);
+
+                    size_t Match = MatchEnd - Pos - MIN_MATCH;
+                    if(Match >= 15)
+                    {
+                        *Token |= 15;
+                        Out = WriteLength(Out, Match - 15);
+                    }
+                    else
+                        *Token |= (uint8_t)Match;
+
+                    Pos = MatchEnd;
+                    Anchor = Pos;
+                }
+            }
+
+            //The last sequence has only literals.
+            Out = WriteSequence(Out, Anchor, End - Anchor);
+            return Out - (uint8_t*)Output;
+        }
+
+        /**
+         * @brief Decompresses "Input" into exactly "OutSize" bytes. Every read and write is bounds checked.
+         *
+         * @throw CMsgPackException If the input is malformed or doesn't fill the output.
+         */
+        static inline void Decompress(const char *Input, size_t Size, char *Output, size_t OutSize)
+        {
+            const uint8_t *In = (const uint8_t*)Input;
+            const uint8_t *InEnd = In + Size;
+            uint8_t *Out = (uint8_t*)Output;
+            uint8_t *OutEnd = Out + OutSize;
+
+            while (true)
+            {
+                if(In >= InEnd)
+                    throw CMsgPackException(MsgPackErrorType::INVALID_COMPRESSION);
+
+                uint8_t Token = *In++;
+                size_t Literals = Token >> 4;
+                if(Literals == 15)
+                    Literals += ReadLength(In, InEnd, OutSize);
+
+                if(Literals > (size_t)(InEnd - In) || Literals > (size_t)(OutEnd - Out))
+                    throw CMsgPackException(MsgPackErrorType::INVALID_COMPRESSION);
+
+                if(Literals != 0)
+                    memcpy(Out, In, Literals);
+
+                In += Literals;
+                Out += Literals;
+
+                if(In == InEnd)
+                    break;
+
+                if(InEnd - In < 2)
+                    throw CMsgPackException(MsgPackErrorType::INVALID_COMPRESSION);
+
+                size_t Offset = In[0] | ((size_t)In[1] << 8);
+                In += 2;
+
+                size_t Match = Token & 15;
+                if(Match == 15)
+                    Match += ReadLength(In, InEnd, OutSize);
+
+                Match += MIN_MATCH;
+                if(Offset == 0 || Offset > (size_t)(Out - (uint8_t*)Output) || Match > (size_t)(OutEnd - Out))
+                    throw CMsgPackException(MsgPackErrorType::INVALID_COMPRESSION);
+
+                //Overlapping matches repeat the last "Offset" bytes, so they are copied forward byte by byte.
+                const uint8_t *Ref = Out - Offset;
+                if(Offset >= Match)
+                    memcpy(Out, Ref, Match);
+                else
+                {
+                    for (size_t i = 0; i < Match; i++)
+                        Out[i] = Ref[i];
+                }
+
+                Out += Match;
+            }
+
+            if(Out != OutEnd)
+                throw CMsgPackException(MsgPackErrorType::INVALID_COMPRESSION);
+        }
+
+    private:
+        const static int HASH_BITS = 12;
+        const static int SKIP_SHIFT = 6;
+        const static size_t MIN_MATCH = 4;
+        const static size_t LAST_LITERALS = 5;     //!< Matches end before the last bytes, so the final sequence always has literals.
+        const static size_t MIN_INPUT = 12;        //!< Smaller inputs are stored as literals.
+        const static size_t MAX_OFFSET = UINT16_MAX;
+
+        static inline uint32_t Read32(const uint8_t *p)
+        {
+            uint32_t Ret;
+            memcpy(&Ret, p, sizeof(Ret));
+            return Ret;
+        }
+
+        static inline uint32_t Hash(uint32_t Seq)
+        {
+            return (Seq * 2654435761u) >> (32 - HASH_BITS);
+        }
+
+        static inline uint8_t *WriteLength(uint8_t *Out, size_t Length)
+        {
+            while (Length >= 255)
+            {
+                *Out++ = 255;
+                Length -= 255;
+            }
+
+            *Out++ = (uint8_t)Length;
+            return Out;
+        }
+
+        //Writes the token and the literals of a sequence. The token is the first byte, its match length is added afterwards.
+        static inline uint8_t *WriteSequence(uint8_t *Out, const uint8_t *Literals, size_t Count)
+        {
+            if(Count >= 15)
+            {
+                *Out++ = 15 << 4;
+                Out = WriteLength(Out, Count - 15);
+            }
+            else
+                *Out++ = (uint8_t)(Count << 4);
+
+            if(Count != 0)
+                memcpy(Out, Literals, Count);
+
+            return Out + Count;
+        }
+
+        static inline size_t ReadLength(const uint8_t *&In, const uint8_t *End, size_t Max)
+        {
+            size_t Ret = 0;
+            uint8_t c;
+            do
+            {
+                if(In >= End || Ret > Max)
+                    throw CMsgPackException(MsgPackErrorType::INVALID_COMPRESSION);
+
+                c = *In++;
+                Ret += c;
+            } while (c == 255);
+
+            return Ret;
+        }
+};
+
+namespace MsgPackCompress
+{
+    const static uint8_t VERSION = 1;
+    const static uint8_t STORED = 0;                //!< Method of chunks which didn't get smaller.
+    const static size_t HEADER_SIZE = 3 + 5;        //!< Ext8 header and payload of the COMPRESSED_HEADER.
+    const static size_t CHUNK_HEADER_SIZE = 6 + 5;  //!< Ext32 header, method and uncompressed size. Chunks always use ext32, so the size is fixed.
+} // namespace MsgPackCompress
+
+/**
+ * @brief Writes a compressed stream into a buffer or a std::ostream.
+ *
+ * @tparam Codec: Compression of the chunks, see the top of this file.
+ */
+template<class Codec = CMsgPackLZ>
+class CMsgPackCompressor
+{
+    public:
+        const static size_t DEFAULT_CHUNK_SIZE = 256 * 1024;
+
+        /**
+         * @param Out: Receives the compressed stream. The content is appended.
+         * @param ChunkSize: Uncompressed size of a chunk.
+         */
+        CMsgPackCompressor(std::vector<char> &Out, size_t ChunkSize = DEFAULT_CHUNK_SIZE) : m_Out(&Out), m_Stream(nullptr), m_ChunkSize(ClampChunkSize(ChunkSize)), m_HeaderWritten(false) {}
+
+        /**
+         * @param Stream: Receives the compressed stream chunk by chunk.
+         * @param ChunkSize: Uncompressed size of a chunk.
+         */
+        CMsgPackCompressor(std::ostream &Stream, size_t ChunkSize = DEFAULT_CHUNK_SIZE) : m_Out(nullptr), m_Stream(&Stream), m_ChunkSize(ClampChunkSize(ChunkSize)), m_HeaderWritten(false) {}
+
+        /**
+         * @brief Appends data to the current chunk. Chunks are only finished between two calls, so values written with one call
+         *        start and end in the same chunk, unless the data is larger than a chunk.
+         */
+        inline void Write(const char *Data, size_t Size)
+        {
+            if(!m_Pending.empty() && m_Pending.size() + Size > m_ChunkSize)
+                Flush();
+
+            while (Size > m_ChunkSize)
+            {
+                WriteChunk(Data, m_ChunkSize);
+                Data += m_ChunkSize;
+                Size -= m_ChunkSize;
+            }
+
+            m_Pending.insert(m_Pending.end(), Data, Data + Size);
+        }
+
+        inline void Write(const std::vector<char> &Data)
+        {
+            Write(Data.data(), Data.size());
+        }
+
+        /**
+         * @brief Appends the stream of a pack, including referenced payloads.
+         */
+        inline void Write(const CMessagePack &Pack)
+        {
+            if(Pack.GetSerializedSize() == Pack.GetData().size())
+                Write(Pack.GetData());
+            else
+            {
+                auto Tmp = Pack.SerializeWithoutWipe();
+                Write(Tmp);
+            }
+        }
+
+        /**
+         * @brief Compresses the pending data as chunk. Has to be called after the last write.
+         */
+        inline void Flush()
+        {
+            WriteHeader();
+            if(!m_Pending.empty())
+            {
+                WriteChunk(m_Pending.data(), m_Pending.size());
+                m_Pending.clear();
+            }
+        }
+
+        /**
+         * @return Returns "Data" as compressed stream.
+         */
+        static inline std::vector<char> Compress(const char *Data, size_t Size, size_t ChunkSize = DEFAULT_CHUNK_SIZE)
+        {
+            std::vector<char> Ret;
+            Ret.reserve(MsgPackCompress::HEADER_SIZE + Codec::MaxCompressedSize(Size) / 2);
+
+            CMsgPackCompressor Compressor(Ret, ChunkSize);
+            Compressor.Write(Data, Size);
+            Compressor.Flush();
+            return Ret;
+        }
+
+        static inline std::vector<char> Compress(const std::vector<char> &Data, size_t ChunkSize = DEFAULT_CHUNK_SIZE)
+        {
+            return Compress(Data.data(), Data.size(), ChunkSize);
+        }
+
+        /**
+         * @return Returns the compressed stream of a pack and clears the pack, like CMessagePack::Serialize().
+         */
+        static inline std::vector<char> Serialize(CMessagePack &Pack, size_t ChunkSize = DEFAULT_CHUNK_SIZE)
+        {
+            std::vector<char> Ret;
+            CMsgPackCompressor Compressor(Ret, ChunkSize);
+            Compressor.Write(Pack);
+            Compressor.Flush();
+
+            Pack.Clear();
+            return Ret;
+        }
+
+        ~CMsgPackCompressor() {}
+    private:
+        std::vector<char> *m_Out;
+        std::ostream *m_Stream;
+        size_t m_ChunkSize;
+        bool m_HeaderWritten;
+        std::vector<char> m_Pending;
+        std::vector<char> m_Buffer;     //!< Output of a chunk, if it is written to a stream.
+
+        static inline size_t ClampChunkSize(size_t ChunkSize)
+        {
+            return std::max<size_t>(1, std::min<size_t>(ChunkSize, UINT32_MAX / 2));
+        }
+
+        //Space for "Size" output bytes. Buffers are written in place.
+        inline char *Reserve(size_t Size)
+        {
+            if(m_Out)
+            {
+                m_Out->resize(m_Out->size() + Size);
+                return m_Out->data() + m_Out->size() - Size;
+            }
+
+            m_Buffer.resize(Size);
+            return m_Buffer.data();
+        }
+
+        //Keeps "Used" of the "Reserved" bytes.
+        inline void Commit(size_t Reserved, size_t Used)
+        {
+            if(m_Out)
+                m_Out->resize(m_Out->size() - Reserved + Used);
+            else
+                m_Stream->write(m_Buffer.data(), Used);
+        }
+
+        inline void WriteHeader()
+        {
+            if(m_HeaderWritten)
+                return;
+
+            char *Out = Reserve(MsgPackCompress::HEADER_SIZE);
+            Out[0] = (char)MsgFormats::EXT8;
+            Out[1] = 5;
+            Out[2] = (char)MsgPackExtTypes::COMPRESSED_HEADER;
+            Out[3] = (char)MsgPackCompress::VERSION;
+            MsgPackDetail::Store((uint32_t)m_ChunkSize, Out + 4);
+            Commit(MsgPackCompress::HEADER_SIZE, MsgPackCompress::HEADER_SIZE);
+
+            m_HeaderWritten = true;
+        }
+
+        inline void WriteChunk(const char *Data, size_t Size)
+        {
+            WriteHeader();
+
+            size_t Reserved = MsgPackCompress::CHUNK_HEADER_SIZE + std::max(Size, Codec::MaxCompressedSize(Size));
+            char *Out = Reserve(Reserved);
+            char *Payload = Out + MsgPackCompress::CHUNK_HEADER_SIZE;
+
+            uint8_t Method = Codec::ID;
+            size_t Packed = Codec::Compress(Data, Size, Payload);
+            if(Packed >= Size)
+            {
+                Method = MsgPackCompress::STORED;
+                Packed = Size;
+                memcpy(Payload, Data, Size);
+            }
+
+            Out[0] = (char)MsgFormats::EXT32;
+            MsgPackDetail::Store((uint32_t)(5 + Packed), Out + 1);
+            Out[5] = (char)MsgPackExtTypes::COMPRESSED_CHUNK;
+            Out[6] = (char)Method;
+            MsgPackDetail::Store((uint32_t)Size, Out + 7);
+            Commit(Reserved, MsgPackCompress::CHUNK_HEADER_SIZE + Packed);
+        }
+};
+
+/**
+ * @brief Reads a compressed stream. The chunks are indexed on construction, so every chunk can be decompressed on its own.
+ *        The stream isn't copied and has to stay valid.
+ *
+ * @tparam Codec: Compression of the chunks, see the top of this file.
+ */
+template<class Codec = CMsgPackLZ>
+class CMsgPackDecompressor
+{
+    public:
+        struct SChunk
+        {
+            const char *Data;       //!< Compressed data inside the stream.
+            uint32_t Size;          //!< Compressed size.
+            uint8_t Method;
+            uint32_t Length;        //!< Uncompressed size.
+            uint64_t Position;      //!< Position of the first uncompressed byte.
+        };
+
+        /**
+         * @throw CMsgPackException If the stream isn't compressed or a header is malformed.
+         */
+        CMsgPackDecompressor(const char *Data, size_t Size) : m_Size(0), m_ChunkSize(0)
+        {
+            if(!IsCompressed(Data, Size))
+                throw CMsgPackException(MsgPackErrorType::INVALID_COMPRESSION);
+
+            CMsgPackReader Reader(Data, Size);
+            int8_t Type;
+            uint32_t Length;
+            const char *Payload = Reader.ReadExt(Type, Length);
+            if(Length < 5 || (uint8_t)Payload[0] != MsgPackCompress::VERSION)
+                throw CMsgPackException(MsgPackErrorType::INVALID_COMPRESSION);
+
+            MsgPackDetail::Load(Payload + 1, m_ChunkSize);
+
+            while (!Reader.AtEnd())
+            {
+                Payload = Reader.ReadExt(Type, Length);
+                if(Type != MsgPackExtTypes::COMPRESSED_CHUNK || Length < 5)
+                    throw CMsgPackException(MsgPackErrorType::INVALID_COMPRESSION);
+
+                SChunk Chunk = {Payload + 5, Length - 5, (uint8_t)Payload[0], 0, m_Size};
+                MsgPackDetail::Load(Payload + 1, Chunk.Length);
+
+                //Rejects sizes no valid chunk can have, before anything is allocated.
+                if(Chunk.Method == MsgPackCompress::STORED ? Chunk.Length != Chunk.Size : 
+                   (Chunk.Method != Codec::ID || Chunk.Length > Codec::MaxDecompressedSize(Chunk.Size)))
+                    throw CMsgPackException(MsgPackErrorType::INVALID_COMPRESSION);
+
+                m_Chunks.push_back(Chunk);
+                m_Size += Chunk.Length;
+            }
+        }
+
+        explicit CMsgPackDecompressor(const std::vector<char> &Data) : CMsgPackDecompressor(Data.data(), Data.size()) {}
+
+        /**
+         * @return Returns true if "Data" starts with a COMPRESSED_HEADER.
+         */
+        static inline bool IsCompressed(const char *Data, size_t Size)
+        {
+            if(Size < MsgPackCompress::HEADER_SIZE)
+                return false;
+
+            try
+            {
+                SMsgPackItem Item = CMsgPackReader(Data, Size).Peek();
+                return CMsgPackReader::IsExt(Item.Format) && Item.ExtType == MsgPackExtTypes::COMPRESSED_HEADER;
+            }
+            catch(const CMsgPackException &)
+            {
+                return false;
+            }
+        }
+
+        inline size_t GetChunkCount() const
+        {
+            return m_Chunks.size();
+        }
+
+        inline const SChunk &GetChunk(size_t Index) const
+        {
+            return m_Chunks.at(Index);
+        }
+
+        /**
+         * @return Returns the chunk size the stream was written with.
+         */
+        inline uint32_t GetChunkSize() const
+        {
+            return m_ChunkSize;
+        }
+
+        /**
+         * @return Returns the uncompressed size of the stream.
+         */
+        inline uint64_t GetSize() const
+        {
+            return m_Size;
+        }
+
+        /**
+         * @brief Decompresses a chunk into "Out", which must hold GetChunk(Index).Length bytes.
+         *
+         * @throw CMsgPackException If the chunk is malformed.
+         */
+        inline void DecompressChunk(size_t Index, char *Out) const
+        {
+            const SChunk &Chunk = m_Chunks.at(Index);
+            if(Chunk.Method == MsgPackCompress::STORED)
+            {
+                if(Chunk.Length != 0)
+                    memcpy(Out, Chunk.Data, Chunk.Length);
+            }
+            else
+                Codec::Decompress(Chunk.Data, Chunk.Size, Out, Chunk.Length);
+        }
+
+        /**
+         * @brief Appends the decompressed chunk to "Out".
+         */
+        inline void DecompressChunk(size_t Index, std::vector<char> &Out) const
+        {
+            size_t Pos = Out.size();
+            Out.resize(Pos + m_Chunks.at(Index).Length);
+            DecompressChunk(Index, Out.data() + Pos);
+        }
+
+        /**
+         * @return Returns the whole uncompressed stream.
+         */
+        inline std::vector<char> Decompress() const
+        {
+            std::vector<char> Ret(m_Size);
+            for (size_t i = 0; i < m_Chunks.size(); i++)
+                DecompressChunk(i, Ret.data() + m_Chunks[i].Position);
+
+            return Ret;
+        }
+
+        static inline std::vector<char> Decompress(const char *Data, size_t Size)
+        {
+            return CMsgPackDecompressor(Data, Size).Decompress();
+        }
+
+        static inline std::vector<char> Decompress(const std::vector<char> &Data)
+        {
+            return Decompress(Data.data(), Data.size());
+        }
+
+        /**
+         * @brief Loads a compressed or plain stream into "Pack" for deserialization.
+         */
+        static inline void Deserialize(CMessagePack &Pack, std::vector<char> &&Data)
+        {
+            if(IsCompressed(Data.data(), Data.size()))
+                Pack.Deserialize(Decompress(Data));
+            else
+                Pack.Deserialize(std::move(Data));
+        }
+
+        ~CMsgPackDecompressor() {}
+    private:
+        std::vector<SChunk> m_Chunks;
+        uint64_t m_Size;
+        uint32_t m_ChunkSize;
+};
+
+#endif //MESSAGEPACKCOMPRESS_HPP
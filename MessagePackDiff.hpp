@@ -0,0 +1,436 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2020 Christian Tost
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef MESSAGEPACKDIFF_HPP
+#define MESSAGEPACKDIFF_HPP
+
+#include <unordered_map>
+#include <unordered_set>
+#include "MessagePack.hpp"
+#include "MessagePackReader.hpp"
+#include "MessagePackPatch.hpp"
+
+/**
+ * @brief Structural diff and merge of two encoded documents without decoding them.
+ *        Subtrees with equal bytes are skipped with a single memcmp, maps are matched by the encoded bytes of their keys
+ *        and arrays by index. A changed container is replaced as a whole, if that is smaller than the changes inside it.
+ *
+ *        The delta is itself a messagepack array of operations:
+ *          [path, value]   Sets the value at "path". An index equal to the array size appends, an unknown map key is added.
+ *          [path]          Removes the map entry or the array element at "path".
+ *        A path is an array of encoded map keys and array indices, the empty path is the whole document.
+ *
+ *        Only the first value of the buffers is compared. Interned strings aren't supported, since equal references
+ *        of two streams may point to different strings.
+ *
+ * Example:
+ *  std::vector<char> Delta = CMsgPackDiff::Diff(Replica, State);
+ *  CMsgPackDiff::Apply(Replica, Delta);
+ */
+class CMsgPackDiff
+{
+    public:
+        /**
+         * @return Returns the delta, which turns "Old" into "New".
+         *
+         * @throw CMsgPackException If a document is malformed or contains interned strings.
+         */
+        static inline std::vector<char> Diff(const char *Old, size_t OldSize, const char *New, size_t NewSize)
+        {
+            CheckPlain(Old, OldSize);
+            CheckPlain(New, NewSize);
+
+            CMsgPackReader OldReader(Old, OldSize), NewReader(New, NewSize);
+
+            CMsgPackDiff Ret;
+            Ret.Compare(View(OldReader), View(NewReader), 0);
+
+            CMessagePack Delta;
+            Delta.AddArray(Ret.m_Count);
+            Delta.AddEncoded(Ret.m_Body.data(), Ret.m_Body.size());
+            return Delta.Detach();
+        }
+
+        static inline std::vector<char> Diff(const std::vector<char> &Old, const std::vector<char> &New)
+        {
+            return Diff(Old.data(), Old.size(), New.data(), New.size());
+        }
+
+        /**
+         * @brief Applies a delta of Diff() to the first value of "Doc". Every operation moves the tail of the document at most twice.
+         *
+         * @throw CMsgPackException If the delta is malformed or doesn't match "Doc".
+         */
+        static inline void Apply(std::vector<char> &Doc, const char *Delta, size_t Size)
+        {
+            CMsgPackReader Reader(Delta, Size);
+            uint32_t Count = Reader.ReadArray();
+
+            std::vector<SMsgPackView> Path;
+            for (uint32_t i = 0; i < Count; i++)
+            {
+                uint32_t Elements = Reader.ReadArray();
+                if(Elements != 1 && Elements != 2)
+                    throw CMsgPackException(MsgPackErrorType::INVALID_DELTA);
+
+                Path.resize(Reader.ReadArray());
+                for (auto &&p : Path)
+                    p = View(Reader);
+
+                SMsgPackView Value = {nullptr, 0};
+                if(Elements == 2)
+                    Value = View(Reader);
+
+                ApplyOperation(Doc, Path, Value);
+            }
+        }
+
+        static inline void Apply(std::vector<char> &Doc, const std::vector<char> &Delta)
+        {
+            Apply(Doc, Delta.data(), Delta.size());
+        }
+
+        ~CMsgPackDiff() {}
+    private:
+        const static int MAX_DEPTH = 512;
+
+        //Step of the current path. Keys point into the new document, indices are encoded when an operation is written.
+        struct SStep
+        {
+            SMsgPackView Key;
+            uint32_t Index;
+        };
+
+        struct SViewHash
+        {
+            inline size_t operator()(const SMsgPackView &v) const
+            {
+                //FNV-1a
+                uint64_t Hash = 14695981039346656037ULL;
+                for (size_t i = 0; i < v.Size; i++)
+                    Hash = (Hash ^ (uint8_t)v.Data[i]) * 1099511628211ULL;
+
+                return (size_t)Hash;
+            }
+        };
+
+        struct SViewEqual
+        {
+            inline bool operator()(const SMsgPackView &a, const SMsgPackView &b) const
+            {
+                return Equal(a, b);
+            }
+        };
+
+        struct SEntry
+        {
+            SMsgPackView Key;
+            SMsgPackView Value;
+            bool Matched;
+        };
+
+        CMessagePack m_Op;
+        std::vector<char> m_Body;       //!< Encoded operations.
+        uint32_t m_Count;               //!< Operations inside m_Body.
+        std::vector<SStep> m_Path;
+
+        CMsgPackDiff() : m_Count(0) {}
+
+        static inline SMsgPackView View(CMsgPackReader &Reader)
+        {
+            size_t Start = Reader.GetPos();
+            Reader.SkipValue();
+            return {Reader.GetData() + Start, Reader.GetPos() - Start};
+        }
+
+        static inline bool Equal(const SMsgPackView &a, const SMsgPackView &b)
+        {
+            return a.Size == b.Size && (a.Size == 0 || memcmp(a.Data, b.Data, a.Size) == 0);
+        }
+
+        //Throws if the first value contains interned strings.
+        static inline void CheckPlain(const char *Data, size_t Size)
+        {
+            CMsgPackReader Reader(Data, Size);
+            uint64_t Pending = 1;
+
+            while (Pending != 0)
+            {
+                SMsgPackItem Item = Reader.Peek();
+                if(CMsgPackReader::IsInternedString(Item))
+                    throw CMsgPackException(MsgPackErrorType::INVALID_REFERENCE);
+
+                Pending--;
+                if(CMsgPackReader::IsContainer(Item.Format))
+                {
+                    Pending += CMsgPackReader::IsMap(Item.Format) ? 2 * (uint64_t)Item.Length : Item.Length;
+                    Reader.SetPos(Reader.GetPos() + Item.Header);
+                }
+                else
+                    Reader.SkipValue();
+            }
+        }
+
+        inline void Compare(const SMsgPackView &Old, const SMsgPackView &New, int Depth)
+        {
+            if(Equal(Old, New))
+                return;
+
+            CMsgPackReader OldReader(Old.Data, Old.Size), NewReader(New.Data, New.Size);
+            MsgFormats OldFormat = OldReader.GetNextType(), NewFormat = NewReader.GetNextType();
+
+            if(Depth > MAX_DEPTH || !CMsgPackReader::IsContainer(OldFormat) || !CMsgPackReader::IsContainer(NewFormat) ||
+               CMsgPackReader::IsMap(OldFormat) != CMsgPackReader::IsMap(NewFormat))
+            {
+                AddOperation(&New);
+                return;
+            }
+
+            size_t Mark = m_Body.size();
+            uint32_t Count = m_Count;
+
+            bool Matched = CMsgPackReader::IsMap(OldFormat) ? CompareMaps(OldReader, NewReader, Depth) : CompareArrays(OldReader, NewReader, Depth);
+
+            //Maps with duplicate keys can't be matched, and a replacement may be smaller than the changes inside.
+            if(!Matched || m_Body.size() - Mark > New.Size + PathSize() + 4)
+            {
+                m_Body.resize(Mark);
+                m_Count = Count;
+                AddOperation(&New);
+            }
+        }
+
+        inline bool CompareMaps(CMsgPackReader &OldReader, CMsgPackReader &NewReader, int Depth)
+        {
+            std::vector<SEntry> Entries(OldReader.ReadMap());
+            std::unordered_map<SMsgPackView, size_t, SViewHash, SViewEqual> Index(Entries.size());
+
+            for (size_t i = 0; i < Entries.size(); i++)
+            {
+                Entries[i].Key = View(OldReader);
+                Entries[i].Value = View(OldReader);
+                Entries[i].Matched = false;
+
+                if(!Index.emplace(Entries[i].Key, i).second)
+                    return false;
+            }
+
+            uint32_t Pairs = NewReader.ReadMap();
+            std::unordered_set<SMsgPackView, SViewHash, SViewEqual> Seen(Pairs);
+
+            for (uint32_t i = 0; i < Pairs; i++)
+            {
+                SMsgPackView Key = View(NewReader);
+                SMsgPackView Value = View(NewReader);
+
+                if(!Seen.insert(Key).second)
+                    return false;
+
+                m_Path.push_back({Key, 0});
+                auto It = Index.find(Key);
+                if(It == Index.end())
+                    AddOperation(&Value);
+                else
+                {
+                    Entries[It->second].Matched = true;
+                    Compare(Entries[It->second].Value, Value, Depth + 1);
+                }
+                m_Path.pop_back();
+            }
+
+            for (auto &&e : Entries)
+            {
+                if(e.Matched)
+                    continue;
+
+                m_Path.push_back({e.Key, 0});
+                AddOperation(nullptr);
+                m_Path.pop_back();
+            }
+
+            return true;
+        }
+
+        inline bool CompareArrays(CMsgPackReader &OldReader, CMsgPackReader &NewReader, int Depth)
+        {
+            uint32_t OldCount = OldReader.ReadArray();
+            uint32_t NewCount = NewReader.ReadArray();
+
+            for (uint32_t i = 0; i < NewCount; i++)
+            {
+                m_Path.push_back({{nullptr, 0}, i});
+                SMsgPackView Value = View(NewReader);
+
+                if(i < OldCount)
+                    Compare(View(OldReader), Value, Depth + 1);
+                else
+                    AddOperation(&Value);
+
+                m_Path.pop_back();
+            }
+
+            //Removed from the back, so the indices stay valid.
+            for (uint32_t i = OldCount; i > NewCount; i--)
+            {
+                m_Path.push_back({{nullptr, 0}, i - 1});
+                AddOperation(nullptr);
+                m_Path.pop_back();
+            }
+
+            return true;
+        }
+
+        inline size_t PathSize() const
+        {
+            size_t Ret = 0;
+            for (auto &&s : m_Path)
+                Ret += s.Key.Data ? s.Key.Size : 5;
+
+            return Ret;
+        }
+
+        //Writes a set operation or, without a value, a remove operation.
+        inline void AddOperation(const SMsgPackView *Value)
+        {
+            m_Op.Clear();
+            m_Op.AddArray(Value ? 2 : 1);
+            m_Op.AddArray(m_Path.size());
+
+            for (auto &&s : m_Path)
+            {
+                if(s.Key.Data)
+                    m_Op.AddEncoded(s.Key.Data, s.Key.Size);
+                else
+                    m_Op.AddValue(s.Index);
+            }
+
+            if(Value)
+                m_Op.AddEncoded(Value->Data, Value->Size);
+
+            m_Body.insert(m_Body.end(), m_Op.GetData().begin(), m_Op.GetData().end());
+            m_Count++;
+        }
+
+        static inline void ApplyOperation(std::vector<char> &Doc, const std::vector<SMsgPackView> &Path, const SMsgPackView &Value)
+        {
+            CMsgPackReader Reader(Doc);
+            if(Path.empty())
+            {
+                if(!Value.Data)
+                    throw CMsgPackException(MsgPackErrorType::INVALID_DELTA);
+
+                Reader.SkipValue();
+                CMsgPackPatcher::Splice(Doc, 0, Reader.GetPos(), Value.Data, Value.Size);
+                return;
+            }
+
+            for (size_t Step = 0; Step < Path.size(); Step++)
+            {
+                size_t Start = Reader.GetPos();
+                SMsgPackItem Item = Reader.Peek();
+                if(!CMsgPackReader::IsContainer(Item.Format))
+                    throw CMsgPackException(MsgPackErrorType::INVALID_DELTA);
+
+                bool Map = CMsgPackReader::IsMap(Item.Format);
+                bool Last = Step + 1 == Path.size();
+                Reader.SetPos(Start + Item.Header);
+
+                //Position of the matching key or element and of its value.
+                size_t Entry = 0, ValuePos = 0;
+                bool Found = false;
+
+                if(Map)
+                {
+                    for (uint32_t i = 0; i < Item.Length && !Found; i++)
+                    {
+                        Entry = Reader.GetPos();
+                        Found = Equal(View(Reader), Path[Step]);
+                        ValuePos = Reader.GetPos();
+                        Reader.SkipValue();
+                    }
+                }
+                else
+                {
+                    CMsgPackReader IndexReader(Path[Step].Data, Path[Step].Size);
+                    MsgFormats IndexFormat = IndexReader.GetNextType();
+                    if(IndexFormat != MsgFormats::POSITIVE_FIXINT && (IndexFormat < MsgFormats::UINT8 || IndexFormat > MsgFormats::UINT64))
+                        throw CMsgPackException(MsgPackErrorType::INVALID_DELTA);
+
+                    uint64_t Index = IndexReader.ReadUInt();
+                    if(Index > Item.Length)
+                        throw CMsgPackException(MsgPackErrorType::INVALID_DELTA);
+
+                    Reader.SkipValue(Index);
+                    Entry = ValuePos = Reader.GetPos();
+                    Found = Index < Item.Length;
+                    if(Found)
+                        Reader.SkipValue();
+                }
+
+                if(!Last)
+                {
+                    if(!Found)
+                        throw CMsgPackException(MsgPackErrorType::INVALID_DELTA);
+
+                    Reader.SetPos(ValuePos);
+                    continue;
+                }
+
+                if(Found && Value.Data)
+                    CMsgPackPatcher::Splice(Doc, ValuePos, Reader.GetPos() - ValuePos, Value.Data, Value.Size);
+                else if(Found)
+                {
+                    CMsgPackPatcher::Splice(Doc, Entry, Reader.GetPos() - Entry, nullptr, 0);
+                    SetCount(Doc, Start, Item, Item.Length - 1);
+                }
+                else if(Value.Data)
+                {
+                    //Appended behind the last entry.
+                    std::vector<char> Added;
+                    if(Map)
+                        Added.insert(Added.end(), Path[Step].Data, Path[Step].Data + Path[Step].Size);
+
+                    Added.insert(Added.end(), Value.Data, Value.Data + Value.Size);
+                    CMsgPackPatcher::Splice(Doc, Reader.GetPos(), 0, Added.data(), Added.size());
+                    SetCount(Doc, Start, Item, Item.Length + 1);
+                }
+                else
+                    throw CMsgPackException(MsgPackErrorType::INVALID_DELTA);
+            }
+        }
+
+        //Rewrites the header of a container, which may change its size.
+        static inline void SetCount(std::vector<char> &Doc, size_t Start, const SMsgPackItem &Item, uint32_t Count)
+        {
+            CMessagePack Header;
+            if(CMsgPackReader::IsMap(Item.Format))
+                Header.AddMap(Count);
+            else
+                Header.AddArray(Count);
+
+            CMsgPackPatcher::Splice(Doc, Start, Item.Header, Header.GetData().data(), Header.GetData().size());
+        }
+};
+
+#endif //MESSAGEPACKDIFF_HPP
@@ -0,0 +1,187 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2020 Christian Tost
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef MESSAGEPACKFIXED_HPP
+#define MESSAGEPACKFIXED_HPP
+
+#include "MessagePack.hpp"
+
+/**
+ * Fixed layout codec for structs which only contains fixed width numbers.
+ * Every field is written with the format matching its C++ type (int64_t -> INT64, double -> FLOAT64, ...),
+ * never with a smaller one, so the encoded layout and all offsets are known at compile time.
+ * The struct is written as fixarray, which every messagepack reader understands.
+ *
+ * Example:
+ *  struct Tick { int64_t ts; double px; uint32_t qty; };
+ *
+ *  using TickCodec = CMsgPackFixedCodec<Tick,
+ *                      CFixedField<Tick, int64_t, &Tick::ts>,
+ *                      CFixedField<Tick, double, &Tick::px>,
+ *                      CFixedField<Tick, uint32_t, &Tick::qty>>;
+ *
+ *  Pack.AddFixed<TickCodec>(tick);
+ *  Tick t = Pack.GetFixed<TickCodec>();
+ */
+
+namespace MsgPackFixed
+{
+    template<class T, class Enable = void>
+    struct Format;
+
+    template<class T>
+    struct Format<T, typename std::enable_if<std::is_integral<T>::value && !std::is_same<T, bool>::value && std::is_signed<T>::value>::type>
+    {
+        static constexpr uint8_t value = sizeof(T) == 1 ? MsgFormats::INT8 : sizeof(T) == 2 ? MsgFormats::INT16 : sizeof(T) == 4 ? MsgFormats::INT32 : MsgFormats::INT64;
+    };
+
+    template<class T>
+    struct Format<T, typename std::enable_if<std::is_integral<T>::value && !std::is_same<T, bool>::value && std::is_unsigned<T>::value>::type>
+    {
+        static constexpr uint8_t value = sizeof(T) == 1 ? MsgFormats::UINT8 : sizeof(T) == 2 ? MsgFormats::UINT16 : sizeof(T) == 4 ? MsgFormats::UINT32 : MsgFormats::UINT64;
+    };
+
+    template<class T>
+    struct Format<T, typename std::enable_if<std::is_floating_point<T>::value>::type>
+    {
+        static_assert(sizeof(T) == sizeof(float) || sizeof(T) == sizeof(double), "Unsupported floating point width!");
+        static constexpr uint8_t value = sizeof(T) == sizeof(float) ? MsgFormats::FLOAT32 : MsgFormats::FLOAT64;
+    };
+
+    template<size_t Offset, class... Fields>
+    struct FieldList
+    {
+        static constexpr size_t Size = 0;
+
+        template<class C>
+        static inline void Encode(const C &, char *) {}
+
+        static inline uint8_t Check(const char *)
+        {
+            return 0;
+        }
+
+        template<class C>
+        static inline void Decode(const char *, C &) {}
+    };
+
+    template<size_t Offset, class Field, class... Rest>
+    struct FieldList<Offset, Field, Rest...>
+    {
+        using Next = FieldList<Offset + Field::Size, Rest...>;
+        static constexpr size_t Size = Field::Size + Next::Size;
+
+        template<class C>
+        static inline void Encode(const C &Obj, char *Out)
+        {
+            Field::Encode(Obj, Out + Offset);
+            Next::Encode(Obj, Out);
+        }
+
+        //Returns zero if all format tags are matching.
+        static inline uint8_t Check(const char *In)
+        {
+            return Field::Check(In + Offset) | Next::Check(In);
+        }
+
+        template<class C>
+        static inline void Decode(const char *In, C &Obj)
+        {
+            Field::Decode(In + Offset, Obj);
+            Next::Decode(In, Obj);
+        }
+    };
+} // namespace MsgPackFixed
+
+/**
+ * @brief Describes a member of a fixed layout struct.
+ */
+template<class C, class M, M C::*Ptr>
+struct CFixedField
+{
+    static constexpr uint8_t Tag = MsgPackFixed::Format<M>::value;
+    static constexpr size_t Size = 1 + sizeof(M);
+
+    static inline void Encode(const C &Obj, char *Out)
+    {
+        Out[0] = (char)Tag;
+        MsgPackDetail::Store(Obj.*Ptr, Out + 1);
+    }
+
+    static inline uint8_t Check(const char *In)
+    {
+        return (uint8_t)In[0] ^ Tag;
+    }
+
+    static inline void Decode(const char *In, C &Obj)
+    {
+        MsgPackDetail::Load(In + 1, Obj.*Ptr);
+    }
+};
+
+/**
+ * @brief Encodes and decodes a struct with a layout known at compile time, without any branches.
+ */
+template<class T, class... Fields>
+class CMsgPackFixedCodec
+{
+    static_assert(sizeof...(Fields) > 0 && sizeof...(Fields) <= 0xF, "A fixed layout needs between 1 and 15 fields!");
+    using List = MsgPackFixed::FieldList<1, Fields...>;
+
+    static constexpr uint8_t HEADER = MsgFormats::FIXARRAY | sizeof...(Fields);
+
+    public:
+        using Type = T;
+
+        static constexpr size_t Size = 1 + List::Size;  //!< Encoded size in bytes.
+
+        /**
+         * @brief Writes "Size" bytes to "Out".
+         */
+        static inline void Encode(const T &Obj, char *Out)
+        {
+            Out[0] = (char)HEADER;
+            List::Encode(Obj, Out);
+        }
+
+        /**
+         * @brief Reads a value from a stream.
+         *
+         * @param In: Stream to read.
+         * @param Len: Available bytes in the stream.
+         * @param Obj: Destination.
+         *
+         * @return Returns false if the stream doesn't match the layout. "Obj" is untouched in that case.
+         */
+        static inline bool Decode(const char *In, size_t Len, T &Obj)
+        {
+            if(Len < Size || (((uint8_t)In[0] ^ HEADER) | List::Check(In)) != 0)
+                return false;
+
+            List::Decode(In, Obj);
+            return true;
+        }
+};
+
+#endif //MESSAGEPACKFIXED_HPP
@@ -0,0 +1,893 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2020 Christian Tost
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef MESSAGEPACKJSON_HPP
+#define MESSAGEPACKJSON_HPP
+
+#include "MessagePackReader.hpp"
+#include <ostream>
+#include <cmath>
+#include <stdio.h>
+#include <stdlib.h>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define MSGPACK_JSON_SSE2
+#endif
+
+#if __cplusplus >= 201703L && defined(__has_include)
+#if __has_include(<charconv>)
+#include <charconv>
+#endif
+#endif
+
+namespace MsgPackJsonDetail
+{
+    /**
+     * @return Returns the count of leading bytes which don't need to be escaped.
+     */
+    inline size_t ScanPlain(const char *Str, size_t Length)
+    {
+        size_t i = 0;
+#ifdef MSGPACK_JSON_SSE2
+        const __m128i Quote = _mm_set1_epi8('"');
+        const __m128i Backslash = _mm_set1_epi8('\\');
+        const __m128i Control = _mm_set1_epi8(0x1F);
+
+        for (; i + 16 <= Length; i += 16)
+        {
+            __m128i v = _mm_loadu_si128((const __m128i*)(Str + i));
+            __m128i Special = _mm_or_si128(_mm_cmpeq_epi8(v, Quote), _mm_cmpeq_epi8(v, Backslash));
+            Special = _mm_or_si128(Special, _mm_cmpeq_epi8(_mm_max_epu8(v, Control), Control));
+
+            int Mask = _mm_movemask_epi8(Special);
+            if(Mask != 0)
+            {
+                for (int Bit = 0; Bit < 16; Bit++)
+                {
+                    if(Mask & (1 << Bit))
+                        return i + Bit;
+                }
+            }
+        }
+#endif
+        for (; i < Length; i++)
+        {
+            uint8_t c = Str[i];
+            if(c < 0x20 || c == '"' || c == '\\')
+                break;
+        }
+
+        return i;
+    }
+} // namespace MsgPackJsonDetail
+
+/**
+ * @brief Transcodes messagepack directly to JSON text, without decoding into intermediate objects.
+ *        Bins are written as base64 strings, interned strings as strings, packed arrays as arrays of signed integers or numbers
+ *        and other exts as {"type": <type>, "data": "<base64>"}.
+ *        Map keys which aren't strings are written as their JSON text inside a string.
+ *        Several values in one stream are written as JSON lines.
+ */
+class CMsgPackToJson
+{
+    public:
+        /**
+         * @param Out: Receives the JSON text. The content is appended.
+         */
+        CMsgPackToJson(std::string &Out) : m_Out(Out), m_Stream(nullptr), m_InKey(0) {}
+
+        /**
+         * @param Stream: Receives the JSON text. Output is flushed in chunks of FLUSH_SIZE bytes.
+         */
+        CMsgPackToJson(std::ostream &Stream) : m_Out(m_Buffer), m_Stream(&Stream), m_InKey(0) {}
+
+        /**
+         * @brief Transcodes all values of a stream.
+         *
+         * @throw CMsgPackException If the stream is malformed.
+         */
+        inline void Write(const char *Data, size_t Size)
+        {
+            CMsgPackReader Reader(Data, Size);
+            while (!Reader.AtEnd())
+            {
+                if(Reader.GetPos() != 0)
+                    m_Out.push_back('\n');
+
+                WriteValue(Reader, 0);
+            }
+
+            Flush();
+        }
+
+        static inline std::string ToJson(const char *Data, size_t Size)
+        {
+            std::string Ret;
+            CMsgPackToJson Json(Ret);
+            Json.Write(Data, Size);
+            return Ret;
+        }
+
+        static inline std::string ToJson(const std::vector<char> &Data)
+        {
+            return ToJson(Data.data(), Data.size());
+        }
+
+        static inline void ToJson(const char *Data, size_t Size, std::ostream &Stream)
+        {
+            CMsgPackToJson Json(Stream);
+            Json.Write(Data, Size);
+        }
+
+        ~CMsgPackToJson() {}
+    private:
+        const static size_t FLUSH_SIZE = 64 * 1024;
+        const static int MAX_DEPTH = 512;
+
+        std::string m_Buffer;
+        std::string &m_Out;
+        std::ostream *m_Stream;
+        int m_InKey;    //!< Output can't be flushed while a key is rendered.
+
+        inline void Flush()
+        {
+            if(m_Stream && !m_Out.empty())
+            {
+                m_Stream->write(m_Out.data(), m_Out.size());
+                m_Out.clear();
+            }
+        }
+
+        inline void MaybeFlush()
+        {
+            if(m_Stream && m_InKey == 0 && m_Out.size() >= FLUSH_SIZE)
+                Flush();
+        }
+
+        inline void WriteValue(CMsgPackReader &Reader, int Depth)
+        {
+            if(Depth > MAX_DEPTH)
+                throw CMsgPackException(MsgPackErrorType::NESTING_TOO_DEEP);
+
+            SMsgPackItem Item = Reader.Peek();
+            switch (Item.Format)
+            {
+                case MsgFormats::NIL:
+                {
+                    Reader.ReadNil();
+                    m_Out.append("null", 4);
+                }break;
+
+                case MsgFormats::TRUE:
+                case MsgFormats::FALSE:
+                {
+                    if(Reader.ReadBool())
+                        m_Out.append("true", 4);
+                    else
+                        m_Out.append("false", 5);
+                }break;
+
+                case MsgFormats::UINT64:
+                {
+                    WriteUInt(Reader.ReadUInt());
+                }break;
+
+                case MsgFormats::POSITIVE_FIXINT:
+                case MsgFormats::NEGATIVE_FIXINT:
+                case MsgFormats::UINT8:
+                case MsgFormats::UINT16:
+                case MsgFormats::UINT32:
+                case MsgFormats::INT8:
+                case MsgFormats::INT16:
+                case MsgFormats::INT32:
+                case MsgFormats::INT64:
+                {
+                    WriteInt(Reader.ReadInt());
+                }break;
+
+                case MsgFormats::FLOAT32:
+                case MsgFormats::FLOAT64:
+                {
+                    WriteFloat(Reader.ReadFloat(), Item.Format == MsgFormats::FLOAT32);
+                }break;
+
+                case MsgFormats::FIXSTR:
+                case MsgFormats::STR8:
+                case MsgFormats::STR16:
+                case MsgFormats::STR32:
+                {
+                    uint32_t Length;
+                    const char *Str = Reader.ReadStr(Length);
+                    WriteString(Str, Length);
+                }break;
+
+                case MsgFormats::BIN8:
+                case MsgFormats::BIN16:
+                case MsgFormats::BIN32:
+                {
+                    uint32_t Length;
+                    const char *Bin = Reader.ReadStr(Length);
+                    WriteBase64(Bin, Length);
+                }break;
+
+                case MsgFormats::FIXARRAY:
+                case MsgFormats::ARRAY16:
+                case MsgFormats::ARRAY32:
+                {
+                    uint32_t Size = Reader.ReadArray();
+                    m_Out.push_back('[');
+                    for (uint32_t i = 0; i < Size; i++)
+                    {
+                        if(i != 0)
+                            m_Out.push_back(',');
+
+                        WriteValue(Reader, Depth + 1);
+                        MaybeFlush();
+                    }
+                    m_Out.push_back(']');
+                }break;
+
+                case MsgFormats::FIXMAP:
+                case MsgFormats::MAP16:
+                case MsgFormats::MAP32:
+                {
+                    uint32_t Size = Reader.ReadMap();
+                    m_Out.push_back('{');
+                    for (uint32_t i = 0; i < Size; i++)
+                    {
+                        if(i != 0)
+                            m_Out.push_back(',');
+
+                        WriteKey(Reader, Depth + 1);
+                        m_Out.push_back(':');
+                        WriteValue(Reader, Depth + 1);
+                        MaybeFlush();
+                    }
+                    m_Out.push_back('}');
+                }break;
+
+                default:
+                {
+                    if(CMsgPackReader::IsInternedString(Item))
+                    {
+                        uint32_t Length;
+                        const char *Str = Reader.ReadStr(Length);
+                        WriteString(Str, Length);
+                        break;
+                    }
+
+                    int8_t Type;
+                    uint32_t Length;
+                    const char *Ext = Reader.ReadExt(Type, Length);
+
+                    if(Type == (int8_t)MsgPackExtTypes::PACKED_INT_ARRAY)
+                    {
+                        WritePackedIntegers(Ext, Length);
+                        break;
+                    }
+
+                    if(Type == (int8_t)MsgPackExtTypes::PACKED_FLOAT_ARRAY)
+                    {
+                        WritePackedFloats(Ext, Length);
+                        break;
+                    }
+
+                    m_Out.append("{\"type\":", 8);
+                    WriteInt(Type);
+                    m_Out.append(",\"data\":", 8);
+                    WriteBase64(Ext, Length);
+                    m_Out.push_back('}');
+                }break;
+            }
+        }
+
+        inline void WritePackedIntegers(const char *Data, uint32_t Size)
+        {
+            m_Out.push_back('[');
+            bool Valid = MsgPackDetail::UnpackIntegers(Data, Size, [](uint64_t) {},
+                [this](size_t Index, int64_t val)
+                {
+                    if(Index != 0)
+                        m_Out.push_back(',');
+
+                    WriteInt(val);
+                    MaybeFlush();
+                });
+
+            if(!Valid)
+                throw CMsgPackException(MsgPackErrorType::INVALID_COMPRESSION);
+
+            m_Out.push_back(']');
+        }
+
+        inline void WritePackedFloats(const char *Data, uint32_t Size)
+        {
+            m_Out.push_back('[');
+            bool Valid = MsgPackDetail::UnpackFloats(Data, Size, [](uint64_t) {},
+                [this](size_t Index, uint64_t Bits, unsigned Width)
+                {
+                    if(Index != 0)
+                        m_Out.push_back(',');
+
+                    WriteFloat(MsgPackDetail::FloatFromBits<double>(Bits, Width), Width == 32);
+                    MaybeFlush();
+                });
+
+            if(!Valid)
+                throw CMsgPackException(MsgPackErrorType::INVALID_COMPRESSION);
+
+            m_Out.push_back(']');
+        }
+
+        inline void WriteKey(CMsgPackReader &Reader, int Depth)
+        {
+            MsgFormats fmt = Reader.GetNextType();
+            if(fmt == MsgFormats::FIXSTR || fmt == MsgFormats::STR8 || fmt == MsgFormats::STR16 || fmt == MsgFormats::STR32 || CMsgPackReader::IsInternedString(Reader.Peek()))
+            {
+                WriteValue(Reader, Depth);
+                return;
+            }
+
+            //JSON only allows string keys, so the key is rendered and then quoted.
+            size_t Start = m_Out.size();
+            m_InKey++;
+            WriteValue(Reader, Depth);
+            m_InKey--;
+
+            std::string Key = m_Out.substr(Start);
+            m_Out.resize(Start);
+            WriteString(Key.data(), Key.size());
+        }
+
+        inline void WriteInt(int64_t val)
+        {
+            if(val < 0)
+            {
+                m_Out.push_back('-');
+                WriteUInt(0 - (uint64_t)val);
+            }
+            else
+                WriteUInt((uint64_t)val);
+        }
+
+        inline void WriteUInt(uint64_t val)
+        {
+            char Buf[20];
+            char *End = Buf + sizeof(Buf);
+            char *Begin = End;
+
+            do
+            {
+                *--Begin = (char)('0' + val % 10);
+                val /= 10;
+            } while (val != 0);
+
+            m_Out.append(Begin, End - Begin);
+        }
+
+        /**
+         * @brief Writes the shortest text which reads back to the same value.
+         */
+        inline void WriteFloat(double val, bool Single)
+        {
+            if(!std::isfinite(val))
+            {
+                m_Out.append("null", 4);
+                return;
+            }
+
+            char Buf[32];
+#if defined(__cpp_lib_to_chars) && __cpp_lib_to_chars >= 201611L
+            //std::to_chars implements a shortest round trip algorithm (Ryu).
+            std::to_chars_result Res = Single ? std::to_chars(Buf, Buf + sizeof(Buf), (float)val) : std::to_chars(Buf, Buf + sizeof(Buf), val);
+            m_Out.append(Buf, Res.ptr - Buf);
+#else
+            //Fallback: The lowest precision which round trips.
+            int Len = 0;
+            for (int Precision = Single ? 6 : 15; Precision <= (Single ? 9 : 17); Precision++)
+            {
+                Len = snprintf(Buf, sizeof(Buf), "%.*g", Precision, val);
+                if(Single ? (strtof(Buf, nullptr) == (float)val) : (strtod(Buf, nullptr) == val))
+                    break;
+            }
+
+            m_Out.append(Buf, Len);
+#endif
+        }
+
+        inline void WriteString(const char *Str, size_t Length)
+        {
+            static const char HEX[] = "0123456789abcdef";
+            m_Out.push_back('"');
+
+            size_t i = 0;
+            while (i < Length)
+            {
+                size_t Run = MsgPackJsonDetail::ScanPlain(Str + i, Length - i);
+                m_Out.append(Str + i, Run);
+                i += Run;
+
+                if(i == Length)
+                    break;
+
+                char c = Str[i++];
+                switch (c)
+                {
+                    case '"': m_Out.append("\\\"", 2); break;
+                    case '\\': m_Out.append("\\\\", 2); break;
+                    case '\n': m_Out.append("\\n", 2); break;
+                    case '\r': m_Out.append("\\r", 2); break;
+                    case '\t': m_Out.append("\\t", 2); break;
+                    case '\b': m_Out.append("\\b", 2); break;
+                    case '\f': m_Out.append("\\f", 2); break;
+                    default:
+                    {
+                        char Esc[6] = {'\\', 'u', '0', '0', HEX[(uint8_t)c >> 4], HEX[c & 0xF]};
+                        m_Out.append(Esc, 6);
+                    }break;
+                }
+            }
+
+            m_Out.push_back('"');
+        }
+
+        inline void WriteBase64(const char *Data, size_t Length)
+        {
+            static const char TABLE[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+            m_Out.push_back('"');
+
+            size_t i = 0;
+            for (; i + 3 <= Length; i += 3)
+            {
+                uint32_t v = ((uint8_t)Data[i] << 16) | ((uint8_t)Data[i + 1] << 8) | (uint8_t)Data[i + 2];
+                char Out[4] = {TABLE[v >> 18], TABLE[(v >> 12) & 0x3F], TABLE[(v >> 6) & 0x3F], TABLE[v & 0x3F]};
+                m_Out.append(Out, 4);
+            }
+
+            if(i < Length)
+            {
+                uint32_t v = (uint8_t)Data[i] << 16;
+                if(i + 1 < Length)
+                    v |= (uint8_t)Data[i + 1] << 8;
+
+                char Out[4] = {TABLE[v >> 18], TABLE[(v >> 12) & 0x3F], i + 1 < Length ? TABLE[(v >> 6) & 0x3F] : '=', '='};
+                m_Out.append(Out, 4);
+            }
+
+            m_Out.push_back('"');
+        }
+};
+
+/**
+ * @brief Converts JSON text in one pass directly into a messagepack stream, without building a DOM.
+ *        Integers are written like AddValue() writes an int64_t (negative) or uint64_t (positive), so they get the smallest format.
+ *        Numbers with fraction or exponent and integers outside of the 64 bit range are written as double.
+ *        Array and map sizes are backpatched, see CMessagePack::BeginContainer().
+ *        Several whitespace separated values (JSON lines) are written one after another.
+ */
+class CJsonToMsgPack
+{
+    public:
+        /**
+         * @param Pack: Receives the values. If an exception is thrown the content of the pack is undefined.
+         */
+        CJsonToMsgPack(CMessagePack &Pack) : m_Pack(Pack), m_Begin(nullptr), m_Pos(nullptr), m_End(nullptr) {}
+
+        /**
+         * @brief Converts all values of a JSON text.
+         *
+         * @throw CMsgPackException If the text is malformed.
+         */
+        inline void Write(const char *Json, size_t Size)
+        {
+            m_Begin = m_Pos = Json;
+            m_End = Json + Size;
+
+            SkipWhitespace();
+            while (m_Pos < m_End)
+            {
+                ParseValue(0);
+                SkipWhitespace();
+            }
+        }
+
+        static inline void Convert(const char *Json, size_t Size, CMessagePack &Pack)
+        {
+            CJsonToMsgPack Conv(Pack);
+            Conv.Write(Json, Size);
+        }
+
+        static inline void Convert(const std::string &Json, CMessagePack &Pack)
+        {
+            Convert(Json.data(), Json.size(), Pack);
+        }
+
+        ~CJsonToMsgPack() {}
+    private:
+        const static int MAX_DEPTH = 512;
+
+        CMessagePack &m_Pack;
+        const char *m_Begin;
+        const char *m_Pos;
+        const char *m_End;
+        std::string m_Scratch;  //!< Reused for strings with escapes.
+
+        inline void Error(const char *Msg)
+        {
+            throw CMsgPackException("Invalid JSON at offset " + std::to_string(m_Pos - m_Begin) + ": " + Msg, MsgPackErrorType::INVALID_JSON);
+        }
+
+        inline void SkipWhitespace()
+        {
+            while (m_Pos < m_End && (*m_Pos == ' ' || *m_Pos == '\n' || *m_Pos == '\r' || *m_Pos == '\t'))
+                m_Pos++;
+        }
+
+        inline void ParseValue(int Depth)
+        {
+            if(Depth > MAX_DEPTH)
+                throw CMsgPackException(MsgPackErrorType::NESTING_TOO_DEEP);
+
+            if(m_Pos >= m_End)
+                Error("Unexpected end");
+
+            switch (*m_Pos)
+            {
+                case '{':
+                {
+                    m_Pos++;
+                    size_t Handle = m_Pack.BeginContainer();
+                    uint32_t Count = 0;
+
+                    SkipWhitespace();
+                    if(m_Pos < m_End && *m_Pos == '}')
+                        m_Pos++;
+                    else
+                    {
+                        while (true)
+                        {
+                            SkipWhitespace();
+                            if(m_Pos >= m_End || *m_Pos != '"')
+                                Error("Expected a string key");
+
+                            ParseString();
+                            SkipWhitespace();
+                            if(m_Pos >= m_End || *m_Pos != ':')
+                                Error("Expected ':'");
+
+                            m_Pos++;
+                            SkipWhitespace();
+                            ParseValue(Depth + 1);
+                            Count++;
+
+                            if(EndOfList('}'))
+                                break;
+                        }
+                    }
+
+                    m_Pack.EndContainer(Handle, Count, true);
+                }break;
+
+                case '[':
+                {
+                    m_Pos++;
+                    size_t Handle = m_Pack.BeginContainer();
+                    uint32_t Count = 0;
+
+                    SkipWhitespace();
+                    if(m_Pos < m_End && *m_Pos == ']')
+                        m_Pos++;
+                    else
+                    {
+                        while (true)
+                        {
+                            SkipWhitespace();
+                            ParseValue(Depth + 1);
+                            Count++;
+
+                            if(EndOfList(']'))
+                                break;
+                        }
+                    }
+
+                    m_Pack.EndContainer(Handle, Count, false);
+                }break;
+
+                case '"':
+                {
+                    ParseString();
+                }break;
+
+                case 't':
+                {
+                    ExpectLiteral("true", 4);
+                    m_Pack.AddValue(true);
+                }break;
+
+                case 'f':
+                {
+                    ExpectLiteral("false", 5);
+                    m_Pack.AddValue(false);
+                }break;
+
+                case 'n':
+                {
+                    ExpectLiteral("null", 4);
+                    m_Pack.AddValue(nullptr);
+                }break;
+
+                default:
+                {
+                    ParseNumber();
+                }break;
+            }
+        }
+
+        //Consumes ',' or the closing character and returns true for the latter.
+        inline bool EndOfList(char Close)
+        {
+            SkipWhitespace();
+            if(m_Pos < m_End)
+            {
+                char c = *m_Pos++;
+                if(c == ',')
+                    return false;
+                else if(c == Close)
+                    return true;
+
+                m_Pos--;
+            }
+
+            Error("Expected ',' or closing bracket");
+            return true;
+        }
+
+        inline void ExpectLiteral(const char *Literal, size_t Length)
+        {
+            if((size_t)(m_End - m_Pos) < Length || memcmp(m_Pos, Literal, Length) != 0)
+                Error("Unknown literal");
+
+            m_Pos += Length;
+        }
+
+        inline void ParseString()
+        {
+            const char *Start = ++m_Pos;
+            size_t Run = MsgPackJsonDetail::ScanPlain(m_Pos, m_End - m_Pos);
+            m_Pos += Run;
+
+            //Fast path, the string is written straight from the input.
+            if(m_Pos < m_End && *m_Pos == '"')
+            {
+                AddString(Start, Run);
+                m_Pos++;
+                return;
+            }
+
+            m_Scratch.assign(Start, Run);
+            while (true)
+            {
+                if(m_Pos >= m_End)
+                    Error("Unterminated string");
+
+                char c = *m_Pos++;
+                if(c == '"')
+                    break;
+                else if(c != '\\')
+                    Error("Control character in string");
+
+                if(m_Pos >= m_End)
+                    Error("Unterminated string");
+
+                switch (*m_Pos++)
+                {
+                    case '"': m_Scratch.push_back('"'); break;
+                    case '\\': m_Scratch.push_back('\\'); break;
+                    case '/': m_Scratch.push_back('/'); break;
+                    case 'b': m_Scratch.push_back('\b'); break;
+                    case 'f': m_Scratch.push_back('\f'); break;
+                    case 'n': m_Scratch.push_back('\n'); break;
+                    case 'r': m_Scratch.push_back('\r'); break;
+                    case 't': m_Scratch.push_back('\t'); break;
+                    case 'u': AppendCodepoint(ParseUnicodeEscape()); break;
+                    default: Error("Unknown escape sequence"); break;
+                }
+
+                Run = MsgPackJsonDetail::ScanPlain(m_Pos, m_End - m_Pos);
+                m_Scratch.append(m_Pos, Run);
+                m_Pos += Run;
+            }
+
+            AddString(m_Scratch.data(), m_Scratch.size());
+        }
+
+        //The input and the scratch buffer don't outlive the conversion, so the characters are always copied.
+        //An empty string stays a str, otherwise it would come back as null.
+        inline void AddString(const char *Str, size_t Size)
+        {
+            if(Size == 0)
+                m_Pack.AddEmptyString();
+            else
+                m_Pack.AddString(Str, Size, true);
+        }
+
+        inline uint32_t ParseHex4()
+        {
+            if(m_End - m_Pos < 4)
+                Error("Truncated unicode escape");
+
+            uint32_t Ret = 0;
+            for (int i = 0; i < 4; i++)
+            {
+                char c = *m_Pos++;
+                Ret <<= 4;
+                if(c >= '0' && c <= '9')
+                    Ret |= c - '0';
+                else if(c >= 'a' && c <= 'f')
+                    Ret |= c - 'a' + 10;
+                else if(c >= 'A' && c <= 'F')
+                    Ret |= c - 'A' + 10;
+                else
+                    Error("Invalid unicode escape");
+            }
+
+            return Ret;
+        }
+
+        inline uint32_t ParseUnicodeEscape()
+        {
+            uint32_t Ret = ParseHex4();
+            if(Ret >= 0xDC00 && Ret <= 0xDFFF)
+                Error("Lone low surrogate");
+
+            if(Ret >= 0xD800 && Ret <= 0xDBFF)
+            {
+                if(m_End - m_Pos < 2 || m_Pos[0] != '\\' || m_Pos[1] != 'u')
+                    Error("Missing low surrogate");
+
+                m_Pos += 2;
+                uint32_t Low = ParseHex4();
+                if(Low < 0xDC00 || Low > 0xDFFF)
+                    Error("Invalid low surrogate");
+
+                Ret = 0x10000 + ((Ret - 0xD800) << 10) + (Low - 0xDC00);
+            }
+
+            return Ret;
+        }
+
+        inline void AppendCodepoint(uint32_t c)
+        {
+            if(c < 0x80)
+                m_Scratch.push_back((char)c);
+            else if(c < 0x800)
+            {
+                m_Scratch.push_back((char)(0xC0 | (c >> 6)));
+                m_Scratch.push_back((char)(0x80 | (c & 0x3F)));
+            }
+            else if(c < 0x10000)
+            {
+                m_Scratch.push_back((char)(0xE0 | (c >> 12)));
+                m_Scratch.push_back((char)(0x80 | ((c >> 6) & 0x3F)));
+                m_Scratch.push_back((char)(0x80 | (c & 0x3F)));
+            }
+            else
+            {
+                m_Scratch.push_back((char)(0xF0 | (c >> 18)));
+                m_Scratch.push_back((char)(0x80 | ((c >> 12) & 0x3F)));
+                m_Scratch.push_back((char)(0x80 | ((c >> 6) & 0x3F)));
+                m_Scratch.push_back((char)(0x80 | (c & 0x3F)));
+            }
+        }
+
+        inline bool IsDigit() const
+        {
+            return m_Pos < m_End && *m_Pos >= '0' && *m_Pos <= '9';
+        }
+
+        inline void ParseNumber()
+        {
+            const char *Start = m_Pos;
+            bool Negative = *m_Pos == '-';
+            if(Negative)
+                m_Pos++;
+
+            if(!IsDigit())
+                Error("Unexpected character");
+
+            uint64_t Magnitude = 0;
+            bool Overflow = false;
+
+            if(*m_Pos == '0')
+                m_Pos++;
+            else
+            {
+                while (IsDigit())
+                {
+                    uint64_t Digit = *m_Pos++ - '0';
+                    if(Magnitude > (UINT64_MAX - Digit) / 10)
+                        Overflow = true;
+                    else
+                        Magnitude = Magnitude * 10 + Digit;
+                }
+            }
+
+            bool Float = false;
+            if(m_Pos < m_End && *m_Pos == '.')
+            {
+                Float = true;
+                m_Pos++;
+                if(!IsDigit())
+                    Error("Expected digits after '.'");
+
+                while (IsDigit())
+                    m_Pos++;
+            }
+
+            if(m_Pos < m_End && (*m_Pos == 'e' || *m_Pos == 'E'))
+            {
+                Float = true;
+                m_Pos++;
+                if(m_Pos < m_End && (*m_Pos == '+' || *m_Pos == '-'))
+                    m_Pos++;
+
+                if(!IsDigit())
+                    Error("Expected digits in exponent");
+
+                while (IsDigit())
+                    m_Pos++;
+            }
+
+            if(!Float && !Overflow)
+            {
+                if(!Negative)
+                {
+                    m_Pack.AddValue(Magnitude);
+                    return;
+                }
+                else if(Magnitude <= (uint64_t)INT64_MAX + 1)
+                {
+                    m_Pack.AddValue(Magnitude == (uint64_t)INT64_MAX + 1 ? INT64_MIN : -(int64_t)Magnitude);
+                    return;
+                }
+            }
+
+            m_Pack.AddValue(ParseDouble(Start, m_Pos));
+        }
+
+        inline double ParseDouble(const char *Begin, const char *End)
+        {
+#if defined(__cpp_lib_to_chars) && __cpp_lib_to_chars >= 201611L
+            double Ret = 0;
+            if(std::from_chars(Begin, End, Ret).ec == std::errc())
+                return Ret;
+#endif
+            //Also handles out of range values, which are rounded to infinity.
+            m_Scratch.assign(Begin, End);
+            return strtod(m_Scratch.c_str(), nullptr);
+        }
+};
+
+#endif //MESSAGEPACKJSON_HPP
@@ -0,0 +1,225 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2020 Christian Tost
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef MESSAGEPACKPATCH_HPP
+#define MESSAGEPACKPATCH_HPP
+
+#include "MessagePack.hpp"
+#include "MessagePackReader.hpp"
+
+enum class MsgPackPatchResult
+{
+    NOT_FOUND,      //!< The path doesn't exist, nothing was changed.
+    IN_PLACE,       //!< The value was overwritten, the size of the stream didn't change.
+    SPLICED         //!< The value had another size, the rest of the stream was moved.
+};
+
+/**
+ * @brief Replaces single values of an encoded stream without decoding it.
+ *        A new value is written in place if its encoding has the same size. Numbers are also written in place
+ *        if they fit the format of the old value, e.g. 7 into an UINT32. Otherwise the tail of the stream is moved once.
+ *        Array and map headers hold element counts, not byte sizes, so enclosing containers never need an update.
+ *        Streams written with CMessagePack::SetFixedWidth() can always patch their numbers in place.
+ *
+ * Example:
+ *  CMsgPackPatcher Patcher(Blob);
+ *  Patcher.Set({"stats", "counter"}, Counter + 1);
+ */
+class CMsgPackPatcher
+{
+    public:
+        /**
+         * @param Data: Stream to patch. It has to stay valid while the patcher is used.
+         */
+        CMsgPackPatcher(std::vector<char> &Data) : m_Data(Data) {}
+
+        /**
+         * @brief Replaces the value at "Path" inside the first value of the stream, see CMsgPackReader::Find().
+         *
+         * @throw CMsgPackException If the stream is malformed or the old value contains interned string definitions.
+         */
+        template<class T>
+        inline MsgPackPatchResult Set(const CMsgPackPath &Path, const T &Value)
+        {
+            CMsgPackReader Reader(m_Data);
+            if(!Reader.Find(Path))
+                return MsgPackPatchResult::NOT_FOUND;
+
+            return SetAt(Reader.GetPos(), Value);
+        }
+
+        /**
+         * @brief Replaces the value, which starts at "Offset".
+         *
+         * @throw CMsgPackException If the stream is malformed or the old value contains interned string definitions.
+         */
+        template<class T>
+        inline MsgPackPatchResult SetAt(size_t Offset, const T &Value)
+        {
+            CMessagePack Tmp;
+            Tmp.AddValue(Value);
+            return Replace(Offset, Tmp.GetData().data(), Tmp.GetData().size());
+        }
+
+        /**
+         * @brief Replaces the value, which starts at "Offset", with an encoded value.
+         *
+         * @throw CMsgPackException If the stream is malformed or the old value contains interned string definitions.
+         */
+        inline MsgPackPatchResult Replace(size_t Offset, const char *Value, size_t Size)
+        {
+            CMsgPackReader Reader(m_Data);
+            Reader.SetPos(Offset);
+            MsgFormats OldFormat = Reader.Peek().Format;
+            Reader.SkipValue();
+
+            size_t OldSize = Reader.GetPos() - Offset;
+            CheckDefinitions(Offset, OldSize);
+
+            char Fitted[9];
+            if(Size != OldSize && FitNumber(OldFormat, Value, Size, Fitted))
+            {
+                Value = Fitted;
+                Size = OldSize;
+            }
+
+            Splice(m_Data, Offset, OldSize, Value, Size);
+            return Size == OldSize ? MsgPackPatchResult::IN_PLACE : MsgPackPatchResult::SPLICED;
+        }
+
+        /**
+         * @brief Replaces "OldSize" bytes at "Offset" with "Size" bytes. The tail of the buffer is moved at most once.
+         */
+        static inline void Splice(std::vector<char> &Data, size_t Offset, size_t OldSize, const char *Value, size_t Size)
+        {
+            if(Size > OldSize)
+                Data.insert(Data.begin() + Offset + OldSize, Size - OldSize, 0);
+            else if(Size < OldSize)
+                Data.erase(Data.begin() + Offset + Size, Data.begin() + Offset + OldSize);
+
+            if(Size != 0)
+                memcpy(Data.data() + Offset, Value, Size);
+        }
+
+        ~CMsgPackPatcher() {}
+    private:
+        std::vector<char> &m_Data;
+
+        //Removing a definition would shift the indices of all later references.
+        inline void CheckDefinitions(size_t Offset, size_t Size) const
+        {
+            CMsgPackReader Reader(m_Data.data(), Offset + Size);
+            Reader.SetPos(Offset);
+
+            while (!Reader.AtEnd())
+            {
+                SMsgPackItem Item = Reader.Peek();
+                if(CMsgPackReader::IsExt(Item.Format) && Item.ExtType == MsgPackExtTypes::INTERNED_STRING_DEF)
+                    throw CMsgPackException(MsgPackErrorType::INVALID_REFERENCE);
+
+                Reader.SetPos(Reader.GetPos() + Item.Header + (CMsgPackReader::IsContainer(Item.Format) ? 0 : Item.Length));
+            }
+        }
+
+        /**
+         * @brief Encodes the number "Value" with the format of the old value.
+         *
+         * @return Returns false if "Value" isn't a number or doesn't fit.
+         */
+        static inline bool FitNumber(MsgFormats Old, const char *Value, size_t Size, char *Out)
+        {
+            CMsgPackReader Reader(Value, Size);
+            MsgFormats New = Reader.GetNextType();
+
+            if(New == MsgFormats::FLOAT32 || New == MsgFormats::FLOAT64)
+            {
+                double v = Reader.ReadFloat();
+                if(Old == MsgFormats::FLOAT64)
+                {
+                    Out[0] = (char)MsgFormats::FLOAT64;
+                    MsgPackDetail::Store(v, Out + 1);
+                    return true;
+                }
+
+                //Only exact values are narrowed.
+                if(Old == MsgFormats::FLOAT32 && ((double)(float)v == v || v != v))
+                {
+                    Out[0] = (char)MsgFormats::FLOAT32;
+                    MsgPackDetail::Store((float)v, Out + 1);
+                    return true;
+                }
+
+                return false;
+            }
+
+            if(!IsInteger(New) || !IsInteger(Old))
+                return false;
+
+            if(New == MsgFormats::UINT64)
+            {
+                CMsgPackReader Tmp(Value, Size);
+                if(Tmp.ReadUInt() > (uint64_t)INT64_MAX)
+                    return false;
+            }
+
+            int64_t v = Reader.ReadInt();
+            switch (Old)
+            {
+                case MsgFormats::POSITIVE_FIXINT: return v >= 0 && v <= INT8_MAX && Put(Out, (uint8_t)v);
+                case MsgFormats::NEGATIVE_FIXINT: return v >= -32 && v < 0 && Put(Out, (int8_t)v);
+                case MsgFormats::UINT8: return v >= 0 && v <= UINT8_MAX && Put(Out, (uint8_t)v, Old);
+                case MsgFormats::UINT16: return v >= 0 && v <= UINT16_MAX && Put(Out, (uint16_t)v, Old);
+                case MsgFormats::UINT32: return v >= 0 && v <= UINT32_MAX && Put(Out, (uint32_t)v, Old);
+                case MsgFormats::UINT64: return v >= 0 && Put(Out, (uint64_t)v, Old);
+                case MsgFormats::INT8: return v >= INT8_MIN && v <= INT8_MAX && Put(Out, (int8_t)v, Old);
+                case MsgFormats::INT16: return v >= INT16_MIN && v <= INT16_MAX && Put(Out, (int16_t)v, Old);
+                case MsgFormats::INT32: return v >= INT32_MIN && v <= INT32_MAX && Put(Out, (int32_t)v, Old);
+                default: return Put(Out, v, Old);
+            }
+        }
+
+        static inline bool IsInteger(MsgFormats fmt)
+        {
+            return fmt == MsgFormats::POSITIVE_FIXINT || fmt == MsgFormats::NEGATIVE_FIXINT ||
+                   (fmt >= MsgFormats::UINT8 && fmt <= MsgFormats::INT64);
+        }
+
+        //Fixints are the tag itself.
+        template<class T>
+        static inline bool Put(char *Out, T val)
+        {
+            Out[0] = (char)val;
+            return true;
+        }
+
+        template<class T>
+        static inline bool Put(char *Out, T val, MsgFormats Tag)
+        {
+            Out[0] = (char)Tag;
+            MsgPackDetail::Store(val, Out + 1);
+            return true;
+        }
+};
+
+#endif //MESSAGEPACKPATCH_HPP
@@ -0,0 +1,150 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2020 Christian Tost
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef MESSAGEPACKPOOL_HPP
+#define MESSAGEPACKPOOL_HPP
+
+#include "MessagePack.hpp"
+
+/**
+ * @brief Recycles the stream buffers of CMessagePack instances.
+ *        Released buffers keep their capacity. Every handed out buffer is reserved to the high-water mark,
+ *        the largest stream seen so far, so a steady state workload doesn't reallocate anymore.
+ *        A pool isn't thread safe, use ThreadLocal() to get a pool per thread.
+ */
+class CMsgPackBufferPool
+{
+    public:
+        /**
+         * @param MaxBuffers: Maximum count of idle buffers to keep.
+         * @param MaxCapacity: Buffers with a larger capacity are freed on release and don't raise the high-water mark.
+         */
+        CMsgPackBufferPool(size_t MaxBuffers = 16, size_t MaxCapacity = 64 * 1024 * 1024) : m_MaxBuffers(MaxBuffers), m_MaxCapacity(MaxCapacity), m_HighWaterMark(0) {}
+
+        /**
+         * @return Returns an empty buffer with at least the high-water mark as capacity.
+         */
+        inline std::vector<char> Acquire()
+        {
+            std::vector<char> Ret;
+            if(!m_Buffers.empty())
+            {
+                Ret = std::move(m_Buffers.back());
+                m_Buffers.pop_back();
+            }
+
+            if(Ret.capacity() < m_HighWaterMark)
+                Ret.reserve(m_HighWaterMark);
+
+            return Ret;
+        }
+
+        /**
+         * @brief Gives a buffer back to the pool.
+         *
+         * @param Buffer: Buffer to recycle.
+         */
+        inline void Release(std::vector<char> &&Buffer)
+        {
+            if(Buffer.capacity() > m_MaxCapacity)
+                return;
+
+            if(Buffer.size() > m_HighWaterMark)
+                m_HighWaterMark = Buffer.size();
+
+            if(m_Buffers.size() < m_MaxBuffers)
+            {
+                Buffer.clear();
+                m_Buffers.push_back(std::move(Buffer));
+            }
+        }
+
+        /**
+         * @return Returns the largest stream size which was released to the pool.
+         */
+        inline size_t GetHighWaterMark() const
+        {
+            return m_HighWaterMark;
+        }
+
+        /**
+         * @return Returns the count of idle buffers.
+         */
+        inline size_t GetIdleCount() const
+        {
+            return m_Buffers.size();
+        }
+
+        /**
+         * @return Returns the pool of the calling thread.
+         */
+        static inline CMsgPackBufferPool &ThreadLocal()
+        {
+            static thread_local CMsgPackBufferPool Pool;
+            return Pool;
+        }
+
+        ~CMsgPackBufferPool() {}
+    private:
+        std::vector<std::vector<char>> m_Buffers;
+        size_t m_MaxBuffers;
+        size_t m_MaxCapacity;
+        size_t m_HighWaterMark;
+};
+
+/**
+ * @brief Messagepack which works on a pooled buffer and gives it back on destruction.
+ *        Must be destroyed on the thread which owns the pool.
+ */
+class CMsgPackLease
+{
+    public:
+        CMsgPackLease(CMsgPackBufferPool &Pool = CMsgPackBufferPool::ThreadLocal()) : m_Pool(&Pool)
+        {
+            m_Pack.Attach(m_Pool->Acquire());
+        }
+
+        CMsgPackLease(const CMsgPackLease &) = delete;
+        CMsgPackLease &operator=(const CMsgPackLease &) = delete;
+
+        inline CMessagePack &operator*()
+        {
+            return m_Pack;
+        }
+
+        inline CMessagePack *operator->()
+        {
+            return &m_Pack;
+        }
+
+        ~CMsgPackLease()
+        {
+            m_Pool->Release(m_Pack.Detach());
+        }
+    private:
+        CMsgPackBufferPool *m_Pool;
+        CMessagePack m_Pack;
+};
+
+#endif //MESSAGEPACKPOOL_HPP
@@ -0,0 +1,687 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2020 Christian Tost
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef MESSAGEPACKREADER_HPP
+#define MESSAGEPACKREADER_HPP
+
+#include "MessagePack.hpp"
+
+/**
+ * @brief Header of a value inside a stream.
+ */
+struct SMsgPackItem
+{
+    MsgFormats Format;
+    uint8_t Header;     //!< Size of the header in bytes, including the format byte.
+    uint32_t Length;    //!< Payload size in bytes for scalars, strings, bins and exts. Element count for arrays, pair count for maps.
+    int8_t ExtType;     //!< Application type of ext values.
+};
+
+/**
+ * @brief Step of a path into nested maps and arrays. Strings match string keys,
+ *        integers match integer keys of maps or the index of an array element.
+ */
+class CMsgPackPathElement
+{
+    public:
+        CMsgPackPathElement(const char *Key) : m_IsKey(true), m_Key(Key), m_Index(0) {}
+        CMsgPackPathElement(const std::string &Key) : m_IsKey(true), m_Key(Key), m_Index(0) {}
+
+        template<class T, typename std::enable_if<std::is_integral<T>::value>::type* = nullptr>
+        CMsgPackPathElement(T Index) : m_IsKey(false), m_Index((int64_t)Index) {}
+
+        inline bool IsKey() const
+        {
+            return m_IsKey;
+        }
+
+        inline const std::string &GetKey() const
+        {
+            return m_Key;
+        }
+
+        inline int64_t GetIndex() const
+        {
+            return m_Index;
+        }
+
+    private:
+        bool m_IsKey;
+        std::string m_Key;
+        int64_t m_Index;
+};
+
+using CMsgPackPath = std::vector<CMsgPackPathElement>;
+
+/**
+ * @brief Encoded bytes of a single value inside a stream. "Data" is nullptr if the value wasn't found.
+ */
+struct SMsgPackView
+{
+    const char *Data;
+    size_t Size;
+};
+
+/**
+ * @brief Non owning cursor over an encoded stream. Nothing is copied, strings and bins are returned as pointers into the stream.
+ *        Every read is bounds checked. Interned strings are resolved, as long as the definitions weren't jumped over with SetPos().
+ */
+class CMsgPackReader
+{
+    public:
+        CMsgPackReader(const char *Data, size_t Size) : m_Data(Data), m_Size(Size), m_Pos(0) {}
+        explicit CMsgPackReader(const std::vector<char> &Data) : m_Data(Data.data()), m_Size(Data.size()), m_Pos(0) {}
+
+        inline const char *GetData() const
+        {
+            return m_Data;
+        }
+
+        inline size_t GetSize() const
+        {
+            return m_Size;
+        }
+
+        inline size_t GetPos() const
+        {
+            return m_Pos;
+        }
+
+        inline void SetPos(size_t Pos)
+        {
+            m_Pos = Pos;
+        }
+
+        inline bool AtEnd() const
+        {
+            return m_Pos >= m_Size;
+        }
+
+        /**
+         * @return Returns the next type inside the stream or RESERVED at the end of the stream.
+         */
+        inline MsgFormats GetNextType() const
+        {
+            if(AtEnd())
+                return MsgFormats::RESERVED;
+
+            uint8_t c = m_Data[m_Pos];
+            if((c & 0x80) == MsgFormats::POSITIVE_FIXINT)
+                return MsgFormats::POSITIVE_FIXINT;
+            else if((c & 0xF0) == MsgFormats::FIXARRAY)
+                return MsgFormats::FIXARRAY;
+            else if((c & 0xF0) == MsgFormats::FIXMAP)
+                return MsgFormats::FIXMAP;
+            else if((c & 0xE0) == MsgFormats::FIXSTR)
+                return MsgFormats::FIXSTR;
+            else if((c & 0xE0) == MsgFormats::NEGATIVE_FIXINT)
+                return MsgFormats::NEGATIVE_FIXINT;
+
+            return (MsgFormats)c;
+        }
+
+        /**
+         * @return Returns the header of the next value.
+         *
+         * @throw CMsgPackException If the header is truncated or the type is unknown.
+         */
+        inline SMsgPackItem Peek() const
+        {
+            if(AtEnd())
+                throw CMsgPackException(MsgPackErrorType::EMPTY_STREAM);
+
+            uint8_t c = m_Data[m_Pos];
+            SMsgPackItem Ret = {GetNextType(), 1, 0, 0};
+
+            switch (Ret.Format)
+            {
+                case MsgFormats::POSITIVE_FIXINT:
+                case MsgFormats::NEGATIVE_FIXINT:
+                case MsgFormats::NIL:
+                case MsgFormats::FALSE:
+                case MsgFormats::TRUE: break;
+
+                case MsgFormats::FIXARRAY:
+                case MsgFormats::FIXMAP: Ret.Length = c & 0x0F; break;
+                case MsgFormats::FIXSTR: Ret.Length = c & 0x1F; break;
+
+                case MsgFormats::UINT8:
+                case MsgFormats::INT8: Ret.Length = 1; break;
+                case MsgFormats::UINT16:
+                case MsgFormats::INT16: Ret.Length = 2; break;
+                case MsgFormats::UINT32:
+                case MsgFormats::INT32:
+                case MsgFormats::FLOAT32: Ret.Length = 4; break;
+                case MsgFormats::UINT64:
+                case MsgFormats::INT64:
+                case MsgFormats::FLOAT64: Ret.Length = 8; break;
+
+                case MsgFormats::STR8:
+                case MsgFormats::BIN8: Ret.Header = 2; Ret.Length = ReadHeaderInt<uint8_t>(); break;
+                case MsgFormats::STR16:
+                case MsgFormats::BIN16:
+                case MsgFormats::ARRAY16:
+                case MsgFormats::MAP16: Ret.Header = 3; Ret.Length = ReadHeaderInt<uint16_t>(); break;
+                case MsgFormats::STR32:
+                case MsgFormats::BIN32:
+                case MsgFormats::ARRAY32:
+                case MsgFormats::MAP32: Ret.Header = 5; Ret.Length = ReadHeaderInt<uint32_t>(); break;
+
+                case MsgFormats::FIXEXT1: Ret.Header = 2; Ret.Length = 1; break;
+                case MsgFormats::FIXEXT2: Ret.Header = 2; Ret.Length = 2; break;
+                case MsgFormats::FIXEXT4: Ret.Header = 2; Ret.Length = 4; break;
+                case MsgFormats::FIXEXT8: Ret.Header = 2; Ret.Length = 8; break;
+                case MsgFormats::FIXEXT16: Ret.Header = 2; Ret.Length = 16; break;
+                case MsgFormats::EXT8: Ret.Header = 3; Ret.Length = ReadHeaderInt<uint8_t>(); break;
+                case MsgFormats::EXT16: Ret.Header = 4; Ret.Length = ReadHeaderInt<uint16_t>(); break;
+                case MsgFormats::EXT32: Ret.Header = 6; Ret.Length = ReadHeaderInt<uint32_t>(); break;
+
+                default:
+                {
+                    throw CMsgPackException(MsgPackErrorType::UNKNOWN_TYPE);
+                } break;
+            }
+
+            if(Ret.Header > m_Size - m_Pos)
+                throw CMsgPackException(MsgPackErrorType::EMPTY_STREAM);
+
+            if(IsExt(Ret.Format))
+                Ret.ExtType = (int8_t)m_Data[m_Pos + Ret.Header - 1];
+
+            return Ret;
+        }
+
+        static inline bool IsContainer(MsgFormats fmt)
+        {
+            return fmt == MsgFormats::FIXARRAY || fmt == MsgFormats::ARRAY16 || fmt == MsgFormats::ARRAY32 ||
+                   fmt == MsgFormats::FIXMAP || fmt == MsgFormats::MAP16 || fmt == MsgFormats::MAP32;
+        }
+
+        static inline bool IsMap(MsgFormats fmt)
+        {
+            return fmt == MsgFormats::FIXMAP || fmt == MsgFormats::MAP16 || fmt == MsgFormats::MAP32;
+        }
+
+        static inline bool IsExt(MsgFormats fmt)
+        {
+            return (fmt >= MsgFormats::FIXEXT1 && fmt <= MsgFormats::FIXEXT16) || (fmt >= MsgFormats::EXT8 && fmt <= MsgFormats::EXT32);
+        }
+
+        /**
+         * @return Returns true for the definitions and references of interned strings, see CMessagePack::SetStringInterning().
+         */
+        static inline bool IsInternedString(const SMsgPackItem &Item)
+        {
+            return IsExt(Item.Format) && (Item.ExtType == MsgPackExtTypes::INTERNED_STRING_DEF || Item.ExtType == MsgPackExtTypes::INTERNED_STRING_REF);
+        }
+
+        /**
+         * @brief Skips the next value/-s. Works without recursion, so deeply nested streams can't overflow the stack.
+         *
+         * @param Count: Count of values to skip.
+         *
+         * @throw CMsgPackException If the stream is truncated or contains an unknown type.
+         */
+        inline void SkipValue(size_t Count = 1)
+        {
+            uint64_t Pending = Count;
+            while (Pending > 0)
+            {
+                SMsgPackItem Item = Peek();
+                Pending--;
+                m_Pos += Item.Header;
+
+                if(IsMap(Item.Format))
+                    Pending += (uint64_t)Item.Length * 2;
+                else if(IsContainer(Item.Format))
+                    Pending += Item.Length;
+                else
+                {
+                    Advance(Item.Length);
+
+                    //Skipped definitions are still needed by later references.
+                    if(IsExt(Item.Format) && Item.ExtType == MsgPackExtTypes::INTERNED_STRING_DEF)
+                        m_Dictionary.Define(m_Pos - Item.Length, Item.Length);
+                }
+            }
+        }
+
+        /**
+         * @return Returns the next value as signed integer. Accepts every int and uint format.
+         */
+        inline int64_t ReadInt()
+        {
+            return (int64_t)ReadInteger();
+        }
+
+        /**
+         * @return Returns the next value as unsigned integer. Accepts every int and uint format.
+         */
+        inline uint64_t ReadUInt()
+        {
+            return ReadInteger();
+        }
+
+        /**
+         * @return Returns the next value as double. Accepts float and integer formats.
+         */
+        inline double ReadFloat()
+        {
+            SMsgPackItem Item = Peek();
+            if(Item.Format != MsgFormats::FLOAT32 && Item.Format != MsgFormats::FLOAT64)
+                return Item.Format == MsgFormats::UINT64 ? (double)ReadUInt() : (double)ReadInt();
+
+            const char *Payload = ReadPayload(Item);
+
+            if(Item.Format == MsgFormats::FLOAT32)
+            {
+                float Ret;
+                MsgPackDetail::Load(Payload, Ret);
+                return Ret;
+            }
+
+            double Ret;
+            MsgPackDetail::Load(Payload, Ret);
+            return Ret;
+        }
+
+        inline bool ReadBool()
+        {
+            MsgFormats fmt = GetNextType();
+            if(fmt != MsgFormats::TRUE && fmt != MsgFormats::FALSE)
+                throw CMsgPackException(MsgPackErrorType::INVALID_CAST);
+
+            m_Pos++;
+            return fmt == MsgFormats::TRUE;
+        }
+
+        inline void ReadNil()
+        {
+            if(GetNextType() != MsgFormats::NIL)
+                throw CMsgPackException(MsgPackErrorType::INVALID_CAST);
+
+            m_Pos++;
+        }
+
+        /**
+         * @return Unpacks an array and returns the element count.
+         */
+        inline uint32_t ReadArray()
+        {
+            SMsgPackItem Item = Peek();
+            if(!IsContainer(Item.Format) || IsMap(Item.Format))
+                throw CMsgPackException(MsgPackErrorType::INVALID_CAST);
+
+            m_Pos += Item.Header;
+            return Item.Length;
+        }
+
+        /**
+         * @return Unpacks a map and returns the pair count.
+         */
+        inline uint32_t ReadMap()
+        {
+            SMsgPackItem Item = Peek();
+            if(!IsMap(Item.Format))
+                throw CMsgPackException(MsgPackErrorType::INVALID_CAST);
+
+            m_Pos += Item.Header;
+            return Item.Length;
+        }
+
+        /**
+         * @return Returns a pointer to the bytes of the next str, bin or interned string value.
+         *
+         * @param Length: Receives the byte count.
+         */
+        inline const char *ReadStr(uint32_t &Length)
+        {
+            SMsgPackItem Item = Peek();
+            switch (Item.Format)
+            {
+                case MsgFormats::NIL:       //Empty string outside the canonical mode.
+                case MsgFormats::FIXSTR:
+                case MsgFormats::STR8:
+                case MsgFormats::STR16:
+                case MsgFormats::STR32:
+                case MsgFormats::BIN8:
+                case MsgFormats::BIN16:
+                case MsgFormats::BIN32: break;
+
+                default:
+                {
+                    if(!IsInternedString(Item))
+                        throw CMsgPackException(MsgPackErrorType::INVALID_CAST);
+                } break;
+            }
+
+            Length = Item.Length;
+            const char *Ret = ReadPayload(Item);
+
+            if(IsExt(Item.Format) && Item.ExtType == MsgPackExtTypes::INTERNED_STRING_DEF)
+                m_Dictionary.Define(Ret - m_Data, Length);
+            else if(IsExt(Item.Format))
+            {
+                size_t Offset;
+                if(!m_Dictionary.Resolve(Ret, Item.Length, Offset, Length))
+                    throw CMsgPackException(MsgPackErrorType::INVALID_REFERENCE);
+
+                Ret = m_Data + Offset;
+            }
+
+            return Ret;
+        }
+
+        /**
+         * @return Returns a pointer to the data of the next ext value.
+         *
+         * @param Type: Receives the application type.
+         * @param Length: Receives the byte count.
+         */
+        inline const char *ReadExt(int8_t &Type, uint32_t &Length)
+        {
+            SMsgPackItem Item = Peek();
+            if(!IsExt(Item.Format))
+                throw CMsgPackException(MsgPackErrorType::INVALID_CAST);
+
+            Type = Item.ExtType;
+            Length = Item.Length;
+            return ReadPayload(Item);
+        }
+
+        /**
+         * @brief Moves the cursor to the value at "Path" inside the next value. Only the path is visited, siblings are skipped.
+         *
+         * @return Returns false if the path doesn't exist, the position is undefined then.
+         *
+         * @throw CMsgPackException If the stream is malformed.
+         */
+        inline bool Find(const CMsgPackPath &Path)
+        {
+            for (auto &&e : Path)
+            {
+                SMsgPackItem Item = Peek();
+                if(IsMap(Item.Format))
+                {
+                    m_Pos += Item.Header;
+
+                    uint32_t i = 0;
+                    for (; i < Item.Length; i++)
+                    {
+                        if(KeyMatches(ReadKey(), e))
+                            break;
+
+                        SkipValue();
+                    }
+
+                    if(i == Item.Length)
+                        return false;
+                }
+                else if(IsContainer(Item.Format))
+                {
+                    if(e.IsKey() || e.GetIndex() < 0 || e.GetIndex() >= Item.Length)
+                        return false;
+
+                    m_Pos += Item.Header;
+                    SkipValue((size_t)e.GetIndex());
+                }
+                else
+                    return false;
+            }
+
+            return true;
+        }
+
+        /**
+         * @return Returns the encoded value at "Path" inside the first value of the stream.
+         *         Interned strings inside the view can't be resolved without the rest of the stream, use Find() for such streams.
+         *
+         * @throw CMsgPackException If the stream is malformed.
+         */
+        static inline SMsgPackView Extract(const char *Data, size_t Size, const CMsgPackPath &Path)
+        {
+            CMsgPackReader Reader(Data, Size);
+            if(!Reader.Find(Path))
+                return {nullptr, 0};
+
+            size_t Start = Reader.GetPos();
+            Reader.SkipValue();
+            return {Data + Start, Reader.GetPos() - Start};
+        }
+
+        static inline SMsgPackView Extract(const std::vector<char> &Data, const CMsgPackPath &Path)
+        {
+            return Extract(Data.data(), Data.size(), Path);
+        }
+
+        /**
+         * @brief Projects several paths in one pass over the first value of the stream. Subtrees no path leads into are skipped.
+         *
+         * @return Returns a view per path, in the order of "Paths".
+         *
+         * @throw CMsgPackException If the stream is malformed.
+         */
+        static inline std::vector<SMsgPackView> ExtractAll(const char *Data, size_t Size, const std::vector<CMsgPackPath> &Paths)
+        {
+            std::vector<SMsgPackView> Ret(Paths.size(), SMsgPackView{nullptr, 0});
+            std::vector<size_t> Active(Paths.size());
+            for (size_t i = 0; i < Active.size(); i++)
+                Active[i] = i;
+
+            CMsgPackReader Reader(Data, Size);
+            Reader.Project(Paths, Active, 0, Ret);
+            return Ret;
+        }
+
+        static inline std::vector<SMsgPackView> ExtractAll(const std::vector<char> &Data, const std::vector<CMsgPackPath> &Paths)
+        {
+            return ExtractAll(Data.data(), Data.size(), Paths);
+        }
+
+        ~CMsgPackReader() {}
+    private:
+        //Map key as read by ReadKey(). Keys which are neither strings nor integers never match.
+        struct SKey
+        {
+            bool IsString;
+            bool IsInt;
+            const char *Str;
+            uint32_t Length;
+            int64_t Int;
+        };
+
+        inline SKey ReadKey()
+        {
+            SKey Ret = {false, false, nullptr, 0, 0};
+            SMsgPackItem Item = Peek();
+
+            switch (Item.Format)
+            {
+                case MsgFormats::FIXSTR:
+                case MsgFormats::STR8:
+                case MsgFormats::STR16:
+                case MsgFormats::STR32:
+                {
+                    Ret.IsString = true;
+                    Ret.Length = Item.Length;
+                    Ret.Str = ReadPayload(Item);
+                }break;
+
+                case MsgFormats::POSITIVE_FIXINT:
+                case MsgFormats::NEGATIVE_FIXINT:
+                case MsgFormats::UINT8:
+                case MsgFormats::UINT16:
+                case MsgFormats::UINT32:
+                case MsgFormats::UINT64:
+                case MsgFormats::INT8:
+                case MsgFormats::INT16:
+                case MsgFormats::INT32:
+                case MsgFormats::INT64:
+                {
+                    Ret.IsInt = true;
+                    Ret.Int = ReadInt();
+                }break;
+
+                default:
+                {
+                    if(IsInternedString(Item))
+                    {
+                        Ret.IsString = true;
+                        Ret.Str = ReadStr(Ret.Length);
+                    }
+                    else
+                        SkipValue();
+                }break;
+            }
+
+            return Ret;
+        }
+
+        static inline bool KeyMatches(const SKey &Key, const CMsgPackPathElement &e)
+        {
+            if(e.IsKey())
+                return Key.IsString && Key.Length == e.GetKey().size() && memcmp(Key.Str, e.GetKey().data(), Key.Length) == 0;
+
+            return Key.IsInt && Key.Int == e.GetIndex();
+        }
+
+        //Visits the value at the cursor. The "Active" paths matched up to "Depth" elements.
+        inline void Project(const std::vector<CMsgPackPath> &Paths, const std::vector<size_t> &Active, size_t Depth, std::vector<SMsgPackView> &Ret)
+        {
+            size_t Start = m_Pos;
+            std::vector<size_t> Deeper;
+            for (auto &&a : Active)
+            {
+                if(Paths[a].size() > Depth)
+                    Deeper.push_back(a);
+            }
+
+            SMsgPackItem Item = Peek();
+            if(Deeper.empty() || !IsContainer(Item.Format))
+                SkipValue();
+            else
+            {
+                m_Pos += Item.Header;
+
+                std::vector<size_t> Matching;
+                for (uint32_t i = 0; i < Item.Length; i++)
+                {
+                    Matching.clear();
+                    if(IsMap(Item.Format))
+                    {
+                        SKey Key = ReadKey();
+                        for (auto &&a : Deeper)
+                        {
+                            if(KeyMatches(Key, Paths[a][Depth]))
+                                Matching.push_back(a);
+                        }
+                    }
+                    else
+                    {
+                        for (auto &&a : Deeper)
+                        {
+                            if(!Paths[a][Depth].IsKey() && Paths[a][Depth].GetIndex() == (int64_t)i)
+                                Matching.push_back(a);
+                        }
+                    }
+
+                    if(Matching.empty())
+                        SkipValue();
+                    else
+                        Project(Paths, Matching, Depth + 1, Ret);
+                }
+            }
+
+            for (auto &&a : Active)
+            {
+                if(Paths[a].size() == Depth)
+                    Ret[a] = {m_Data + Start, m_Pos - Start};
+            }
+        }
+
+        const char *m_Data;
+        size_t m_Size;
+        size_t m_Pos;
+        MsgPackDetail::CStringDictionary m_Dictionary;
+
+        template<class T>
+        inline T ReadHeaderInt() const
+        {
+            if(m_Size - m_Pos < 1 + sizeof(T))
+                throw CMsgPackException(MsgPackErrorType::EMPTY_STREAM);
+
+            T Ret;
+            MsgPackDetail::Load(m_Data + m_Pos + 1, Ret);
+            return Ret;
+        }
+
+        inline void Advance(size_t Count)
+        {
+            if(Count > m_Size - m_Pos)
+                throw CMsgPackException(MsgPackErrorType::EMPTY_STREAM);
+
+            m_Pos += Count;
+        }
+
+        //Consumes the value and returns its payload.
+        inline const char *ReadPayload(const SMsgPackItem &Item)
+        {
+            m_Pos += Item.Header;
+            const char *Ret = m_Data + m_Pos;
+            Advance(Item.Length);
+            return Ret;
+        }
+
+        inline uint64_t ReadInteger()
+        {
+            SMsgPackItem Item = Peek();
+            uint8_t c = m_Data[m_Pos];
+
+            switch (Item.Format)
+            {
+                case MsgFormats::POSITIVE_FIXINT:
+                case MsgFormats::NEGATIVE_FIXINT:
+                {
+                    m_Pos++;
+                    return (uint64_t)(int64_t)(int8_t)c;
+                }break;
+
+                case MsgFormats::UINT8: { uint8_t v; MsgPackDetail::Load(ReadPayload(Item), v); return v; }
+                case MsgFormats::UINT16: { uint16_t v; MsgPackDetail::Load(ReadPayload(Item), v); return v; }
+                case MsgFormats::UINT32: { uint32_t v; MsgPackDetail::Load(ReadPayload(Item), v); return v; }
+                case MsgFormats::UINT64: { uint64_t v; MsgPackDetail::Load(ReadPayload(Item), v); return v; }
+                case MsgFormats::INT8: { int8_t v; MsgPackDetail::Load(ReadPayload(Item), v); return (uint64_t)(int64_t)v; }
+                case MsgFormats::INT16: { int16_t v; MsgPackDetail::Load(ReadPayload(Item), v); return (uint64_t)(int64_t)v; }
+                case MsgFormats::INT32: { int32_t v; MsgPackDetail::Load(ReadPayload(Item), v); return (uint64_t)(int64_t)v; }
+                case MsgFormats::INT64: { int64_t v; MsgPackDetail::Load(ReadPayload(Item), v); return (uint64_t)v; }
+
+                default:
+                {
+                    throw CMsgPackException(MsgPackErrorType::INVALID_CAST);
+                } break;
+            }
+        }
+};
+
+#endif //MESSAGEPACKREADER_HPP
@@ -0,0 +1,470 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2020 Christian Tost
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef MESSAGEPACKSCHEMA_HPP
+#define MESSAGEPACKSCHEMA_HPP
+
+#include <array>
+#include "MessagePack.hpp"
+
+/**
+ * Schema codec for structs which are written as map of their fields, like objects with a Serialize() method.
+ * The fields are declared once, the decoder for them is put together at compile time. It expects the map header,
+ * the keys in declared order and only the formats which can occur for the type of each field, so there is no
+ * generic type dispatch and only one bounds check per value. If a message doesn't have this shape, e.g. the keys
+ * are reordered, missing, unknown or interned, the generic decoder of CMessagePack is used instead.
+ *
+ * Example:
+ *  struct Request { uint32_t id; std::string method; std::vector<double> args; };
+ *
+ *  static const CMsgPackSchema<Request,
+ *                  CSchemaField<Request, uint32_t, &Request::id>,
+ *                  CSchemaField<Request, std::string, &Request::method>,
+ *                  CSchemaField<Request, std::vector<double>, &Request::args>> RequestSchema("id", "method", "args");
+ *
+ *  Pack.AddSchema(RequestSchema, req);
+ *  Request r = Pack.GetSchema(RequestSchema);
+ */
+
+namespace MsgPackSchema
+{
+    /**
+     * @brief Reads a value of type "T" directly from the stream. Only the formats, which the generic decoder accepts for "T", are handled.
+     *        Types without a specialization are decoded generically.
+     */
+    template<class T, class Enable = void>
+    struct Value
+    {
+        static constexpr bool Supported = false;
+
+        static inline bool Read(const char *&, const char *, T &)
+        {
+            return false;
+        }
+    };
+
+    //Loads a payload of type "S" behind the tag.
+    template<class S, class T>
+    inline bool Fetch(const char *&In, const char *End, T &Out)
+    {
+        if((size_t)(End - In) < 1 + sizeof(S))
+            return false;
+
+        S Tmp;
+        MsgPackDetail::Load(In + 1, Tmp);
+        Out = (T)Tmp;
+        In += 1 + sizeof(S);
+        return true;
+    }
+
+    template<class T>
+    struct Value<T, typename std::enable_if<std::is_integral<T>::value && !std::is_same<T, bool>::value>::type>
+    {
+        static constexpr bool Supported = true;
+
+        static inline bool Read(const char *&In, const char *End, T &Out)
+        {
+            if(In == End)
+                return false;
+
+            uint8_t Tag = (uint8_t)*In;
+            if(Tag <= POS_FIXINT_TAG_MAX || Tag >= MsgFormats::NEGATIVE_FIXINT)
+            {
+                Out = Tag <= POS_FIXINT_TAG_MAX ? (T)Tag : (T)(int8_t)Tag;
+                In++;
+                return true;
+            }
+
+            //Same conversions as the generic decoder, every format is read as int64_t first.
+            int64_t Tmp = 0;
+            bool Ret;
+            switch (Tag)
+            {
+                case MsgFormats::UINT8: Ret = Fetch<uint8_t>(In, End, Tmp); break;
+                case MsgFormats::UINT16: Ret = Fetch<uint16_t>(In, End, Tmp); break;
+                case MsgFormats::UINT32: Ret = Fetch<uint32_t>(In, End, Tmp); break;
+                case MsgFormats::UINT64:
+                case MsgFormats::INT64: Ret = Fetch<int64_t>(In, End, Tmp); break;
+                case MsgFormats::INT8: Ret = Fetch<int8_t>(In, End, Tmp); break;
+                case MsgFormats::INT16: Ret = Fetch<int16_t>(In, End, Tmp); break;
+                case MsgFormats::INT32: Ret = Fetch<int32_t>(In, End, Tmp); break;
+                default: return false;
+            }
+
+            Out = (T)Tmp;
+            return Ret;
+        }
+
+        static const uint8_t POS_FIXINT_TAG_MAX = 0x7F;
+    };
+
+    template<>
+    struct Value<bool>
+    {
+        static constexpr bool Supported = true;
+
+        static inline bool Read(const char *&In, const char *End, bool &Out)
+        {
+            if(In == End || ((uint8_t)*In != MsgFormats::TRUE && (uint8_t)*In != MsgFormats::FALSE))
+                return false;
+
+            Out = (uint8_t)*In++ == MsgFormats::TRUE;
+            return true;
+        }
+    };
+
+    template<class T>
+    struct Value<T, typename std::enable_if<std::is_floating_point<T>::value>::type>
+    {
+        static constexpr bool Supported = true;
+
+        static inline bool Read(const char *&In, const char *End, T &Out)
+        {
+            if(In == End)
+                return false;
+
+            switch ((uint8_t)*In)
+            {
+                case MsgFormats::FLOAT32: return Fetch<float>(In, End, Out);
+                case MsgFormats::FLOAT64: return Fetch<double>(In, End, Out);
+                case MsgFormats::UINT64: return Fetch<uint64_t>(In, End, Out);
+            }
+
+            //Integers written by CMessagePack::SetFloatNarrowing().
+            int64_t Tmp = 0;
+            if(!Value<int64_t>::Read(In, End, Tmp))
+                return false;
+
+            Out = (T)Tmp;
+            return true;
+        }
+    };
+
+    template<>
+    struct Value<std::string>
+    {
+        static constexpr bool Supported = true;
+
+        static inline bool Read(const char *&In, const char *End, std::string &Out)
+        {
+            if(In == End)
+                return false;
+
+            uint8_t Tag = (uint8_t)*In;
+            uint32_t Size;
+            size_t Header = 1;
+
+            if((Tag & 0xE0) == MsgFormats::FIXSTR)
+                Size = Tag & 0x1F;
+            else
+            {
+                //Empty strings are written as NIL outside the canonical mode.
+                switch (Tag)
+                {
+                    case MsgFormats::NIL: Size = 0; break;
+                    case MsgFormats::STR8: case MsgFormats::BIN8: Header = 2; break;
+                    case MsgFormats::STR16: case MsgFormats::BIN16: Header = 3; break;
+                    case MsgFormats::STR32: case MsgFormats::BIN32: Header = 5; break;
+                    default: return false;
+                }
+
+                if((size_t)(End - In) < Header)
+                    return false;
+
+                switch (Header)
+                {
+                    case 2: Size = (uint8_t)In[1]; break;
+                    case 3: { uint16_t Tmp; MsgPackDetail::Load(In + 1, Tmp); Size = Tmp; } break;
+                    case 5: MsgPackDetail::Load(In + 1, Size); break;
+                }
+            }
+
+            //Truncated strings are left to the generic decoder.
+            if((size_t)(End - In) - Header < Size)
+                return false;
+
+            Out.assign(In + Header, Size);
+            In += Header + Size;
+            return true;
+        }
+    };
+
+    template<class E, class A>
+    struct Value<std::vector<E, A>, typename std::enable_if<Value<E>::Supported && !std::is_same<E, char>::value>::type>
+    {
+        static constexpr bool Supported = true;
+
+        static inline bool Read(const char *&In, const char *End, std::vector<E, A> &Out)
+        {
+            if(In == End)
+                return false;
+
+            uint8_t Tag = (uint8_t)*In;
+            uint32_t Count;
+
+            if((Tag & 0xF0) == MsgFormats::FIXARRAY)
+            {
+                Count = Tag & 0x0F;
+                In++;
+            }
+            else if(Tag == MsgFormats::ARRAY16)
+            {
+                uint16_t Tmp;
+                if(!Fetch<uint16_t>(In, End, Tmp))
+                    return false;
+
+                Count = Tmp;
+            }
+            else if(Tag != MsgFormats::ARRAY32 || !Fetch<uint32_t>(In, End, Count))
+                return false;
+
+            //Every element needs at least one byte.
+            if((size_t)(End - In) < Count)
+                return false;
+
+            Out.resize(Count);
+            for (auto &&e : Out)
+            {
+                E Tmp;
+                if(!Value<E>::Read(In, End, Tmp))
+                    return false;
+
+                e = std::move(Tmp);
+            }
+
+            return true;
+        }
+    };
+
+    template<class... Fields>
+    struct FieldList
+    {
+        static constexpr bool Supported = true;
+
+        template<class C>
+        static inline void Encode(CMessagePack &, const std::string *, const C &) {}
+
+        template<class C>
+        static inline bool Decode(const char *&, const char *, const std::string *, C &)
+        {
+            return true;
+        }
+
+        template<class C>
+        static inline void Get(size_t, CMessagePack &, C &) {}
+    };
+
+    template<class Field, class... Rest>
+    struct FieldList<Field, Rest...>
+    {
+        using Next = FieldList<Rest...>;
+        static constexpr bool Supported = Field::Supported && Next::Supported;
+
+        template<class C>
+        static inline void Encode(CMessagePack &Pack, const std::string *Names, const C &Obj)
+        {
+            Pack.AddValue(*Names);
+            Field::Write(Pack, Obj);
+            Next::Encode(Pack, Names + 1, Obj);
+        }
+
+        //Compares the encoded key and reads the value.
+        template<class C>
+        static inline bool Decode(const char *&In, const char *End, const std::string *Keys, C &Obj)
+        {
+            if((size_t)(End - In) < Keys->size() || memcmp(In, Keys->data(), Keys->size()) != 0)
+                return false;
+
+            In += Keys->size();
+            return Field::Read(In, End, Obj) && Next::Decode(In, End, Keys + 1, Obj);
+        }
+
+        //Reads the field with the index "Index" with the generic decoder.
+        template<class C>
+        static inline void Get(size_t Index, CMessagePack &Pack, C &Obj)
+        {
+            if(Index == 0)
+                Field::Get(Pack, Obj);
+            else
+                Next::Get(Index - 1, Pack, Obj);
+        }
+    };
+} // namespace MsgPackSchema
+
+/**
+ * @brief Describes a member of a struct with a schema.
+ */
+template<class C, class M, M C::*Ptr>
+struct CSchemaField
+{
+    static constexpr bool Supported = MsgPackSchema::Value<M>::Supported;
+
+    static inline void Write(CMessagePack &Pack, const C &Obj)
+    {
+        Pack.AddValue(Obj.*Ptr);
+    }
+
+    static inline bool Read(const char *&In, const char *End, C &Obj)
+    {
+        return MsgPackSchema::Value<M>::Read(In, End, Obj.*Ptr);
+    }
+
+    static inline void Get(CMessagePack &Pack, C &Obj)
+    {
+        Obj.*Ptr = Pack.GetValue<M>();
+    }
+};
+
+/**
+ * @brief Encodes and decodes a struct as map of its fields with a decoder specialized for the declared schema.
+ */
+template<class T, class... Fields>
+class CMsgPackSchema
+{
+    static_assert(sizeof...(Fields) > 0, "A schema needs at least one field!");
+    using List = MsgPackSchema::FieldList<Fields...>;
+
+    static constexpr size_t COUNT = sizeof...(Fields);
+
+    public:
+        using Type = T;
+
+        static constexpr bool COMPILED = List::Supported;   //!< False if a field type can only be decoded generically.
+
+        /**
+         * @param Names: Map key of every field, in the order of the fields.
+         */
+        template<class... Names>
+        explicit CMsgPackSchema(const Names &... FieldNames)
+        {
+            static_assert(sizeof...(Names) == COUNT, "Every field needs a name!");
+
+            const char *List[] = {FieldNames...};
+            for (size_t i = 0; i < COUNT; i++)
+            {
+                m_Names[i] = List[i];
+
+                //The map header is matched together with the first key.
+                CMessagePack Tmp;
+                if(i == 0)
+                    Tmp.AddMap(COUNT);
+
+                Tmp.AddValue(m_Names[i]);
+                m_Keys[i].assign(Tmp.GetData().begin(), Tmp.GetData().end());
+            }
+        }
+
+        /**
+         * @brief Writes "Obj" as map of its fields.
+         */
+        inline void Encode(CMessagePack &Pack, const T &Obj) const
+        {
+            Pack.AddMap(COUNT);
+            List::Encode(Pack, m_Names.data(), Obj);
+        }
+
+        /**
+         * @brief Reads a message with the specialized decoder.
+         *
+         * @param In: Stream to read.
+         * @param Len: Available bytes in the stream.
+         * @param Obj: Destination.
+         *
+         * @return Returns the count of read bytes or 0 if the message doesn't have the declared shape. "Obj" may be modified in that case.
+         */
+        inline size_t Decode(const char *In, size_t Len, T &Obj) const
+        {
+            if(!COMPILED)
+                return 0;
+
+            const char *Pos = In;
+            if(!List::Decode(Pos, In + Len, m_Keys.data(), Obj))
+                return 0;
+
+            return Pos - In;
+        }
+
+        /**
+         * @brief Reads a message with the generic decoder. Keys may have any order, unknown keys are skipped and missing fields are left untouched.
+         *
+         * @throw CMsgPackException If the message isn't a map or a value doesn't match the type of its field.
+         */
+        inline void DecodeGeneric(CMessagePack &Pack, T &Obj) const
+        {
+            uint32_t Pairs = Pack.UnpackMap();
+            for (uint32_t i = 0; i < Pairs; i++)
+            {
+                MsgFormats fmt = Pack.GetNextType();
+                if(fmt == MsgFormats::RESERVED)
+                    throw CMsgPackException(MsgPackErrorType::EMPTY_STREAM);
+
+                size_t Field = COUNT;
+                if(IsStringKey(fmt))
+                {
+                    uint32_t Length;
+                    const char *Key = Pack.GetStr(Length);
+
+                    for (size_t j = 0; j < COUNT && Field == COUNT; j++)
+                    {
+                        if(m_Names[j].size() == Length && memcmp(m_Names[j].data(), Key, Length) == 0)
+                            Field = j;
+                    }
+                }
+                else
+                    Pack.SkipValue();
+
+                if(Field == COUNT)
+                    Pack.SkipValue();
+                else
+                    List::Get(Field, Pack, Obj);
+            }
+        }
+
+        ~CMsgPackSchema() {}
+    private:
+        std::array<std::string, COUNT> m_Names;
+        std::array<std::string, COUNT> m_Keys;     //!< Encoded keys, the first one with the map header.
+
+        static inline bool IsStringKey(MsgFormats fmt)
+        {
+            switch (fmt)
+            {
+                case MsgFormats::FIXSTR:
+                case MsgFormats::STR8:
+                case MsgFormats::STR16:
+                case MsgFormats::STR32:
+                case MsgFormats::FIXEXT1:
+                case MsgFormats::FIXEXT2:
+                case MsgFormats::FIXEXT4:
+                case MsgFormats::FIXEXT8:
+                case MsgFormats::FIXEXT16:
+                case MsgFormats::EXT8:
+                case MsgFormats::EXT16:
+                case MsgFormats::EXT32: return true;
+                default: return false;
+            }
+        }
+};
+
+#endif //MESSAGEPACKSCHEMA_HPP
@@ -0,0 +1,481 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2020 Christian Tost
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+ * Encode / decode throughput per type family.
+ * Every dataset is generated from a fixed seed, so runs are comparable.
+ * Prints one JSON object per line:
+ *  {"family":"small_int","op":"encode","values":...,"bytes":...,"iterations":...,"seconds":...,"ops_per_s":...,"mb_per_s":...}
+ *
+ * Usage: bench [--filter=<substring>] [--min-time=<seconds>]
+ */
+
+#include <iostream>
+#include <chrono>
+#include <random>
+#include <functional>
+#include <string>
+#include <vector>
+#include <map>
+#include <unordered_map>
+#include <set>
+#include <stdio.h>
+#include "MessagePack.hpp"
+#include "MessagePackCompress.hpp"
+#include "MessagePackReader.hpp"
+#include "MessagePackSchema.hpp"
+#include "MessagePackColumns.hpp"
+
+using namespace std;
+
+static volatile uint64_t g_Sink = 0;   //Keeps the compiler from removing the benchmarked code.
+
+struct SOptions
+{
+    std::string Filter;
+    double MinTime = 0.25;
+};
+
+class CRecord
+{
+    public:
+        int64_t Id;
+        std::string Name;
+        double Price;
+        std::vector<int32_t> Tags;
+
+        void Serialize(CMessagePack &Pack) const
+        {
+            Pack.AddPair("id", Id);
+            Pack.AddPair("name", Name);
+            Pack.AddPair("price", Price);
+            Pack.AddPair("tags", Tags);
+        }
+
+        void Deserialize(CMessagePack &Pack)
+        {
+            uint32_t Pairs = Pack.UnpackMap();
+            for (uint32_t i = 0; i < Pairs; i++)
+            {
+                std::string Key = Pack.GetValue<std::string>();
+                if(Key == "id")
+                    Id = Pack.GetValue<int64_t>();
+                else if(Key == "name")
+                    Name = Pack.GetValue<std::string>();
+                else if(Key == "price")
+                    Price = Pack.GetValue<double>();
+                else if(Key == "tags")
+                    Tags = Pack.GetValue<std::vector<int32_t>>();
+                else
+                    Pack.SkipValue();
+            }
+        }
+};
+
+static const CMsgPackSchema<CRecord,
+    CSchemaField<CRecord, int64_t, &CRecord::Id>,
+    CSchemaField<CRecord, std::string, &CRecord::Name>,
+    CSchemaField<CRecord, double, &CRecord::Price>,
+    CSchemaField<CRecord, std::vector<int32_t>, &CRecord::Tags>> RecordSchema("id", "name", "price", "tags");
+
+/**
+ * @brief Runs "fn" until "MinTime" has passed and prints the result.
+ *
+ * @param Values: Count of values processed by one call of "fn".
+ * @param Bytes: Count of encoded bytes processed by one call of "fn".
+ */
+void Run(const SOptions &Opt, const std::string &Family, const std::string &Op, size_t Values, size_t Bytes, std::function<void()> fn)
+{
+    if(!Opt.Filter.empty() && (Family + "/" + Op).find(Opt.Filter) == std::string::npos)
+        return;
+
+    using Clock = std::chrono::steady_clock;
+
+    fn();   //Warm up caches and buffers.
+
+    uint64_t Iterations = 0;
+    double Seconds = 0;
+    auto Start = Clock::now();
+
+    do
+    {
+        fn();
+        Iterations++;
+        Seconds = std::chrono::duration<double>(Clock::now() - Start).count();
+    } while (Seconds < Opt.MinTime);
+
+    char Line[512];
+    snprintf(Line, sizeof(Line), "{\"family\":\"%s\",\"op\":\"%s\",\"values\":%zu,\"bytes\":%zu,\"iterations\":%llu,\"seconds\":%.6f,\"ops_per_s\":%.1f,\"mb_per_s\":%.2f}",
+        Family.c_str(), Op.c_str(), Values, Bytes, (unsigned long long)Iterations, Seconds,
+        Values * Iterations / Seconds, Bytes * Iterations / Seconds / (1024.0 * 1024.0));
+
+    cout << Line << endl;
+}
+
+template<class T, typename std::enable_if<std::is_arithmetic<T>::value>::type * = nullptr>
+inline uint64_t Consume(const T &val)
+{
+    return val != T();
+}
+
+template<class T, typename std::enable_if<!std::is_arithmetic<T>::value>::type * = nullptr>
+inline uint64_t Consume(const T &val)
+{
+    return val.size();
+}
+
+/**
+ * @brief Benchmarks encoding and decoding of a list of values.
+ */
+template<class T>
+void RunFamily(const SOptions &Opt, const std::string &Family, const std::vector<T> &Values, size_t PackMin = 0)
+{
+    CMessagePack Pack;
+    Pack.SetIntegerPacking(PackMin);
+    Pack.SetFloatPacking(PackMin);
+    for (auto &&v : Values)
+        Pack.AddValue(v);
+
+    size_t Bytes = Pack.GetData().size();
+
+    Run(Opt, Family, "encode", Values.size(), Bytes, [&]()
+    {
+        Pack.Clear();
+        for (auto &&v : Values)
+            Pack.AddValue(v);
+
+        g_Sink += Pack.GetData().size();
+    });
+
+    Run(Opt, Family, "decode", Values.size(), Bytes, [&]()
+    {
+        Pack.Reset();
+        for (size_t i = 0; i < Values.size(); i++)
+            g_Sink += Consume(Pack.GetValue<T>());
+    });
+}
+
+int main(int argc, char const *argv[])
+{
+    SOptions Opt;
+    for (int i = 1; i < argc; i++)
+    {
+        std::string Arg = argv[i];
+        if(Arg.compare(0, 9, "--filter=") == 0)
+            Opt.Filter = Arg.substr(9);
+        else if(Arg.compare(0, 11, "--min-time=") == 0)
+            Opt.MinTime = atof(Arg.c_str() + 11);
+        else
+        {
+            cerr << "Usage: " << argv[0] << " [--filter=<substring>] [--min-time=<seconds>]" << endl;
+            return 1;
+        }
+    }
+
+    std::mt19937_64 Rng(0x4D736750);   //Fixed seed for reproducible datasets.
+    const size_t COUNT = 10000;
+
+    std::vector<int32_t> SmallInts(COUNT);
+    for (auto &&v : SmallInts)
+        v = std::uniform_int_distribution<int32_t>(-32, 127)(Rng);
+
+    std::vector<int64_t> WideInts(COUNT);
+    for (auto &&v : WideInts)
+        v = std::uniform_int_distribution<int64_t>(INT64_MIN, INT64_MAX)(Rng);
+
+    std::vector<double> Floats(COUNT);
+    for (auto &&v : Floats)
+        v = std::normal_distribution<double>(100.0, 25.0)(Rng);
+
+    auto RandomString = [&](size_t Min, size_t Max)
+    {
+        std::string Ret(std::uniform_int_distribution<size_t>(Min, Max)(Rng), ' ');
+        for (auto &&c : Ret)
+            c = (char)std::uniform_int_distribution<int>('a', 'z')(Rng);
+
+        return Ret;
+    };
+
+    std::vector<std::string> ShortStrings(COUNT);
+    for (auto &&v : ShortStrings)
+        v = RandomString(4, 24);
+
+    std::vector<std::string> LongStrings(COUNT / 10);
+    for (auto &&v : LongStrings)
+        v = RandomString(256, 4096);
+
+    std::vector<std::vector<char>> Bins(COUNT / 10);
+    for (auto &&v : Bins)
+    {
+        v.resize(std::uniform_int_distribution<size_t>(256, 4096)(Rng));
+        for (auto &&c : v)
+            c = (char)Rng();
+    }
+
+    std::vector<std::vector<int32_t>> Arrays(COUNT / 100);
+    for (auto &&v : Arrays)
+    {
+        v.resize(100);
+        for (auto &&e : v)
+            e = std::uniform_int_distribution<int32_t>(-100000, 100000)(Rng);
+    }
+
+    //Regular samples with a little jitter.
+    std::vector<std::vector<int64_t>> Timestamps(COUNT / 1000);
+    for (auto &&v : Timestamps)
+    {
+        int64_t Time = 1600000000000;
+        v.resize(1000);
+        for (auto &&e : v)
+            e = Time += 1000 + std::uniform_int_distribution<int64_t>(-8, 8)(Rng);
+    }
+
+    //Sensor readings with a 0.01 resolution.
+    std::vector<std::vector<double>> Readings(COUNT / 1000);
+    for (auto &&v : Readings)
+    {
+        double Reading = 20;
+        v.resize(1000);
+        for (auto &&e : v)
+            e = Reading = std::round((Reading + std::uniform_real_distribution<double>(-0.05, 0.05)(Rng)) * 100) / 100;
+    }
+
+    std::vector<std::map<std::string, int32_t>> Maps(COUNT / 20);
+    for (auto &&v : Maps)
+    {
+        for (int i = 0; i < 20; i++)
+            v[RandomString(4, 12)] = std::uniform_int_distribution<int32_t>(0, 1000)(Rng);
+    }
+
+    std::vector<std::unordered_map<std::string, std::string>> HashMaps(COUNT / 1000);
+    for (auto &&v : HashMaps)
+    {
+        for (int i = 0; i < 1000; i++)
+            v[RandomString(8, 16)] = RandomString(16, 48);
+    }
+
+    std::vector<std::set<int32_t>> Sets(COUNT / 100);
+    for (auto &&v : Sets)
+    {
+        for (int i = 0; i < 100; i++)
+            v.insert(std::uniform_int_distribution<int32_t>(0, 100000)(Rng));
+    }
+
+    std::vector<CRecord> Records(COUNT / 10);
+    for (auto &&r : Records)
+    {
+        r.Id = std::uniform_int_distribution<int64_t>(0, INT64_MAX)(Rng);
+        r.Name = RandomString(8, 32);
+        r.Price = std::uniform_real_distribution<double>(0, 1000)(Rng);
+        r.Tags.resize(std::uniform_int_distribution<size_t>(0, 8)(Rng));
+        for (auto &&t : r.Tags)
+            t = std::uniform_int_distribution<int32_t>(0, 500)(Rng);
+    }
+
+    RunFamily(Opt, "small_int", SmallInts);
+    RunFamily(Opt, "wide_int", WideInts);
+    RunFamily(Opt, "float", Floats);
+    RunFamily(Opt, "short_string", ShortStrings);
+    RunFamily(Opt, "long_string", LongStrings);
+    RunFamily(Opt, "array", Arrays);
+    RunFamily(Opt, "array_packed", Arrays, 16);
+    RunFamily(Opt, "timestamps", Timestamps);
+    RunFamily(Opt, "timestamps_packed", Timestamps, 16);
+    RunFamily(Opt, "readings", Readings);
+    RunFamily(Opt, "readings_packed", Readings, 16);
+    RunFamily(Opt, "map", Maps);
+    RunFamily(Opt, "unordered_map", HashMaps);
+    RunFamily(Opt, "set", Sets);
+
+    CMessagePack Pack;
+
+    //AddValue(std::vector<char>) writes an array, bins need AddBin.
+    for (auto &&v : Bins)
+        Pack.AddBin(v);
+
+    size_t BinBytes = Pack.GetData().size();
+    Run(Opt, "bin", "encode", Bins.size(), BinBytes, [&]()
+    {
+        Pack.Clear();
+        for (auto &&v : Bins)
+            Pack.AddBin(v);
+
+        g_Sink += Pack.GetData().size();
+    });
+
+    Run(Opt, "bin", "decode", Bins.size(), BinBytes, [&]()
+    {
+        Pack.Reset();
+        for (size_t i = 0; i < Bins.size(); i++)
+            g_Sink += Pack.GetValue<std::vector<char>>().size();
+    });
+
+    Pack.Clear();
+    for (auto &&r : Records)
+        Pack.AddValue(r);
+
+    size_t RecordBytes = Pack.GetData().size();
+    Run(Opt, "nested_object", "encode", Records.size(), RecordBytes, [&]()
+    {
+        Pack.Clear();
+        for (auto &&r : Records)
+            Pack.AddValue(r);
+
+        g_Sink += Pack.GetData().size();
+    });
+
+    Run(Opt, "nested_object", "decode", Records.size(), RecordBytes, [&]()
+    {
+        CRecord Rec;
+        Pack.Reset();
+        for (size_t i = 0; i < Records.size(); i++)
+        {
+            Rec.Deserialize(Pack);
+            g_Sink += Rec.Tags.size();
+        }
+    });
+
+    Run(Opt, "nested_object", "schema", Records.size(), RecordBytes, [&]()
+    {
+        Pack.Reset();
+        for (size_t i = 0; i < Records.size(); i++)
+            g_Sink += Pack.GetSchema(RecordSchema).Tags.size();
+    });
+
+    Run(Opt, "nested_object", "skip", Records.size(), RecordBytes, [&]()
+    {
+        Pack.Reset();
+        Pack.SkipValue(Records.size());
+        g_Sink += Pack.GetNextType();
+    });
+
+    //The same records transposed into one array per field.
+    Pack.Clear();
+    CMsgPackColumns::Add(Pack, Records);
+    std::vector<char> Columnar = Pack.Serialize();
+
+    Run(Opt, "columns", "encode", Records.size(), Columnar.size(), [&]()
+    {
+        Pack.Clear();
+        CMsgPackColumns::Add(Pack, Records);
+        g_Sink += Pack.GetData().size();
+    });
+
+    Run(Opt, "columns", "decode", Records.size(), Columnar.size(), [&]()
+    {
+        Pack.Deserialize(Columnar);
+        g_Sink += CMsgPackColumns::Get<CRecord>(Pack).size();
+    });
+
+    Run(Opt, "columns", "read_column", Records.size(), Columnar.size(), [&]()
+    {
+        g_Sink += CMsgPackColumns(Columnar).GetColumn<double>("price").size();
+    });
+
+    //The same records with the keys written through the string dictionary.
+    Pack.Clear();
+    Pack.SetStringInterning(16);
+    for (auto &&r : Records)
+        Pack.AddValue(r);
+
+    size_t InternedBytes = Pack.GetData().size();
+    Run(Opt, "interned_object", "encode", Records.size(), InternedBytes, [&]()
+    {
+        Pack.Clear();
+        for (auto &&r : Records)
+            Pack.AddValue(r);
+
+        g_Sink += Pack.GetData().size();
+    });
+
+    Run(Opt, "interned_object", "decode", Records.size(), InternedBytes, [&]()
+    {
+        CRecord Rec;
+        Pack.Reset();
+        for (size_t i = 0; i < Records.size(); i++)
+        {
+            Rec.Deserialize(Pack);
+            g_Sink += Rec.Tags.size();
+        }
+    });
+
+    //Reads 3 fields out of documents with 200 keys.
+    std::vector<std::map<std::string, int32_t>> WideDocs(COUNT / 100);
+    for (auto &&v : WideDocs)
+    {
+        for (int i = 0; i < 200; i++)
+            v["field" + std::to_string(i)] = std::uniform_int_distribution<int32_t>(0, 1000000)(Rng);
+    }
+
+    std::vector<std::vector<char>> WideStreams;
+    size_t WideBytes = 0;
+    for (auto &&v : WideDocs)
+    {
+        Pack.Clear();
+        Pack.AddValue(v);
+        WideStreams.push_back(Pack.Serialize());
+        WideBytes += WideStreams.back().size();
+    }
+
+    Run(Opt, "projection", "decode", WideDocs.size(), WideBytes, [&]()
+    {
+        CMessagePack Doc;
+        for (auto &&s : WideStreams)
+        {
+            Doc.Deserialize(std::vector<char>(s));
+            auto Map = Doc.GetValue<std::map<std::string, int32_t>>();
+            g_Sink += Map["field10"] + Map["field100"] + Map["field150"];
+        }
+    });
+
+    const std::vector<CMsgPackPath> Fields = {{"field10"}, {"field100"}, {"field150"}};
+    Run(Opt, "projection", "extract", WideDocs.size(), WideBytes, [&]()
+    {
+        for (auto &&s : WideStreams)
+        {
+            for (auto &&v : CMsgPackReader::ExtractAll(s, Fields))
+                g_Sink += CMsgPackReader(v.Data, v.Size).ReadInt();
+        }
+    });
+
+    //Compression of the plain record stream.
+    Pack.Clear();
+    Pack.SetStringInterning(0);
+    for (auto &&r : Records)
+        Pack.AddValue(r);
+
+    std::vector<char> Plain = Pack.Serialize();
+    std::vector<char> Compressed = CMsgPackCompressor<>::Compress(Plain);
+    Run(Opt, "lz_chunks", "compress", 1, Plain.size(), [&]()
+    {
+        g_Sink += CMsgPackCompressor<>::Compress(Plain).size();
+    });
+
+    Run(Opt, "lz_chunks", "decompress", 1, Plain.size(), [&]()
+    {
+        g_Sink += CMsgPackDecompressor<>::Decompress(Compressed).size();
+    });
+
+    return 0;
+}
@@ -0,0 +1,712 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2020 Christian Tost
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+ * Differential fuzz target. Every input is used twice:
+ *  - As messagepack stream, which is skipped by CMessagePack and CMsgPackReader (both have to agree),
+ *    decoded with the typed GetValue() overloads and transcoded to JSON. The input is also parsed as JSON text.
+ *  - As entropy for random values, which are round-tripped through AddValue() / GetValue() and compared.
+ * Each input must finish within the time budget (MSGPACK_FUZZ_BUDGET_MS, default 100 ms),
+ * so quadratic or pathological decode paths fail like crashes. The ctest smoke test raises it to 10 s.
+ *
+ * libFuzzer: build with MSGPACK_LIBFUZZER and -fsanitize=fuzzer (CMESSAGEPACK_LIBFUZZER=ON).
+ * AFL or replay: fuzz [--random=<count>] [<file or directory> ...], reads stdin without arguments.
+ */
+
+#include <iostream>
+#include <fstream>
+#include <chrono>
+#include <random>
+#include <functional>
+#include <string>
+#include <vector>
+#include <list>
+#include <map>
+#include <unordered_map>
+#include <set>
+#include <unordered_set>
+#include <stdio.h>
+#include <stdlib.h>
+#include <dirent.h>
+#include "MessagePack.hpp"
+#include "MessagePackReader.hpp"
+#include "MessagePackJson.hpp"
+#include "MessagePackCompress.hpp"
+#include "MessagePackPatch.hpp"
+#include "MessagePackDiff.hpp"
+#include "MessagePackSchema.hpp"
+#include "MessagePackColumns.hpp"
+
+using namespace std;
+
+static void Fail(const std::string &Msg)
+{
+    cerr << "FUZZ FAILURE: " << Msg << endl;
+    abort();
+}
+
+/**
+ * @brief Reads random values from the fuzz input. Returns zeros if the input is consumed.
+ */
+class CFuzzInput
+{
+    public:
+        CFuzzInput(const uint8_t *Data, size_t Size) : m_Data(Data), m_Size(Size), m_Pos(0) {}
+
+        inline bool AtEnd() const
+        {
+            return m_Pos >= m_Size;
+        }
+
+        template<class T>
+        inline T Get()
+        {
+            T Ret;
+            uint8_t Bytes[sizeof(T)] = {};
+            for (size_t i = 0; i < sizeof(T) && m_Pos < m_Size; i++)
+                Bytes[i] = m_Data[m_Pos++];
+
+            memcpy(&Ret, Bytes, sizeof(T));
+            return Ret;
+        }
+
+        /**
+         * @return Returns a number in [0, Max].
+         */
+        inline size_t GetRange(size_t Max)
+        {
+            return Get<uint32_t>() % (Max + 1);
+        }
+
+        //Empty strings are written as NIL and can't be read back as std::string, so every string has at least one character.
+        inline std::string GetString(size_t Max)
+        {
+            std::string Ret(1 + GetRange(Max), ' ');
+            for (auto &&c : Ret)
+                c = Get<char>();
+
+            return Ret;
+        }
+
+    private:
+        const uint8_t *m_Data;
+        size_t m_Size;
+        size_t m_Pos;
+};
+
+using Checker = std::function<void(CMessagePack&)>;
+
+template<class T>
+static bool Equal(const T &a, const T &b)
+{
+    return a == b;
+}
+
+//Compares bitwise, so NaNs are round-tripped too.
+static bool Equal(const float &a, const float &b)
+{
+    return memcmp(&a, &b, sizeof(a)) == 0;
+}
+
+static bool Equal(const double &a, const double &b)
+{
+    return memcmp(&a, &b, sizeof(a)) == 0;
+}
+
+template<class T>
+static bool Equal(const std::vector<T> &a, const std::vector<T> &b)
+{
+    return a.size() == b.size() && std::equal(a.begin(), a.end(), b.begin(), [](const T &x, const T &y) { return Equal(x, y); });
+}
+
+template<class T>
+static void AddRoundTrip(CMessagePack &Pack, std::vector<Checker> &Checks, const T &val, const char *Name)
+{
+    size_t Before = Pack.GetData().size();
+    size_t Measured = Pack.MeasureValue(val);
+    Pack.AddValue(val);
+
+    if(Measured != Pack.GetData().size() - Before)
+        Fail(std::string("MeasureValue mismatch for ") + Name);
+
+    Checks.push_back([val, Name](CMessagePack &In)
+    {
+        if(!Equal(In.GetValue<T>(), val))
+            Fail(std::string("Round trip mismatch for ") + Name);
+    });
+}
+
+/**
+ * @brief Builds random values from the input, encodes them and checks that every decoder reads them back.
+ */
+static void RoundTrip(const uint8_t *Data, size_t Size)
+{
+    CFuzzInput In(Data, Size);
+    CMessagePack Pack;
+    std::vector<Checker> Checks;
+
+    //Half of the inputs write their strings through the dictionary.
+    Pack.SetStringInterning(In.GetRange(1) * In.GetRange(80));
+    Pack.SetCanonical(In.GetRange(1) == 1);
+    Pack.SetIntegerPacking(In.GetRange(1) * In.GetRange(8));
+    Pack.SetFloatPacking(In.GetRange(1) * In.GetRange(8));
+    Pack.SetFloatNarrowing((MsgPackFloatNarrowing)In.GetRange(2));
+
+    for (int i = 0; i < 64 && !In.AtEnd(); i++)
+    {
+        switch (In.GetRange(18))
+        {
+            case 0:
+            {
+                Pack.AddValue(nullptr);
+                Checks.push_back([](CMessagePack &In) { In.GetValue<std::nullptr_t>(); });
+            }break;
+
+            case 1: AddRoundTrip(Pack, Checks, In.Get<uint8_t>() % 2 == 1, "bool"); break;
+            case 2: AddRoundTrip(Pack, Checks, In.Get<int8_t>(), "int8"); break;
+            case 3: AddRoundTrip(Pack, Checks, In.Get<int16_t>(), "int16"); break;
+            case 4: AddRoundTrip(Pack, Checks, In.Get<int32_t>(), "int32"); break;
+            case 5: AddRoundTrip(Pack, Checks, In.Get<int64_t>(), "int64"); break;
+            case 6: AddRoundTrip(Pack, Checks, In.Get<uint8_t>(), "uint8"); break;
+            case 7: AddRoundTrip(Pack, Checks, In.Get<uint16_t>(), "uint16"); break;
+            case 8: AddRoundTrip(Pack, Checks, In.Get<uint32_t>(), "uint32"); break;
+            case 9: AddRoundTrip(Pack, Checks, In.Get<uint64_t>(), "uint64"); break;
+            case 10: AddRoundTrip(Pack, Checks, In.Get<float>(), "float"); break;
+            case 11: AddRoundTrip(Pack, Checks, In.Get<double>(), "double"); break;
+
+            case 12:
+            {
+                //Grows past the str8 / str16 limits now and then.
+                size_t Max = In.GetRange(3) == 0 ? 70000 : 40;
+                AddRoundTrip(Pack, Checks, In.GetString(Max), "string");
+            }break;
+
+            case 13:
+            {
+                std::string Str = In.GetString(40);
+                Str.erase(std::remove(Str.begin(), Str.end(), '\0'), Str.end());
+                if(Str.empty())
+                    Str = "x";
+
+                Pack.AddValue(Str.c_str());
+                Checks.push_back([Str](CMessagePack &In)
+                {
+                    if(In.GetValue<std::string>() != Str)
+                        Fail("Round trip mismatch for char*");
+                });
+            }break;
+
+            case 14:
+            {
+                //AddValue(std::vector<char>) writes an array, bins need AddBin.
+                std::vector<char> Bin(1 + In.GetRange(300));
+                for (auto &&c : Bin)
+                    c = In.Get<char>();
+
+                Pack.AddBin(Bin);
+                Checks.push_back([Bin](CMessagePack &In)
+                {
+                    if(In.GetValue<std::vector<char>>() != Bin)
+                        Fail("Round trip mismatch for bin");
+                });
+            }break;
+
+            case 15:
+            {
+                std::vector<int64_t> Vec(In.GetRange(20));
+                for (auto &&e : Vec)
+                    e = In.Get<int64_t>() >> In.GetRange(63);
+
+                AddRoundTrip(Pack, Checks, Vec, "vector");
+                AddRoundTrip(Pack, Checks, std::list<int64_t>(Vec.begin(), Vec.end()), "list");
+
+                //Mostly regular series with random outliers.
+                std::vector<double> Reals(Vec.size());
+                std::vector<float> Floats(Vec.size());
+                double Base = In.Get<double>();
+                for (size_t j = 0; j < Reals.size(); j++)
+                {
+                    Reals[j] = In.GetRange(3) == 0 ? In.Get<double>() : Base + j * 0.25;
+                    Floats[j] = In.GetRange(3) == 0 ? In.Get<float>() : 1.5f * (j % 4);
+                }
+
+                AddRoundTrip(Pack, Checks, Reals, "double vector");
+                AddRoundTrip(Pack, Checks, Floats, "float vector");
+            }break;
+
+            case 16:
+            {
+                std::map<std::string, int32_t> Map;
+                size_t Count = In.GetRange(20);
+                for (size_t j = 0; j < Count; j++)
+                    Map[In.GetString(8)] = In.Get<int32_t>();
+
+                AddRoundTrip(Pack, Checks, Map, "map");
+            }break;
+
+            case 17:
+            {
+                std::unordered_map<uint16_t, std::vector<std::string>> Map;
+                size_t Count = In.GetRange(8);
+                for (size_t j = 0; j < Count; j++)
+                    Map[In.Get<uint16_t>()] = std::vector<std::string>(In.GetRange(3), In.GetString(5));
+
+                AddRoundTrip(Pack, Checks, Map, "unordered_map");
+
+                //The canonical bytes don't depend on the iteration order.
+                CMessagePack First, Second;
+                First.SetCanonical(true);
+                Second.SetCanonical(true);
+                First.AddValue(Map);
+                Second.AddValue(std::unordered_map<uint16_t, std::vector<std::string>>(Map.begin(), Map.end(), 64));
+                if(First.GetData() != Second.GetData())
+                    Fail("Canonical encoding depends on the iteration order");
+            }break;
+
+            case 18:
+            {
+                std::set<int32_t> Set;
+                size_t Count = In.GetRange(30);
+                for (size_t j = 0; j < Count; j++)
+                    Set.insert(In.Get<int32_t>());
+
+                AddRoundTrip(Pack, Checks, Set, "set");
+                AddRoundTrip(Pack, Checks, std::unordered_set<int32_t>(Set.begin(), Set.end()), "unordered_set");
+            }break;
+        }
+    }
+
+    CMessagePack Out;
+    Out.Deserialize(Pack.Serialize());
+    for (auto &&c : Checks)
+        c(Out);
+
+    if(Out.GetNextType() != MsgFormats::RESERVED)
+        Fail("Round trip didn't consume the stream");
+
+    Out.Reset();
+    Out.SkipValue(Checks.size());
+    if(Out.GetNextType() != MsgFormats::RESERVED)
+        Fail("SkipValue didn't consume the stream");
+
+    CMsgPackReader Reader(Out.GetData());
+    Reader.SkipValue(Checks.size());
+    if(!Reader.AtEnd())
+        Fail("CMsgPackReader didn't consume the stream");
+
+    //Every valid stream is valid JSON input.
+    CMessagePack Json;
+    CJsonToMsgPack::Convert(CMsgPackToJson::ToJson(Out.GetData()), Json);
+}
+
+struct SFuzzRecord
+{
+    int64_t a;
+    std::string b;
+    std::vector<double> c;
+    bool d;
+};
+
+static const CMsgPackSchema<SFuzzRecord,
+    CSchemaField<SFuzzRecord, int64_t, &SFuzzRecord::a>,
+    CSchemaField<SFuzzRecord, std::string, &SFuzzRecord::b>,
+    CSchemaField<SFuzzRecord, std::vector<double>, &SFuzzRecord::c>,
+    CSchemaField<SFuzzRecord, bool, &SFuzzRecord::d>> FuzzSchema("a", "b", "c", "d");
+
+/**
+ * @brief The compiled decoder of a schema has to read the same values as the generic one.
+ */
+static void DecodeSchema(CMessagePack &Pack)
+{
+    SFuzzRecord Compiled{}, Generic{};
+    size_t Size = FuzzSchema.Decode(Pack.GetData().data(), Pack.GetData().size(), Compiled);
+    if(Size != 0)
+    {
+        Pack.Reset();
+        try
+        {
+            FuzzSchema.DecodeGeneric(Pack, Generic);
+        }
+        catch(const CMsgPackException &)
+        {
+            Fail("Generic decoder rejected a valid schema message");
+        }
+
+        bool Same = Compiled.a == Generic.a && Compiled.b == Generic.b && Compiled.d == Generic.d && Compiled.c.size() == Generic.c.size();
+        for (size_t i = 0; Same && i < Compiled.c.size(); i++)
+            Same = Equal(Compiled.c[i], Generic.c[i]);
+
+        if(!Same || Pack.GetStreamPos() != Size)
+            Fail("Compiled and generic schema decoder disagree");
+    }
+
+    Pack.Reset();
+    try
+    {
+        while (Pack.GetNextType() != MsgFormats::RESERVED)
+            Pack.GetSchema(FuzzSchema);
+    }
+    catch(const CMsgPackException &)
+    {
+    }
+}
+
+/**
+ * @brief Reads values of type "T" until the stream ends or a value doesn't match.
+ */
+template<class T>
+static void DecodeAll(CMessagePack &Pack)
+{
+    Pack.Reset();
+    try
+    {
+        while (Pack.GetNextType() != MsgFormats::RESERVED)
+            Pack.GetValue<T>();
+    }
+    catch(const CMsgPackException &)
+    {
+    }
+}
+
+/**
+ * @brief Decodes arbitrary bytes with every decoder. Only CMsgPackExceptions are allowed.
+ */
+static void DecodeBytes(const uint8_t *Data, size_t Size)
+{
+    CMessagePack Pack;
+    Pack.Deserialize(std::vector<char>(Data, Data + Size));
+    CMsgPackReader Reader(Pack.GetData());
+
+    //Both skippers have to end at the same position for every value, which CMsgPackReader accepts.
+    while (!Reader.AtEnd())
+    {
+        size_t Start = Reader.GetPos();
+        try
+        {
+            Reader.SkipValue();
+        }
+        catch(const CMsgPackException &)
+        {
+            break;
+        }
+
+        CMessagePack Single;
+        Single.Deserialize(std::vector<char>(Pack.GetData().begin() + Start, Pack.GetData().end()));
+        try
+        {
+            Single.SkipValue();
+        }
+        catch(const CMsgPackException &e)
+        {
+            if(e.GetErrType() == MsgPackErrorType::UNKNOWN_TYPE)
+                break;  //CMessagePack doesn't support ext types.
+
+            Fail("CMessagePack::SkipValue() rejected a valid value");
+        }
+
+        if(Start + Single.GetStreamPos() != Reader.GetPos())
+            Fail("CMessagePack and CMsgPackReader disagree about the value size");
+    }
+
+    DecodeAll<std::nullptr_t>(Pack);
+    DecodeAll<bool>(Pack);
+    DecodeAll<int64_t>(Pack);
+    DecodeAll<uint8_t>(Pack);
+    DecodeAll<double>(Pack);
+    DecodeAll<float>(Pack);
+    DecodeAll<std::string>(Pack);
+    DecodeAll<std::vector<char>>(Pack);
+    DecodeAll<std::vector<int32_t>>(Pack);
+    DecodeAll<std::vector<std::vector<std::string>>>(Pack);
+    DecodeAll<std::map<std::string, int64_t>>(Pack);
+    DecodeAll<std::unordered_map<int32_t, std::vector<double>>>(Pack);
+    DecodeAll<std::set<std::string>>(Pack);
+    DecodeAll<std::array<int8_t, 4>>(Pack);
+    DecodeAll<std::unique_ptr<std::vector<int16_t>>>(Pack);
+    DecodeAll<std::pair<std::string, std::tuple<int, double>>>(Pack);
+#ifdef MSGPACK_HAS_OPTIONAL_VARIANT
+    DecodeAll<std::optional<std::string>>(Pack);
+    DecodeAll<std::variant<int64_t, std::string, std::vector<bool>>>(Pack);
+#endif
+    DecodeSchema(Pack);
+
+    Pack.Reset();
+    try
+    {
+        while (Pack.GetNextType() != MsgFormats::RESERVED)
+            Pack.SkipValue();
+    }
+    catch(const CMsgPackException &)
+    {
+    }
+
+    try
+    {
+        std::vector<SMsgPackView> Views = CMsgPackReader::ExtractAll(Pack.GetData(), {{0}, {1, "a"}, {"a", 0, "b"}, {"a"}, {2, 2, 2}});
+        for (auto &&v : Views)
+        {
+            if(v.Data && (v.Data < Pack.GetData().data() || v.Data + v.Size > Pack.GetData().data() + Pack.GetData().size()))
+                Fail("ExtractAll() returned a view outside of the stream");
+        }
+
+        CMsgPackReader::Extract(Pack.GetData(), {"a", 0, "b"});
+    }
+    catch(const CMsgPackException &)
+    {
+    }
+
+    try
+    {
+        CMsgPackColumns Columns(Pack.GetData());
+        if(Columns.GetColumnView("a").Data)
+            Columns.GetColumn<std::string>("a");
+    }
+    catch(const CMsgPackException &)
+    {
+    }
+
+    try
+    {
+        CMsgPackToJson::ToJson(Pack.GetData());
+    }
+    catch(const CMsgPackException &)
+    {
+    }
+
+    try
+    {
+        CMessagePack Json;
+        CJsonToMsgPack::Convert((const char*)Data, Size, Json);
+    }
+    catch(const CMsgPackException &)
+    {
+    }
+}
+
+/**
+ * @brief Round-trips the input through the compression layer and decompresses it as arbitrary LZ and chunk data.
+ */
+static void Compression(const uint8_t *Data, size_t Size)
+{
+    //Repeating the input gives the matcher something to find.
+    std::vector<char> Plain(Data, Data + Size);
+    Plain.insert(Plain.end(), Data, Data + Size / 2);
+    Plain.insert(Plain.end(), Data + Size / 3, Data + Size);
+
+    size_t ChunkSize = Size == 0 ? 1 : 1 + Data[0] * 64;
+    if(CMsgPackDecompressor<>::Decompress(CMsgPackCompressor<>::Compress(Plain, ChunkSize)) != Plain)
+        Fail("Compression round trip mismatch");
+
+    std::vector<char> Out(std::min<size_t>(Size * 4, 1 << 16));
+    try
+    {
+        CMsgPackLZ::Decompress((const char*)Data, Size, Out.data(), Out.size());
+    }
+    catch(const CMsgPackException &)
+    {
+    }
+
+    try
+    {
+        CMsgPackDecompressor<>::Decompress((const char*)Data, Size);
+    }
+    catch(const CMsgPackException &)
+    {
+    }
+}
+
+/**
+ * @brief Replaces the first value of the input with a number and checks that the rest of the stream is untouched.
+ */
+static void Patching(const uint8_t *Data, size_t Size)
+{
+    std::vector<char> Doc(Data, Data + Size);
+    int64_t Value = Size == 0 ? 0 : (int64_t)(int8_t)Data[Size - 1] * (Size % 3 == 0 ? 1 : 100000);
+
+    size_t OldSize;
+    try
+    {
+        CMsgPackReader Reader(Doc);
+        Reader.SkipValue();
+        OldSize = Reader.GetPos();
+        CMsgPackPatcher(Doc).SetAt(0, Value);
+    }
+    catch(const CMsgPackException &)
+    {
+        return;
+    }
+
+    CMsgPackReader Reader(Doc);
+    if(Reader.ReadInt() != Value)
+        Fail("Patched value mismatch");
+
+    if(Doc.size() - Reader.GetPos() != Size - OldSize || memcmp(Doc.data() + Reader.GetPos(), Data + OldSize, Size - OldSize) != 0)
+        Fail("Patch changed the rest of the stream");
+}
+
+/**
+ * @brief Diffs the two halves of the input, applies the delta and applies the input itself as a delta.
+ */
+static void Diffing(const uint8_t *Data, size_t Size)
+{
+    std::vector<char> Old(Data, Data + Size / 2);
+    std::vector<char> New(Data + Size / 2, Data + Size);
+
+    try
+    {
+        std::vector<char> Delta = CMsgPackDiff::Diff(Old, New);
+        CMsgPackDiff::Apply(Old, Delta);
+    }
+    catch(const CMsgPackException &)
+    {
+        return;
+    }
+
+    if(CMsgPackDiff::Diff(Old, New) != std::vector<char>{(char)0x90})
+        Fail("Applied delta doesn't match the new document");
+
+    try
+    {
+        CMsgPackDiff::Apply(Old, (const char*)Data, Size);
+    }
+    catch(const CMsgPackException &)
+    {
+    }
+}
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *Data, size_t Size)
+{
+    static const double Budget = getenv("MSGPACK_FUZZ_BUDGET_MS") ? atof(getenv("MSGPACK_FUZZ_BUDGET_MS")) : 100.0;
+
+    auto Start = std::chrono::steady_clock::now();
+
+    DecodeBytes(Data, Size);
+    RoundTrip(Data, Size);
+    Compression(Data, Size);
+    Patching(Data, Size);
+    Diffing(Data, Size);
+
+    double Elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - Start).count();
+    if(Elapsed > Budget)
+        Fail("Input of " + std::to_string(Size) + " bytes took " + std::to_string(Elapsed) + " ms");
+
+    return 0;
+}
+
+#ifndef MSGPACK_LIBFUZZER
+
+static void RunFile(const std::string &Path)
+{
+    ifstream in(Path, ios::binary);
+    std::vector<uint8_t> Data((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    LLVMFuzzerTestOneInput(Data.data(), Data.size());
+}
+
+/**
+ * @brief Collects the files of "Path", which is either a file or a directory.
+ */
+static void CollectInputs(const std::string &Path, std::vector<std::string> &Files)
+{
+    DIR *Dir = opendir(Path.c_str());
+    if(!Dir)
+    {
+        Files.push_back(Path);
+        return;
+    }
+
+    while (dirent *Entry = readdir(Dir))
+    {
+        if(Entry->d_name[0] != '.')
+            Files.push_back(Path + "/" + Entry->d_name);
+    }
+
+    closedir(Dir);
+}
+
+int main(int argc, char const *argv[])
+{
+    size_t RandomRuns = 0;
+    std::vector<std::string> Files;
+
+    for (int i = 1; i < argc; i++)
+    {
+        std::string Arg = argv[i];
+        if(Arg.compare(0, 9, "--random=") == 0)
+            RandomRuns = strtoull(Arg.c_str() + 9, nullptr, 10);
+        else
+            CollectInputs(Arg, Files);
+    }
+
+    if(Files.empty() && RandomRuns == 0)
+    {
+        //AFL passes the input over stdin.
+        std::vector<uint8_t> Data((std::istreambuf_iterator<char>(cin)), std::istreambuf_iterator<char>());
+        LLVMFuzzerTestOneInput(Data.data(), Data.size());
+        return 0;
+    }
+
+    std::vector<std::vector<uint8_t>> Seeds;
+    for (auto &&f : Files)
+    {
+        RunFile(f);
+
+        ifstream in(f, ios::binary);
+        Seeds.emplace_back((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    }
+
+    //Without libFuzzer: random inputs and random mutations of the given files, from a fixed seed.
+    std::mt19937_64 Rng(0x4D736750);
+    for (size_t i = 0; i < RandomRuns; i++)
+    {
+        std::vector<uint8_t> Data;
+        if(!Seeds.empty() && i % 2 == 0)
+        {
+            Data = Seeds[Rng() % Seeds.size()];
+            size_t Mutations = 1 + Rng() % 8;
+            for (size_t j = 0; j < Mutations && !Data.empty(); j++)
+            {
+                size_t Pos = Rng() % Data.size();
+                switch (Rng() % 3)
+                {
+                    case 0: Data[Pos] ^= (uint8_t)(1 << (Rng() % 8)); break;
+                    case 1: Data[Pos] = (uint8_t)Rng(); break;
+                    case 2: Data.resize(Pos); break;
+                }
+            }
+        }
+        else
+        {
+            Data.resize(Rng() % 512);
+            for (auto &&c : Data)
+                c = (uint8_t)Rng();
+        }
+
+        LLVMFuzzerTestOneInput(Data.data(), Data.size());
+    }
+
+    cout << "Executed " << Files.size() << " files and " << RandomRuns << " random inputs" << endl;
+    return 0;
+}
+
+#endif //MSGPACK_LIBFUZZER
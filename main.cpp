@@ -22,11 +22,32 @@
  * SOFTWARE.
  */
 
+//The tests run with the counting instrumentation, see TestStats().
+#define MSGPACK_ENABLE_STATS
+
 #include <iostream>
 #include "MessagePack.hpp"
 #include <fstream>
 #include <iomanip>
 #include <bitset>
+#include "MessagePackPool.hpp"
+#include "MessagePackFixed.hpp"
+#include "MessagePackJson.hpp"
+#include "MessagePackReader.hpp"
+#include "MessagePackCompress.hpp"
+#include "MessagePackPatch.hpp"
+#include "MessagePackDiff.hpp"
+#include "MessagePackSchema.hpp"
+#include "MessagePackColumns.hpp"
+#include <sstream>
+#include <set>
+#include <unordered_set>
+#include <deque>
+#include <list>
+#include <array>
+#include <cmath>
+#include <cfloat>
+#include <limits>
 #include "CTest.hpp"
 
 using namespace std;
@@ -514,6 +535,7 @@ std::string MsgPackErrorTypeToString(MsgPackErrorType val)
 }
 
 CMessagePack Pack;
+std::string CorpusDir;	//Set by --corpus=<dir>, the test streams are written there as seeds for fuzz.cpp.
 
 void SaveTestMsgPack(const std::string &Name)
 {
@@ -562,7 +584,8 @@ void TestSerialPrimitives()
 	std::multimap<int, std::string> cmmap = {{1, "Test1"}, {1, "Hallo1"}, {3, "Hallo Test1"}};
 	Pack.AddValue(cmmap);	
 
-	// SaveTestMsgPack("TestSerialPrimitives.mpack");
+	if(!CorpusDir.empty())
+		SaveTestMsgPack(CorpusDir + "/TestSerialPrimitives.mpack");
 }
 
 void TestDeserialPrimitives()
@@ -771,11 +794,1571 @@ void TestSkipValues()
 	CT::Check("Value check after third skip", Pack.GetValue<int>(), 89, fnInt);
 }
 
+void TestReferenceOutput()
+{
+	std::string Blob(1000, 'x');
+	std::vector<char> Image(70000, 3);
+
+	CMessagePack Copy, Ref;
+	Ref.SetReferenceThreshold(512);
+
+	for (auto P : {&Copy, &Ref})
+	{
+		P->AddMap(3);
+		P->AddValue("name");
+		P->AddValue("Hallo Welt!");
+		P->AddValue("blob");
+		P->AddValue(Blob);
+		P->AddValue("image");
+		P->AddBin(Image);
+	}
+
+	CT::Check("Check referenced size", Ref.GetSerializedSize(), Copy.GetSerializedSize());
+	CT::Check("Check flattened stream", Ref.SerializeWithoutWipe() == Copy.SerializeWithoutWipe(), true);
+
+#ifdef MSGPACK_HAS_IOVEC
+	std::vector<char> Gathered;
+	auto Vecs = Ref.GetIOVec();
+	for (auto &&v : Vecs)
+		Gathered.insert(Gathered.end(), (char*)v.iov_base, (char*)v.iov_base + v.iov_len);
+
+	CT::Check("Check iovec count", Vecs.size(), (size_t)4);
+	CT::Check("Check blob is referenced", Vecs[1].iov_base == (void*)Blob.data(), true);
+	CT::Check("Check gathered stream", Gathered == Copy.SerializeWithoutWipe(), true);
+#endif
+}
+
+struct SThrowing
+{
+	template<class T>
+	void Serialize(T &Pack) const
+	{
+		Pack.AddPair("name", "Hallo Welt!");
+		throw std::runtime_error("Serialize failed");
+	}
+};
+
+void TestBufferPool()
+{
+	std::function<std::string(MsgFormats)> fn = std::bind(MsgFormatsToString, std::placeholders::_1);
+	CMsgPackBufferPool Pool(2);
+	CTest Obj;
+	const char *Data = nullptr;
+
+	{
+		CMsgPackLease Lease(Pool);
+		Lease->AddValue(Obj);
+		Data = Lease->GetData().data();
+	}
+
+	CT::Check("Check buffer returned", Pool.GetIdleCount(), (size_t)1);
+
+	CMsgPackLease Lease(Pool);
+	CT::Check("Check buffer recycled", Lease->GetData().data() == Data, true);
+	CT::Check("Check capacity kept", Lease->GetData().capacity() >= Pool.GetHighWaterMark(), true);
+
+	Lease->AddValue(Obj);
+	CT::Check("Check no reallocation", Lease->GetData().data() == Data, true);
+
+	//The nested object header is inserted in front of its pairs.
+	CT::Check("Typecheck object", Lease->GetNextType(), MsgFormats::FIXMAP, fn);
+	CT::Check("Check pair count", Lease->UnpackMap(), (uint32_t)7);
+	Lease->SkipValue(10);
+	CT::Check("Check nested key", Lease->GetValue<std::string>(), std::string("CTest1"));
+	CT::Check("Check nested pair count", Lease->UnpackMap(), (uint32_t)5);
+	Lease->SkipValue(10);
+	CT::Check("Typecheck pointer key", Lease->GetNextType(), MsgFormats::FIXMAP, fn);
+	Lease->SkipValue(2);
+	CT::Check("Check end of stream", Lease->GetNextType(), MsgFormats::RESERVED, fn);
+
+	//A throwing Serialize() leaves no partial object behind.
+	CMessagePack Pack;
+	Pack.SetStringInterning(32);
+	Pack.AddValue(7);
+
+	bool Thrown = false;
+	try
+	{
+		Pack.AddValue(SThrowing());
+	}
+	catch(const std::runtime_error &)
+	{
+		Thrown = true;
+	}
+
+	CT::Check("Check serialize threw", Thrown, true);
+	Pack.AddValue("Hallo Welt!");
+	CT::Check("Check value before", Pack.GetValue<int>(), 7);
+	CT::Check("Check value after", Pack.GetValue<std::string>(), std::string("Hallo Welt!"));
+	CT::Check("Check no partial object", Pack.GetNextType(), MsgFormats::RESERVED, fn);
+}
+
+template<class T>
+void CheckMeasure(const std::string &Name, const T &val)
+{
+	std::function<std::string(size_t)> fnSize = [](size_t val) { return std::to_string(val); };
+	CMessagePack Tmp;
+	size_t Size = Tmp.MeasureValue(val);
+	Tmp.AddValue(val);
+
+	CT::Check("Measure " + Name, Size, Tmp.GetData().size(), fnSize);
+	CT::Check("Measure nothing written " + Name, CMessagePack::EncodedSize(val), Size, fnSize);
+}
+
+void TestMeasure()
+{
+	CheckMeasure("posfixint", 5);
+	CheckMeasure("int16", -300);
+	CheckMeasure("uint64", (uint64_t)0xFFFFFFFFFFFFFFFF);
+	CheckMeasure("double", 1.8);
+	CheckMeasure("fixstr", "Hallo Welt!");
+	CheckMeasure("str16", std::string(300, 'a'));
+	CheckMeasure("array16", std::vector<int>(20, 1000));
+	CheckMeasure("map", std::map<int, std::string>{{1, "Test"}, {2, "Hallo"}});
+	CheckMeasure("object", CTest());
+
+	CMessagePack Ref;
+	std::string Blob(1000, 'x');
+	Ref.SetReferenceThreshold(100);
+	Ref.Reserve(Ref.MeasureValue(Blob));
+	Ref.AddValue(Blob);
+
+	std::vector<char> Slot(Ref.GetSerializedSize());
+	CT::Check("Check serialize to slot", Ref.SerializeTo(Slot.data(), Slot.size()), Slot.size());
+	CT::Check("Check slot content", Slot == Ref.SerializeWithoutWipe(), true);
+
+	bool Thrown = false;
+	try
+	{
+		Ref.SerializeTo(Slot.data(), Slot.size() - 1);
+	}
+	catch(const CMsgPackException& e)
+	{
+		Thrown = e.GetErrType() == MsgPackErrorType::BUFFER_TOO_SMALL;
+	}
+
+	CT::Check("Check slot too small", Thrown, true);
+}
+
+struct Tick
+{
+	int64_t ts;
+	double px;
+	uint32_t qty;
+	int8_t side;
+};
+
+using TickCodec = CMsgPackFixedCodec<Tick,
+	CFixedField<Tick, int64_t, &Tick::ts>,
+	CFixedField<Tick, double, &Tick::px>,
+	CFixedField<Tick, uint32_t, &Tick::qty>,
+	CFixedField<Tick, int8_t, &Tick::side>>;
+
+void TestFixedCodec()
+{
+	std::function<std::string(MsgFormats)> fn = std::bind(MsgFormatsToString, std::placeholders::_1);
+	Tick In = {-1234567890123, 101.25, 7, -1};
+
+	CMessagePack Fixed;
+	Fixed.AddFixed<TickCodec>(In);
+	Fixed.AddFixed<TickCodec>(In);
+	CT::Check("Check fixed size", Fixed.GetData().size(), 2 * TickCodec::Size);
+
+	//The fixed layout is readable by the generic decoder.
+	CT::Check("Check array size", Fixed.UnpackArray(), (uint32_t)4);
+	CT::Check("Typecheck ts", Fixed.GetNextType(), MsgFormats::INT64, fn);
+	CT::Check("Check ts", Fixed.GetValue<int64_t>(), In.ts);
+	CT::Check("Check px", Fixed.GetValue<double>(), In.px);
+	CT::Check("Typecheck qty", Fixed.GetNextType(), MsgFormats::UINT32, fn);
+	CT::Check("Check qty", Fixed.GetValue<uint32_t>(), In.qty);
+	CT::Check("Check side", Fixed.GetValue<int>(), -1);
+
+	Tick Out = Fixed.GetFixed<TickCodec>();
+	CT::Check("Check fixed ts", Out.ts, In.ts);
+	CT::Check("Check fixed px", Out.px, In.px);
+	CT::Check("Check fixed qty", Out.qty, In.qty);
+	CT::Check("Check fixed side", Out.side, In.side);
+
+	//Minimal encoding doesn't match the fixed layout.
+	CMessagePack Generic;
+	Generic.AddArray(4);
+	Generic.AddValue(In.ts);
+	Generic.AddValue(In.px);
+	Generic.AddValue(In.qty);
+	Generic.AddValue(In.side);
+
+	bool Thrown = false;
+	try
+	{
+		Generic.GetFixed<TickCodec>();
+	}
+	catch(const CMsgPackException& e)
+	{
+		Thrown = e.GetErrType() == MsgPackErrorType::INVALID_CAST;
+	}
+
+	CT::Check("Check layout mismatch", Thrown, true);
+}
+
+void TestJsonOutput()
+{
+	std::function<std::string(std::string)> fnStr = [](std::string val) { return val; };
+	CMessagePack Json;
+
+	Json.AddMap(4);
+	Json.AddValue("name");
+	Json.AddValue("Tab\t \"quoted\" \\ \x01 and a long text which uses the vector path");
+	Json.AddValue("values");
+	Json.AddValue(std::vector<int64_t>{-1, 200, -40000, (int64_t)-5000000000});
+	Json.AddValue(12);
+	Json.AddValue(std::vector<double>{0.1, 1.5e300, 2.0});
+	Json.AddValue("bin");
+	const char Data[] = {1, 2, 3, 4};
+	Json.AddBin(Data, sizeof(Data));
+
+	Json.AddValue((uint64_t)0xFFFFFFFFFFFFFFFF);
+	Json.AddValue((float)1.6);
+	Json.AddValue(nullptr);
+
+	std::string Expected = "{\"name\":\"Tab\\t \\\"quoted\\\" \\\\ \\u0001 and a long text which uses the vector path\","
+		"\"values\":[-1,200,-40000,-5000000000],\"12\":[0.1,1.5e+300,2],\"bin\":\"AQIDBA==\"}\n"
+		"18446744073709551615\n1.6\nnull";
+
+	CT::Check("Check JSON text", CMsgPackToJson::ToJson(Json.GetData()), Expected, fnStr);
+
+	std::ostringstream Stream;
+	CMsgPackToJson::ToJson(Json.GetData().data(), Json.GetData().size(), Stream);
+	CT::Check("Check JSON stream", Stream.str(), Expected, fnStr);
+}
+
+void TestJsonInput()
+{
+	std::function<std::string(MsgFormats)> fn = std::bind(MsgFormatsToString, std::placeholders::_1);
+	std::function<std::string(std::string)> fnStr = [](std::string val) { return val; };
+
+	std::string Json = "{\"a\" : [1, -1, 200, -200, 5000000000, -9223372036854775808, -99999999999999999999, 1.5, -0.25e2],"
+		" \"esc\\u00e4\": \"line\\n\\ud83d\\ude00\", \"nested\": {\"t\": true, \"f\": false, \"n\": null, \"e\": [], \"o\": {}, \"s\": \"\"}}\n[7]";
+
+	CMessagePack Pack;
+	CJsonToMsgPack::Convert(Json, Pack);
+
+	CT::Check("Check map", Pack.UnpackMap(), (uint32_t)3);
+	CT::Check("Check key", Pack.GetValue<std::string>(), std::string("a"));
+	CT::Check("Check array", Pack.UnpackArray(), (uint32_t)9);
+	CT::Check("Typecheck 1", Pack.GetNextType(), MsgFormats::POSITIVE_FIXINT, fn);
+	Pack.SkipValue();
+	CT::Check("Typecheck -1", Pack.GetNextType(), MsgFormats::NEGATIVE_FIXINT, fn);
+	Pack.SkipValue();
+	CT::Check("Typecheck 200", Pack.GetNextType(), MsgFormats::UINT8, fn);
+	Pack.SkipValue();
+	CT::Check("Typecheck -200", Pack.GetNextType(), MsgFormats::INT16, fn);
+	CT::Check("Check -200", Pack.GetValue<int>(), -200);
+	CT::Check("Typecheck 5000000000", Pack.GetNextType(), MsgFormats::UINT64, fn);
+	Pack.SkipValue();
+	CT::Check("Check int64 min", Pack.GetValue<int64_t>(), INT64_MIN);
+	CT::Check("Typecheck overflow", Pack.GetNextType(), MsgFormats::FLOAT64, fn);
+
+	std::string Back = CMsgPackToJson::ToJson(Pack.GetData());
+	std::string Expected = "{\"a\":[1,-1,200,-200,5000000000,-9223372036854775808,-1e+20,1.5,-25],"
+		"\"esc\u00e4\":\"line\\n\xf0\x9f\x98\x80\",\"nested\":{\"t\":true,\"f\":false,\"n\":null,\"e\":[],\"o\":{},\"s\":\"\"}}\n[7]";
+	CT::Check("Check round trip", Back, Expected, fnStr);
+
+	//Escaped strings are decoded into a reused buffer, which must not be referenced.
+	CMessagePack Referencing;
+	Referencing.SetReferenceThreshold(4);
+	CJsonToMsgPack::Convert("[\"first\\tvalue\", \"second\\tvalue\", \"plain string\", \"\"]", Referencing);
+	CT::Check("Check referenced round trip", CMsgPackToJson::ToJson(Referencing.Serialize()), std::string("[\"first\\tvalue\",\"second\\tvalue\",\"plain string\",\"\"]"), fnStr);
+
+	//Backpatched headers shrink to ARRAY16 / ARRAY32.
+	std::string Large = "[[";
+	for (int i = 0; i < 70000; i++)
+		Large += i == 0 ? "1" : ",1";
+	Large += "],[1,2,3,4,5,6,7,8,9,10,11,12,13,14,15,16]]";
+
+	CMessagePack LargePack;
+	CJsonToMsgPack::Convert(Large, LargePack);
+	CT::Check("Check outer array", LargePack.UnpackArray(), (uint32_t)2);
+	CT::Check("Typecheck array32", LargePack.GetNextType(), MsgFormats::ARRAY32, fn);
+	CT::Check("Check array32", LargePack.GetValue<std::vector<int>>().size(), (size_t)70000);
+	CT::Check("Typecheck array16", LargePack.GetNextType(), MsgFormats::ARRAY16, fn);
+	CT::Check("Check array16", LargePack.GetValue<std::vector<int>>().back(), 16);
+	CT::Check("Check measured JSON", LargePack.MeasureValue(std::vector<int>(70000, 1)), (size_t)70005);
+
+	bool Thrown = false;
+	try
+	{
+		CMessagePack Invalid;
+		CJsonToMsgPack::Convert("{\"a\": [1, 2}", Invalid);
+	}
+	catch(const CMsgPackException& e)
+	{
+		Thrown = e.GetErrType() == MsgPackErrorType::INVALID_JSON;
+	}
+
+	CT::Check("Check invalid JSON", Thrown, true);
+}
+
+struct StatsItem
+{
+	int Id;
+	std::string Name;
+
+	void Serialize(CMessagePack &Pack) const
+	{
+		Pack.AddPair("id", Id);
+		Pack.AddPair("name", Name);
+	}
+};
+
+void TestStats()
+{
+	CMessagePack Pack;
+	Pack.AddValue(std::vector<StatsItem>{{1, "a"}, {300, "b"}});
+	Pack.AddValue(1.5);
+
+	SMsgPackStats Stats = Pack.GetStats();
+	CT::Check("Check encoded arrays", Stats.Encoded[MsgFormats::FIXARRAY], (uint64_t)1);
+	CT::Check("Check encoded maps", Stats.Encoded[MsgFormats::FIXMAP], (uint64_t)2);
+	CT::Check("Check encoded strings", Stats.Encoded[MsgFormats::FIXSTR], (uint64_t)6);
+	CT::Check("Check encoded fixints", Stats.Encoded[MsgFormats::POSITIVE_FIXINT], (uint64_t)1);
+	CT::Check("Check encoded int16", Stats.Encoded[MsgFormats::INT16], (uint64_t)1);
+	CT::Check("Check encoded floats", Stats.Encoded[MsgFormats::FLOAT64], (uint64_t)1);
+	CT::Check("Check nested objects", Stats.NestedObjects, (uint64_t)2);
+	CT::Check("Check bytes written", Stats.BytesWritten, (uint64_t)Pack.GetData().size());
+	CT::Check("Check reallocations", Stats.Reallocations > 0, true);
+
+	//Measuring doesn't count.
+	Pack.MeasureValue(std::string("measured"));
+	CT::Check("Check measure", Pack.GetStats().Encoded[MsgFormats::FIXSTR], (uint64_t)6);
+
+	Pack.Deserialize(Pack.Serialize());
+	CT::Check("Check array", Pack.UnpackArray(), (uint32_t)2);
+	Pack.SkipValue();
+	CT::Check("Check map", Pack.UnpackMap(), (uint32_t)2);
+	CT::Check("Check key", Pack.GetValue<std::string>(), std::string("id"));
+	CT::Check("Check id", Pack.GetValue<int>(), 300);
+
+	bool Thrown = false;
+	try
+	{
+		Pack.GetValue<bool>();
+	}
+	catch(const CMsgPackException& e)
+	{
+		Thrown = true;
+	}
+
+	CT::Check("Check thrown", Thrown, true);
+
+	Stats = Pack.GetStats();
+	CT::Check("Check decoded maps", Stats.Decoded[MsgFormats::FIXMAP], (uint64_t)1);
+	CT::Check("Check decoded int16", Stats.Decoded[MsgFormats::INT16], (uint64_t)1);
+	CT::Check("Check decoded strings", Stats.Decoded[MsgFormats::FIXSTR], (uint64_t)2);
+	CT::Check("Check bytes read", Stats.BytesRead, (uint64_t)20);
+	CT::Check("Check exceptions", Stats.Exceptions, (uint64_t)1);
+	CT::Check("Check serialize calls", Stats.SerializeCalls, (uint64_t)1);
+	CT::Check("Check deserialize calls", Stats.DeserializeCalls, (uint64_t)1);
+
+	Pack.ResetStats();
+	CT::Check("Check reset", Pack.GetStats().BytesWritten, (uint64_t)0);
+}
+
+void TestMalformedInput()
+{
+	//Float64 read as float is narrowed instead of overflowing the float.
+	CMessagePack Float;
+	Float.AddValue(2.5);
+	CT::Check("Check narrowed float", Float.GetValue<float>(), 2.5f);
+
+	//A truncated str32 with the largest length returns the available bytes without visiting 4 GiB.
+	CMessagePack Truncated;
+	Truncated.Deserialize(std::vector<char>{(char)0xdb, (char)0xff, (char)0xff, (char)0xff, (char)0xff, 'a', 'b'});
+	CT::Check("Check truncated str32", Truncated.GetValue<std::string>(), std::string("ab"));
+
+	//Skipping deeply nested arrays doesn't recurse.
+	CMessagePack Deep;
+	Deep.Deserialize(std::vector<char>(1000000, (char)0x91));
+	Deep.SkipValue();
+	CT::Check("Check deep skip", Deep.GetNextType(), MsgFormats::RESERVED, std::function<std::string(MsgFormats)>(MsgFormatsToString));
+}
+
+void TestContainers()
+{
+	std::set<std::string> Set = {"c", "a", "b"};
+	std::multiset<int> MultiSet = {3, 1, 3, -7};
+	std::unordered_set<int64_t> HashSet = {5, 5000000000, -1};
+	std::unordered_multiset<int> HashMultiSet = {2, 2, 9};
+	std::deque<double> Deque = {1.5, -2.25};
+	std::list<std::string> List = {"x", "yz"};
+	std::array<int16_t, 3> Array = {{-300, 0, 300}};
+	std::set<char> CharSet = {'a', 'z'};
+
+	CMessagePack Containers;
+	Containers.AddValue(Set);
+	Containers.AddValue(MultiSet);
+	Containers.AddValue(HashSet);
+	Containers.AddValue(HashMultiSet);
+	Containers.AddValue(Deque);
+	Containers.AddValue(List);
+	Containers.AddValue(Array);
+	Containers.AddValue(CharSet);
+	Containers.AddValue(Array);
+
+	CT::Check("Check set", Containers.GetValue<std::set<std::string>>() == Set, true);
+	CT::Check("Check multiset", Containers.GetValue<std::multiset<int>>() == MultiSet, true);
+	CT::Check("Check unordered_set", Containers.GetValue<std::unordered_set<int64_t>>() == HashSet, true);
+	CT::Check("Check unordered_multiset", Containers.GetValue<std::unordered_multiset<int>>() == HashMultiSet, true);
+	CT::Check("Check deque", Containers.GetValue<std::deque<double>>() == Deque, true);
+	CT::Check("Check list", Containers.GetValue<std::list<std::string>>() == List, true);
+	CT::Check("Check array", Containers.GetValue<std::array<int16_t, 3>>() == Array, true);
+	CT::Check("Check char set", Containers.GetValue<std::set<char>>() == CharSet, true);
+
+	//The size of a std::array has to match.
+	bool Thrown = false;
+	try
+	{
+		Containers.GetValue<std::array<int16_t, 4>>();
+	}
+	catch(const CMsgPackException& e)
+	{
+		Thrown = e.GetErrType() == MsgPackErrorType::INVALID_CAST;
+	}
+
+	CT::Check("Check array size mismatch", Thrown, true);
+
+	//A huge announced size doesn't reserve more than the stream can hold.
+	CMessagePack Huge;
+	Huge.Deserialize(std::vector<char>{(char)0xdd, (char)0xff, (char)0xff, (char)0xff, (char)0xff, 1});
+	Thrown = false;
+	try
+	{
+		Huge.GetValue<std::vector<int>>();
+	}
+	catch(const CMsgPackException& e)
+	{
+		Thrown = e.GetErrType() == MsgPackErrorType::EMPTY_STREAM;
+	}
+
+	CT::Check("Check huge array", Thrown, true);
+}
+
+void TestMapDecode()
+{
+	std::map<std::string, std::string> Map;
+	std::unordered_map<std::string, std::vector<int>> HashMap;
+	for (int i = 0; i < 1000; i++)
+	{
+		Map["key" + std::to_string(i)] = "a value which doesn't fit into the small string buffer " + std::to_string(i);
+		HashMap["key" + std::to_string(i)] = std::vector<int>(3, i);
+	}
+
+	std::multimap<int, std::string> MultiMap = {{1, "first"}, {1, "second"}, {0, "zero"}, {1, "third"}};
+
+	CMessagePack Maps;
+	Maps.AddValue(Map);
+	Maps.AddValue(HashMap);
+	Maps.AddValue(MultiMap);
+
+	CT::Check("Check map", Maps.GetValue<std::map<std::string, std::string>>() == Map, true);
+
+	auto DecodedHashMap = Maps.GetValue<std::unordered_map<std::string, std::vector<int>>>();
+	CT::Check("Check unordered_map", DecodedHashMap == HashMap, true);
+	CT::Check("Check reserved buckets", DecodedHashMap.bucket_count() >= DecodedHashMap.size(), true);
+
+	//Equal keys keep their order.
+	auto DecodedMultiMap = Maps.GetValue<std::multimap<int, std::string>>();
+	std::vector<std::string> Values;
+	for (auto &&e : DecodedMultiMap)
+		Values.push_back(e.second);
+
+	CT::Check("Check multimap order", Values == std::vector<std::string>{"zero", "first", "second", "third"}, true);
+
+	//A huge announced size doesn't reserve more than the stream can hold.
+	CMessagePack Huge;
+	Huge.Deserialize(std::vector<char>{(char)0xdf, (char)0xff, (char)0xff, (char)0xff, (char)0xff, 1, 2});
+	bool Thrown = false;
+	try
+	{
+		Huge.GetValue<std::unordered_map<int, int>>();
+	}
+	catch(const CMsgPackException& e)
+	{
+		Thrown = e.GetErrType() == MsgPackErrorType::EMPTY_STREAM;
+	}
+
+	CT::Check("Check huge map", Thrown, true);
+}
+
+//Stand-in for a third-party map, which has no emplace and no reserve.
+class CFlatMap
+{
+	public:
+		using key_type = int;
+		using mapped_type = std::string;
+		using value_type = std::pair<int, std::string>;
+		using const_iterator = std::vector<value_type>::const_iterator;
+
+		const_iterator begin() const { return m_Entries.begin(); }
+		const_iterator end() const { return m_Entries.end(); }
+		size_t size() const { return m_Entries.size(); }
+
+		void Put(int Key, std::string &&Value) { m_Entries.emplace_back(Key, std::move(Value)); }
+		void Grow(size_t Size) { m_Entries.reserve(Size); Reserved = Size; }
+
+		size_t Reserved = 0;
+
+	private:
+		std::vector<value_type> m_Entries;
+};
+
+template<>
+struct MsgPackContainerTraits<CFlatMap>
+{
+	static constexpr MsgPackContainerKind Kind = MsgPackContainerKind::MAP;
+
+	static void Reserve(CFlatMap &Map, size_t Size) { Map.Grow(Size); }
+	static void Insert(CFlatMap &Map, int &&Key, std::string &&Value) { Map.Put(Key, std::move(Value)); }
+};
+
+//Iterable, but serializes itself as object.
+class CRange
+{
+	public:
+		std::vector<int> Values;
+
+		std::vector<int>::const_iterator begin() const { return Values.begin(); }
+		std::vector<int>::const_iterator end() const { return Values.end(); }
+
+		void Serialize(CMessagePack &Pack) const
+		{
+			Pack.AddPair("values", Values);
+		}
+};
+
+template<>
+struct MsgPackContainerTraits<CRange>
+{
+	static constexpr MsgPackContainerKind Kind = MsgPackContainerKind::NONE;
+};
+
+struct ReverseHash
+{
+	size_t operator()(int val) const { return std::hash<int>()(-val); }
+};
+
+void TestContainerTraits()
+{
+	std::function<std::string(MsgFormats)> fn = std::bind(MsgFormatsToString, std::placeholders::_1);
+
+	std::map<std::string, int, std::greater<std::string>> Descending = {{"a", 1}, {"b", 2}, {"c", 3}};
+	std::unordered_map<int, int, ReverseHash> Hashed = {{1, 10}, {2, 20}};
+	std::vector<int, std::allocator<int>> Allocated = {4, 5};
+	std::set<int, std::greater<int>> DescendingSet = {1, 2, 3};
+
+	CFlatMap Flat;
+	Flat.Put(7, "seven");
+	Flat.Put(8, "eight");
+
+	CRange Range;
+	Range.Values = {1, 2};
+
+	CMessagePack Pack;
+	Pack.AddValue(Descending);
+	Pack.AddValue(Hashed);
+	Pack.AddValue(Allocated);
+	Pack.AddValue(DescendingSet);
+	Pack.AddValue(Flat);
+	Pack.AddValue(Range);
+
+	CT::Check("Typecheck comparator map", Pack.GetNextType(), MsgFormats::FIXMAP, fn);
+	CT::Check("Check comparator map", Pack.GetValue<std::map<std::string, int, std::greater<std::string>>>() == Descending, true);
+	CT::Check("Typecheck hasher map", Pack.GetNextType(), MsgFormats::FIXMAP, fn);
+	CT::Check("Check hasher map", Pack.GetValue<std::unordered_map<int, int, ReverseHash>>() == Hashed, true);
+	CT::Check("Check allocator vector", Pack.GetValue<std::vector<int, std::allocator<int>>>() == Allocated, true);
+	CT::Check("Check comparator set", Pack.GetValue<std::set<int, std::greater<int>>>() == DescendingSet, true);
+
+	CT::Check("Typecheck custom map", Pack.GetNextType(), MsgFormats::FIXMAP, fn);
+	CFlatMap Decoded = Pack.GetValue<CFlatMap>();
+	CT::Check("Check custom map size", Decoded.size(), (size_t)2);
+	CT::Check("Check custom map reserve", Decoded.Reserved, (size_t)2);
+	CT::Check("Check custom map value", Decoded.begin()->second, std::string("seven"));
+
+	CT::Check("Check iterable object", Pack.UnpackMap(), (uint32_t)1);
+	CT::Check("Check iterable object key", Pack.GetValue<std::string>(), std::string("values"));
+	CT::Check("Check iterable object values", Pack.GetValue<std::vector<int>>() == Range.Values, true);
+}
+
+struct SPoint
+{
+	int X = 0;
+	int Y = 0;
+
+	void Serialize(CMessagePack &Pack) const
+	{
+		Pack.AddPair("x", X);
+		Pack.AddPair("y", Y);
+	}
+
+	void Deserialize(CMessagePack &Pack)
+	{
+		for (uint32_t i = Pack.UnpackMap(); i > 0; i--)
+		{
+			std::string Key = Pack.GetValue<std::string>();
+			if(Key == "x")
+				X = Pack.GetValue<int>();
+			else
+				Y = Pack.GetValue<int>();
+		}
+	}
+};
+
+void TestPointersAndSumTypes()
+{
+	std::function<std::string(MsgFormats)> fn = std::bind(MsgFormatsToString, std::placeholders::_1);
+
+	std::unique_ptr<SPoint> Point(new SPoint());
+	Point->X = 3;
+	Point->Y = -4;
+
+	std::unique_ptr<int> NoInt;
+	std::shared_ptr<SPoint> SharedPoint = std::make_shared<SPoint>(*Point);
+	std::pair<std::string, int> Pair("a", 1);
+	std::tuple<int, std::string, double> Tuple(7, "b", 2.5);
+
+	CMessagePack Pack;
+	Pack.AddValue(Point);
+	Pack.AddValue(NoInt);
+	Pack.AddValue(SharedPoint);
+	Pack.AddValue(Pair);
+	Pack.AddValue(Tuple);
+	Pack.AddValue(Tuple);
+
+	CT::Check("Typecheck unique_ptr", Pack.GetNextType(), MsgFormats::FIXMAP, fn);
+	std::unique_ptr<SPoint> DecodedPoint = Pack.GetValue<std::unique_ptr<SPoint>>();
+	CT::Check("Check unique_ptr", DecodedPoint && DecodedPoint->X == 3 && DecodedPoint->Y == -4, true);
+	CT::Check("Typecheck empty unique_ptr", Pack.GetNextType(), MsgFormats::NIL, fn);
+	CT::Check("Check empty unique_ptr", (bool)Pack.GetValue<std::unique_ptr<int>>(), false);
+	CT::Check("Check shared_ptr", Pack.GetValue<std::shared_ptr<SPoint>>()->Y, -4);
+	CT::Check("Typecheck pair", Pack.GetNextType(), MsgFormats::FIXARRAY, fn);
+	CT::Check("Check pair", Pack.GetValue<std::pair<std::string, int>>() == Pair, true);
+	CT::Check("Check tuple", Pack.GetValue<std::tuple<int, std::string, double>>() == Tuple, true);
+
+	//An empty string behind a pointer isn't NIL, which would read back as no string.
+	CMessagePack EmptyPtr;
+	EmptyPtr.AddValue(std::unique_ptr<std::string>(new std::string()));
+	std::unique_ptr<std::string> EmptyStr = EmptyPtr.GetValue<std::unique_ptr<std::string>>();
+	CT::Check("Check empty string pointer", EmptyStr && EmptyStr->empty(), true);
+
+	//The element count of a tuple has to match.
+	bool Thrown = false;
+	try
+	{
+		Pack.GetValue<std::pair<int, std::string>>();
+	}
+	catch(const CMsgPackException& e)
+	{
+		Thrown = e.GetErrType() == MsgPackErrorType::INVALID_CAST;
+	}
+
+	CT::Check("Check tuple size mismatch", Thrown, true);
+
+#ifdef MSGPACK_HAS_OPTIONAL_VARIANT
+	std::optional<std::string> Optional = "opt";
+	std::optional<int> NoOptional;
+	std::variant<int, std::string, std::vector<int>> Variant = std::string("var");
+	std::variant<int, std::string, std::vector<int>> VariantVec = std::vector<int>{1, 2};
+
+	CMessagePack Sum;
+	Sum.AddValue(Optional);
+	Sum.AddValue(NoOptional);
+	Sum.AddValue(Variant);
+	Sum.AddValue(VariantVec);
+	Sum.AddValue(std::make_tuple(5u, 1));
+
+	CT::Check("Typecheck optional", Sum.GetNextType(), MsgFormats::FIXSTR, fn);
+	CT::Check("Check optional", Sum.GetValue<std::optional<std::string>>() == Optional, true);
+	CT::Check("Typecheck empty optional", Sum.GetNextType(), MsgFormats::NIL, fn);
+	CT::Check("Check empty optional", Sum.GetValue<std::optional<int>>().has_value(), false);
+
+	CMessagePack EmptyOpt;
+	EmptyOpt.AddValue(std::optional<std::string>(""));
+	EmptyOpt.AddValue(std::optional<std::string>());
+	CT::Check("Check optional empty string", EmptyOpt.GetValue<std::optional<std::string>>() == std::optional<std::string>(""), true);
+	CT::Check("Check optional without string", EmptyOpt.GetValue<std::optional<std::string>>().has_value(), false);
+	CT::Check("Check variant", (Sum.GetValue<std::variant<int, std::string, std::vector<int>>>() == Variant), true);
+	CT::Check("Check variant vector", (Sum.GetValue<std::variant<int, std::string, std::vector<int>>>() == VariantVec), true);
+
+	//Index 5 doesn't exist.
+	Thrown = false;
+	try
+	{
+		Sum.GetValue<std::variant<int, std::string, std::vector<int>>>();
+	}
+	catch(const CMsgPackException& e)
+	{
+		Thrown = e.GetErrType() == MsgPackErrorType::INVALID_CAST;
+	}
+
+	CT::Check("Check invalid variant index", Thrown, true);
+#endif
+}
+
+void TestStringInterning()
+{
+	std::function<std::string(MsgFormats)> fn = std::bind(MsgFormatsToString, std::placeholders::_1);
+	std::map<std::string, std::string> Record = {{"temperature", "celsius"}, {"humidity", "percent"}, {"id", "sensor"}};
+
+	CMessagePack Plain;
+	CMessagePack Interned;
+	Interned.SetStringInterning(32);
+
+	for (int i = 0; i < 100; i++)
+	{
+		Plain.AddValue(Record);
+		CT::Check("Check interned measure", Interned.MeasureValue(Record), i == 0 ? (size_t)57 : (size_t)19);
+		Interned.AddValue(Record);
+	}
+
+	CT::Check("Check interned size", Interned.GetData().size() < Plain.GetData().size() / 2, true);
+	CT::Check("Check interned JSON", CMsgPackToJson::ToJson(Interned.GetData()), CMsgPackToJson::ToJson(Plain.GetData()));
+
+	if(!CorpusDir.empty())
+	{
+		ofstream out(CorpusDir + "/TestStringInterning.mpack", ios::binary);
+		out.write(Interned.GetData().data(), Interned.GetData().size());
+	}
+
+	CMessagePack In;
+	In.Deserialize(Interned.Serialize());
+	CT::Check("Check dictionary reset", Interned.MeasureValue(Record), (size_t)57);
+
+	CT::Check("Typecheck definition", In.GetNextType(), MsgFormats::FIXMAP, fn);
+	CT::Check("Check definitions", In.GetValue<std::map<std::string, std::string>>() == Record, true);
+
+	//Skipped definitions are still resolved.
+	In.Reset();
+	In.SkipValue();
+	CT::Check("Check references", In.GetValue<std::map<std::string, std::string>>() == Record, true);
+
+	CT::Check("Check reference map", In.UnpackMap(), (uint32_t)3);
+	uint32_t Length;
+	const char *Key = In.GetStr(Length);
+	CT::Check("Check zero copy reference", std::string(Key, Length), std::string("humidity"));
+	CT::Check("Check zero copy pointer", Key >= In.GetData().data() && Key < In.GetData().data() + In.GetData().size(), true);
+
+	CMsgPackReader Reader(In.GetData());
+	Reader.SkipValue(2);
+	CT::Check("Check reader map", Reader.ReadMap(), (uint32_t)3);
+	Key = Reader.ReadStr(Length);
+	CT::Check("Check reader reference", std::string(Key, Length), std::string("humidity"));
+
+	//References to unknown entries are rejected.
+	CMessagePack Unknown;
+	Unknown.Deserialize(std::vector<char>{(char)MsgFormats::FIXEXT1, (char)MsgPackExtTypes::INTERNED_STRING_REF, 0});
+	bool Thrown = false;
+	try
+	{
+		Unknown.GetValue<std::string>();
+	}
+	catch(const CMsgPackException& e)
+	{
+		Thrown = e.GetErrType() == MsgPackErrorType::INVALID_REFERENCE;
+	}
+
+	CT::Check("Check unknown reference", Thrown, true);
+}
+
+void TestCompression()
+{
+	std::vector<std::map<std::string, int>> Records;
+	for (int i = 0; i < 2000; i++)
+		Records.push_back({{"sensor", i % 7}, {"temperature", 20 + i % 5}, {"humidity", 40}});
+
+	CMessagePack Pack;
+	for (auto &&r : Records)
+		Pack.AddValue(r);
+
+	size_t PlainSize = Pack.GetData().size();
+	std::vector<char> Archive = CMsgPackCompressor<>::Serialize(Pack, 4096);
+	if(!CorpusDir.empty())
+	{
+		ofstream out(CorpusDir + "/TestCompression.mpack", ios::binary);
+		out.write(Archive.data(), Archive.size());
+	}
+
+	CT::Check("Check compressed size", Archive.size() * 4 < PlainSize, true);
+	CT::Check("Check compressed detection", CMsgPackDecompressor<>::IsCompressed(Archive.data(), Archive.size()), true);
+
+	CMessagePack In;
+	CMsgPackDecompressor<>::Deserialize(In, std::vector<char>(Archive));
+	CT::Check("Check decompressed size", In.GetData().size(), PlainSize);
+	CT::Check("Check decompressed value", In.GetValue<std::map<std::string, int>>() == Records[0], true);
+
+	//Plain streams are loaded as they are.
+	CMessagePack Plain;
+	CMsgPackDecompressor<>::Deserialize(Plain, In.Serialize());
+	CT::Check("Check plain stream", Plain.GetValue<std::map<std::string, int>>() == Records[0], true);
+
+	//Values written one by one aren't split, so every chunk can be decoded on its own.
+	std::ostringstream Stream;
+	CMsgPackCompressor<> Compressor(Stream, 4096);
+	for (auto &&r : Records)
+	{
+		CMessagePack Single;
+		Single.AddValue(r);
+		Compressor.Write(Single);
+	}
+	Compressor.Flush();
+
+	std::string Streamed = Stream.str();
+	CMsgPackDecompressor<> Chunks(Streamed.data(), Streamed.size());
+	CT::Check("Check chunk count", Chunks.GetChunkCount() > 2, true);
+	CT::Check("Check chunk size", Chunks.GetChunkSize(), (uint32_t)4096);
+
+	std::vector<char> Chunk;
+	Chunks.DecompressChunk(2, Chunk);
+	CMessagePack ChunkPack;
+	ChunkPack.Deserialize(std::move(Chunk));
+
+	size_t First = (size_t)(Chunks.GetChunk(2).Position / CMessagePack::EncodedSize(Records[0]));
+	bool Match = true;
+	for (size_t i = First; ChunkPack.GetNextType() != MsgFormats::RESERVED; i++)
+		Match &= ChunkPack.GetValue<std::map<std::string, int>>() == Records[i];
+
+	CT::Check("Check chunk values", Match, true);
+
+	//Incompressible data is stored.
+	std::vector<char> Noise(10000);
+	uint32_t Seed = 1;
+	for (auto &&c : Noise)
+	{
+		Seed = Seed * 1103515245 + 12345;
+		c = (char)(Seed >> 16);
+	}
+
+	std::vector<char> Stored = CMsgPackCompressor<>::Compress(Noise);
+	CT::Check("Check stored chunk", (int)CMsgPackDecompressor<>(Stored).GetChunk(0).Method, 0);
+	CT::Check("Check stored data", CMsgPackDecompressor<>::Decompress(Stored) == Noise, true);
+
+	//A chunk announcing more data than it can hold is rejected before decoding.
+	Archive[MsgPackCompress::HEADER_SIZE + 7] = (char)0x7F;
+	bool Thrown = false;
+	try
+	{
+		CMsgPackDecompressor<>::Decompress(Archive);
+	}
+	catch(const CMsgPackException& e)
+	{
+		Thrown = e.GetErrType() == MsgPackErrorType::INVALID_COMPRESSION;
+	}
+
+	CT::Check("Check malformed chunk", Thrown, true);
+}
+
+void TestPathExtraction()
+{
+	CMessagePack Pack;
+	Pack.AddMap(3);
+	Pack.AddPair("customer", "Alice");
+	Pack.AddValue("orders");
+	Pack.AddArray(4);
+	for (int i = 0; i < 4; i++)
+	{
+		std::map<std::string, double> Order = {{"price", 10.5 * i}, {"quantity", (double)i}};
+		Pack.AddValue(Order);
+	}
+	Pack.AddPair(7, std::vector<int>{1, 2, 3});
+
+	const std::vector<char> &Doc = Pack.GetData();
+	SMsgPackView Price = CMsgPackReader::Extract(Doc, {"orders", 3, "price"});
+	CT::Check("Check extracted value", CMsgPackReader(Price.Data, Price.Size).ReadFloat(), 31.5);
+	CT::Check("Check extracted size", Price.Size, (size_t)9);
+	CT::Check("Check missing key", CMsgPackReader::Extract(Doc, {"orders", 3, "discount"}).Data == nullptr, true);
+	CT::Check("Check missing index", CMsgPackReader::Extract(Doc, {"orders", 4}).Data == nullptr, true);
+	CT::Check("Check path into scalar", CMsgPackReader::Extract(Doc, {"customer", 0}).Data == nullptr, true);
+
+	std::vector<SMsgPackView> Views = CMsgPackReader::ExtractAll(Doc, {{"customer"}, {7, 2}, {"orders", 1, "quantity"}, {"orders", 1}, {"missing"}, {}});
+	uint32_t Length;
+	const char *Name = CMsgPackReader(Views[0].Data, Views[0].Size).ReadStr(Length);
+	CT::Check("Check batch string", std::string(Name, Length), std::string("Alice"));
+	CT::Check("Check batch integer key", CMsgPackReader(Views[1].Data, Views[1].Size).ReadInt(), (int64_t)3);
+	CT::Check("Check batch nested", CMsgPackReader(Views[2].Data, Views[2].Size).ReadFloat(), 1.0);
+
+	CMessagePack Order;
+	Order.Deserialize(std::vector<char>(Views[3].Data, Views[3].Data + Views[3].Size));
+	CT::Check("Check batch subtree", Order.GetValue<std::map<std::string, double>>().at("price"), 10.5);
+	CT::Check("Check batch missing", Views[4].Data == nullptr, true);
+	CT::Check("Check batch whole document", Views[5].Size, Doc.size());
+
+	//Interned keys are resolved by Find().
+	CMessagePack Interned;
+	Interned.SetStringInterning(16);
+	std::map<std::string, int> Record = {{"counter", 1}, {"gauge", 2}};
+	Interned.AddValue(Record);
+	Interned.AddValue(Record);
+
+	CMsgPackReader Reader(Interned.GetData());
+	Reader.SkipValue();
+	CT::Check("Check interned path", Reader.Find({"gauge"}) && Reader.ReadInt() == 2, true);
+}
+
+void TestPatching()
+{
+	CMessagePack Pack;
+	Pack.AddMap(3);
+	Pack.AddPair("name", "sensor");
+	Pack.AddPair("counter", (uint32_t)70000);
+	Pack.AddPair("ratio", 0.5f);
+
+	std::vector<char> Doc = Pack.GetData();
+	size_t Size = Doc.size();
+	CMsgPackPatcher Patcher(Doc);
+	CT::Check("Check number in place", Patcher.Set({"counter"}, 7) == MsgPackPatchResult::IN_PLACE && Doc.size() == Size, true);
+	CT::Check("Check exact float in place", Patcher.Set({"ratio"}, 0.25) == MsgPackPatchResult::IN_PLACE && Doc.size() == Size, true);
+	CT::Check("Check inexact float spliced", Patcher.Set({"ratio"}, 0.1) == MsgPackPatchResult::SPLICED && Doc.size() == Size + 4, true);
+	CT::Check("Check longer string spliced", Patcher.Set({"name"}, "temperature sensor") == MsgPackPatchResult::SPLICED, true);
+	CT::Check("Check missing path", Patcher.Set({"missing"}, 1) == MsgPackPatchResult::NOT_FOUND, true);
+
+	CMsgPackReader Reader(Doc);
+	CT::Check("Check map size", Reader.ReadMap(), (uint32_t)3);
+	Reader.SkipValue();
+	uint32_t Length;
+	const char *Name = Reader.ReadStr(Length);
+	CT::Check("Check patched string", std::string(Name, Length), std::string("temperature sensor"));
+	Reader.SkipValue();
+	CT::Check("Check patched number", Reader.ReadInt(), (int64_t)7);
+	Reader.SkipValue();
+	CT::Check("Check patched float", Reader.ReadFloat(), 0.1);
+	CT::Check("Check patched end", Reader.AtEnd(), true);
+
+	//Fixed width streams never need a splice for numbers.
+	CMessagePack Fixed;
+	Fixed.SetFixedWidth(true);
+	Fixed.AddValue(std::vector<int>{0, 1});
+	Fixed.AddValue(1.5f);
+	CT::Check("Check fixed width size", Fixed.GetData().size(), (size_t)(1 + 9 + 9 + 9));
+	CT::Check("Check fixed width tag", (uint8_t)Fixed.GetData()[1], (uint8_t)MsgFormats::INT64);
+
+	Doc = Fixed.GetData();
+	CMsgPackPatcher FixedPatcher(Doc);
+	CT::Check("Check fixed width negative", FixedPatcher.Set({1}, INT64_MIN) == MsgPackPatchResult::IN_PLACE, true);
+	CT::Check("Check fixed width float", FixedPatcher.SetAt(19, 0.1) == MsgPackPatchResult::IN_PLACE && Doc.size() == (size_t)28, true);
+
+	CMessagePack Unpacked;
+	Unpacked.Deserialize(std::move(Doc));
+	CT::Check("Check fixed width values", Unpacked.GetValue<std::vector<int64_t>>() == std::vector<int64_t>{0, INT64_MIN} && Unpacked.GetValue<double>() == 0.1, true);
+
+	//Removing a definition would break later references.
+	CMessagePack Interned;
+	Interned.SetStringInterning(16);
+	Interned.AddValue(std::vector<std::string>{"shared", "shared"});
+	Doc = Interned.GetData();
+	CMsgPackPatcher InternedPatcher(Doc);
+	bool Thrown = false;
+	try
+	{
+		InternedPatcher.Set({0}, "other");
+	}
+	catch(const CMsgPackException& e)
+	{
+		Thrown = e.GetErrType() == MsgPackErrorType::INVALID_REFERENCE;
+	}
+	CT::Check("Check definition protected", Thrown, true);
+	CT::Check("Check reference replaced", InternedPatcher.Set({1}, "other") == MsgPackPatchResult::SPLICED, true);
+}
+
+void TestCanonical()
+{
+	//Same content, different insertion order and bucket count.
+	std::unordered_map<std::string, int> First, Second(1024);
+	for (int i = 0; i < 100; i++)
+		First["key" + std::to_string(i)] = i;
+	for (int i = 99; i >= 0; i--)
+		Second["key" + std::to_string(i)] = i;
+
+	CMessagePack A, B;
+	A.SetCanonical(true);
+	B.SetCanonical(true);
+	A.AddValue(First);
+	B.AddValue(Second);
+	CT::Check("Check equal bytes", A.GetData() == B.GetData(), true);
+	CT::Check("Check round trip", A.GetValue<std::unordered_map<std::string, int>>() == First, true);
+
+	//Keys are ordered by their encoding, so shorter strings come first and negative numbers last.
+	CMessagePack Ordered;
+	Ordered.SetCanonical(true);
+	Ordered.AddValue(std::map<std::string, int>{{"b", 1}, {"aa", 2}, {"a", 3}});
+	Ordered.AddValue(std::map<int, int>{{-1, 0}, {200, 0}, {-100, 0}, {5, 0}});
+
+	CMsgPackReader Reader(Ordered.GetData());
+	std::string Keys;
+	Reader.ReadMap();
+	for (int i = 0; i < 3; i++)
+	{
+		uint32_t Length;
+		const char *Key = Reader.ReadStr(Length);
+		Keys += std::string(Key, Length) + " ";
+		Reader.SkipValue();
+	}
+	CT::Check("Check string key order", Keys, std::string("a b aa "));
+
+	std::vector<int64_t> IntKeys;
+	Reader.ReadMap();
+	for (int i = 0; i < 4; i++)
+	{
+		IntKeys.push_back(Reader.ReadInt());
+		Reader.SkipValue();
+	}
+	CT::Check("Check integer key order", IntKeys == std::vector<int64_t>{5, 200, -100, -1}, true);
+
+	CMessagePack Minimal;
+	Minimal.SetCanonical(true);
+	Minimal.SetFixedWidth(true);
+	Minimal.AddValue((int16_t)200);
+	Minimal.AddValue(std::string());
+	CT::Check("Check positive as unsigned", (uint8_t)Minimal.GetData()[0], (uint8_t)MsgFormats::UINT8);
+	CT::Check("Check empty string", (uint8_t)Minimal.GetData()[2], (uint8_t)MsgFormats::FIXSTR);
+	CT::Check("Check canonical size", Minimal.GetData().size(), (size_t)3);
+	CT::Check("Check canonical values", Minimal.GetValue<int16_t>() == 200 && Minimal.GetValue<std::string>().empty(), true);
+
+	//Empty strings of the default mode are NIL and read back as empty strings.
+	CMessagePack Default;
+	Default.AddValue(std::vector<std::string>{"", "a"});
+	CT::Check("Check empty string as NIL", (uint8_t)Default.GetData()[1], (uint8_t)MsgFormats::NIL);
+	CT::Check("Check NIL as string", Default.GetValue<std::vector<std::string>>() == std::vector<std::string>{"", "a"}, true);
+}
+
+void TestDiff()
+{
+	std::map<std::string, std::vector<int>> Sensors;
+	for (int i = 0; i < 50; i++)
+		Sensors["sensor" + std::to_string(i)] = std::vector<int>(20, i);
+
+	CMessagePack Old;
+	Old.AddMap(3);
+	Old.AddPair("version", 1);
+	Old.AddPair("sensors", Sensors);
+	Old.AddPair("removed", "gone");
+
+	Sensors["sensor7"][3] = -5;
+	Sensors["sensor9"].push_back(42);
+	Sensors["sensor11"].resize(2);
+	Sensors.erase("sensor20");
+	Sensors["sensor50"] = {1, 2};
+
+	CMessagePack New;
+	New.AddMap(3);
+	New.AddPair("version", 2);
+	New.AddPair("added", std::vector<std::string>{"x"});
+	New.AddPair("sensors", Sensors);
+
+	std::vector<char> Delta = CMsgPackDiff::Diff(Old.GetData(), New.GetData());
+	CT::Check("Check delta is small", Delta.size() < New.GetData().size() / 10, true);
+
+	std::vector<char> Replica = Old.GetData();
+	CMsgPackDiff::Apply(Replica, Delta);
+	CT::Check("Check no differences left", CMsgPackDiff::Diff(Replica, New.GetData()) == std::vector<char>{(char)0x90}, true);
+
+	CMessagePack Merged;
+	Merged.Deserialize(std::move(Replica));
+	CMsgPackReader Reader(Merged.GetData());
+	CT::Check("Check merged entries", Reader.ReadMap(), (uint32_t)3);
+	CT::Check("Check merged sensors", CMsgPackReader::Extract(Merged.GetData(), {"sensors", "sensor11", 1}).Size, (size_t)1);
+	CT::Check("Check removed key", CMsgPackReader::Extract(Merged.GetData(), {"removed"}).Data == nullptr, true);
+
+	//Identical documents give an empty delta and a changed type replaces the value.
+	CT::Check("Check empty delta", CMsgPackDiff::Diff(Old.GetData(), Old.GetData()).size(), (size_t)1);
+
+	CMessagePack Scalar, Array;
+	Scalar.AddValue(5);
+	Array.AddValue(std::vector<int>{5});
+	std::vector<char> Doc = Scalar.GetData();
+	CMsgPackDiff::Apply(Doc, CMsgPackDiff::Diff(Scalar.GetData(), Array.GetData()));
+	CT::Check("Check replaced root", Doc == Array.GetData(), true);
+
+	//A delta for another document is rejected.
+	bool Thrown = false;
+	try
+	{
+		CMsgPackDiff::Apply(Doc, Delta);
+	}
+	catch(const CMsgPackException& e)
+	{
+		Thrown = e.GetErrType() == MsgPackErrorType::INVALID_DELTA;
+	}
+	CT::Check("Check mismatching delta", Thrown, true);
+}
+
+struct Request
+{
+	uint32_t Id;
+	std::string Method;
+	std::vector<double> Args;
+	bool Urgent;
+	int16_t Priority;
+
+	void Serialize(CMessagePack &Pack) const
+	{
+		Pack.AddPair("method", Method);
+		Pack.AddPair("id", Id);
+		Pack.AddPair("extra", std::vector<int>{1, 2});
+		Pack.AddPair("args", Args);
+	}
+};
+
+static const CMsgPackSchema<Request,
+	CSchemaField<Request, uint32_t, &Request::Id>,
+	CSchemaField<Request, std::string, &Request::Method>,
+	CSchemaField<Request, std::vector<double>, &Request::Args>,
+	CSchemaField<Request, bool, &Request::Urgent>,
+	CSchemaField<Request, int16_t, &Request::Priority>> RequestSchema("id", "method", "args", "urgent", "priority");
+
+void TestSchema()
+{
+	CT::Check("Check compiled", RequestSchema.COMPILED, true);
+
+	Request In{70000, "resize", {1.5, -2.0}, true, -300};
+	CMessagePack Pack;
+	Pack.AddSchema(RequestSchema, In);
+	Pack.AddValue(In);
+
+	//Same bytes as a map written by hand.
+	CMessagePack Manual;
+	Manual.AddMap(5);
+	Manual.AddPair("id", In.Id);
+	Manual.AddPair("method", In.Method);
+	Manual.AddPair("args", In.Args);
+	Manual.AddPair("urgent", In.Urgent);
+	Manual.AddPair("priority", In.Priority);
+	CT::Check("Check schema encoding", std::vector<char>(Pack.GetData().begin(), Pack.GetData().begin() + Manual.GetData().size()) == Manual.GetData(), true);
+
+	Request Out{0, "", {}, false, 0};
+	CT::Check("Check compiled decode", RequestSchema.Decode(Pack.GetData().data(), Pack.GetData().size(), Out), Manual.GetData().size());
+
+	Pack.Deserialize(Pack.Serialize());
+	Out = Pack.GetSchema(RequestSchema);
+	CT::Check("Check fields", Out.Id == In.Id && Out.Method == In.Method && Out.Args == In.Args && Out.Urgent && Out.Priority == -300, true);
+	CT::Check("Check read bytes", Pack.GetStreamPos(), Manual.GetData().size());
+
+	//Reordered, unknown and missing keys use the generic decoder.
+	Out = Pack.GetSchema(RequestSchema);
+	CT::Check("Check fallback", Out.Id == In.Id && Out.Method == In.Method && Out.Args == In.Args && !Out.Urgent && Out.Priority == 0, true);
+	CT::Check("Check fallback end", Pack.GetStreamPos(), Pack.GetData().size());
+
+	//A value with the wrong type fails in both decoders.
+	CMessagePack Wrong;
+	Wrong.AddMap(1);
+	Wrong.AddPair("id", "text");
+	Wrong.Deserialize(Wrong.Serialize());
+
+	bool Thrown = false;
+	try
+	{
+		Wrong.GetSchema(RequestSchema);
+	}
+	catch(const CMsgPackException& e)
+	{
+		Thrown = e.GetErrType() == MsgPackErrorType::INVALID_CAST;
+	}
+	CT::Check("Check wrong type", Thrown, true);
+}
+
+struct Label
+{
+	std::string Name = "x";
+	std::unique_ptr<std::string> Owner;
+
+	void Serialize(CMessagePack &Pack) const
+	{
+		Pack.AddPair("name", Name);
+		if(Owner)
+			Pack.AddPair("owner", *Owner);
+	}
+
+	void Deserialize(CMessagePack &Pack)
+	{
+		uint32_t Pairs = Pack.UnpackMap();
+		for (uint32_t i = 0; i < Pairs; i++)
+		{
+			std::string Key = Pack.GetValue<std::string>();
+			if(Key == "name")
+				Name = Pack.GetValue<std::string>();
+			else if(Key == "owner")
+				Owner.reset(new std::string(Pack.GetValue<std::string>()));
+			else
+				Pack.SkipValue();
+		}
+	}
+};
+
+struct Trade
+{
+	int64_t Time = 0;
+	std::string Symbol;
+	double Price = 0;
+	std::unique_ptr<std::string> Note;
+
+	void Serialize(CMessagePack &Pack) const
+	{
+		Pack.AddPair("time", Time);
+		Pack.AddPair("symbol", Symbol);
+		Pack.AddPair("price", Price);
+		if(Note)
+			Pack.AddPair("note", *Note);
+	}
+
+	void Deserialize(CMessagePack &Pack)
+	{
+		uint32_t Pairs = Pack.UnpackMap();
+		for (uint32_t i = 0; i < Pairs; i++)
+		{
+			std::string Key = Pack.GetValue<std::string>();
+			if(Key == "time")
+				Time = Pack.GetValue<int64_t>();
+			else if(Key == "symbol")
+				Symbol = Pack.GetValue<std::string>();
+			else if(Key == "price")
+				Price = Pack.GetValue<double>();
+			else if(Key == "note")
+				Note = Pack.GetValue<std::unique_ptr<std::string>>();
+			else
+				Pack.SkipValue();
+		}
+	}
+};
+
+void TestColumns()
+{
+	std::vector<Trade> Trades(1000);
+	for (size_t i = 0; i < Trades.size(); i++)
+	{
+		Trades[i].Time = 1600000000000 + i * 250;
+		Trades[i].Symbol = i % 3 == 0 ? "AAPL" : "MSFT";
+		Trades[i].Price = 100 + (i % 17) * 0.25;
+	}
+	Trades[500].Note.reset(new std::string("halted"));
+
+	CMessagePack Rows, Columnar;
+	Rows.AddValue(Trades);
+	CMsgPackColumns::Add(Columnar, Trades);
+	Columnar.AddValue(7);
+
+	CMsgPackColumns Columns(Columnar.GetData());
+	CT::Check("Check row count", Columns.GetRowCount(), Trades.size());
+	CT::Check("Check missing column", Columns.GetColumnView("volume").Data == nullptr, true);
+
+	std::vector<double> Prices = Columns.GetColumn<double>("price");
+	CT::Check("Check price column", Prices.size() == Trades.size() && Prices[17] == 100.0 && Prices[18] == 100.25, true);
+
+	//Only one record has a note, all others are NIL.
+	std::vector<std::unique_ptr<std::string>> Notes = Columns.GetColumn<std::unique_ptr<std::string>>("note");
+	CT::Check("Check sparse column", !Notes[499] && *Notes[500] == "halted", true);
+
+	Columnar.Deserialize(Columnar.Serialize());
+	std::vector<Trade> Out = CMsgPackColumns::Get<Trade>(Columnar);
+	bool Same = Out.size() == Trades.size();
+	for (size_t i = 0; Same && i < Out.size(); i++)
+		Same = Out[i].Time == Trades[i].Time && Out[i].Symbol == Trades[i].Symbol && Out[i].Price == Trades[i].Price && !Out[i].Note == !Trades[i].Note;
+
+	CT::Check("Check rebuilt records", Same, true);
+	CT::Check("Check rebuilt note", *Out[500].Note, std::string("halted"));
+	CT::Check("Check value behind columns", Columnar.GetValue<int>(), 7);
+
+	//Columns repeat far less than rows.
+	size_t RowSize = CMsgPackCompressor<>::Compress(Rows.GetData()).size();
+	size_t ColumnSize = CMsgPackCompressor<>::Compress(Columnar.GetData()).size();
+	CT::Check("Check smaller compressed", ColumnSize * 2 < RowSize, true);
+
+	//An empty string is written as NIL, but it is still a value and not an absent field.
+	std::vector<Label> Labels(2);
+	Labels[0].Name = "";
+	Labels[1].Name = "set";
+	Labels[1].Owner.reset(new std::string("me"));
+
+	CMessagePack Tagged;
+	CMsgPackColumns::Add(Tagged, Labels);
+	std::vector<Label> OutLabels = CMsgPackColumns::Get<Label>(Tagged);
+	CT::Check("Check empty string field", OutLabels[0].Name, std::string(""));
+	CT::Check("Check absent field", !OutLabels[0].Owner && *OutLabels[1].Owner == "me", true);
+
+	std::vector<std::string> Names = CMsgPackColumns(Tagged.GetData()).GetColumn<std::string>("name");
+	std::vector<std::string> Owners = CMsgPackColumns(Tagged.GetData()).GetColumn<std::string>("owner");
+	CT::Check("Check empty string column", Names == std::vector<std::string>{"", "set"}, true);
+	CT::Check("Check absent column cell", Owners == std::vector<std::string>{"", "me"}, true);
+}
+
+void TestIntegerPacking()
+{
+	std::vector<int64_t> Times;
+	for (int64_t i = 0; i < 1000; i++)
+		Times.push_back(1600000000000 + i * 1000 + i % 3);
+
+	CMessagePack Plain, Packed;
+	Packed.SetIntegerPacking(16);
+	Plain.AddValue(Times);
+	Packed.AddValue(Times);
+
+	CT::Check("Check packed format", (int)Packed.GetNextType(), (int)MsgFormats::EXT16);
+	CT::Check("Check packed size", Packed.GetData().size() * 4 < Plain.GetData().size(), true);
+	CT::Check("Check measured size", Packed.MeasureValue(Times), Packed.GetData().size());
+	CT::Check("Check packed values", Packed.GetValue<std::vector<int64_t>>() == Times, true);
+
+	//Wrapping differences between the extremes.
+	std::vector<uint64_t> Extremes = {0, UINT64_MAX, 5, UINT64_MAX - 1, 0, 1ull << 63};
+	std::set<int8_t> Small = {INT8_MIN, -1, 0, 3, INT8_MAX};
+	std::array<uint16_t, 3> Fixed = {{7, 7, 7}};
+	Packed.Clear();
+	Packed.SetIntegerPacking(1);
+	Packed.AddValue(Extremes);
+	Packed.AddValue(Small);
+	Packed.AddValue(Fixed);
+	Packed.Deserialize(Packed.Serialize());
+	CT::Check("Check unsigned extremes", Packed.GetValue<std::vector<uint64_t>>() == Extremes, true);
+	CT::Check("Check packed set", Packed.GetValue<std::set<int8_t>>() == Small, true);
+	CT::Check("Check packed std::array", Packed.GetValue<std::array<uint16_t, 3>>() == Fixed, true);
+
+	//Doubles accept packed integers, like they accept plain integers.
+	Packed.Clear();
+	Packed.AddValue(std::vector<int>{-3, 0, 7, 1 << 20});
+	CT::Check("Check packed ints as doubles", Packed.GetValue<std::vector<double>>() == std::vector<double>{-3, 0, 7, 1 << 20}, true);
+
+	//The packing buffer is reused, so it must not be referenced.
+	CMessagePack Referencing;
+	Referencing.SetReferenceThreshold(4);
+	Referencing.SetIntegerPacking(1);
+	Referencing.AddValue(Times);
+	Referencing.AddValue(Extremes);
+	Referencing.Deserialize(Referencing.Serialize());
+	CT::Check("Check referenced packing", Referencing.GetValue<std::vector<int64_t>>() == Times && Referencing.GetValue<std::vector<uint64_t>>() == Extremes, true);
+
+	//Short sequences, bools and floats stay arrays.
+	Packed.Clear();
+	Packed.SetIntegerPacking(4);
+	Packed.AddValue(std::vector<int>{1, 2, 3});
+	Packed.AddValue(std::vector<bool>{true, false, true, true});
+	CT::Check("Check short array", (int)Packed.GetNextType(), (int)MsgFormats::FIXARRAY);
+	Packed.SkipValue();
+	CT::Check("Check bool array", (int)Packed.GetNextType(), (int)MsgFormats::FIXARRAY);
+
+	Packed.Clear();
+	Packed.AddValue(std::vector<int>{-2, 5, 5, 1000});
+	CT::Check("Check packed json", CMsgPackToJson::ToJson(Packed.GetData()), std::string("[-2,5,5,1000]"));
+
+	try
+	{
+		Packed.Reset();
+		Packed.GetValue<std::vector<std::string>>();
+		CT::Check("Check packed strings", false, true);
+	}
+	catch(const CMsgPackException& e)
+	{
+		CT::Check("Check packed strings", (int)e.GetErrType(), (int)MsgPackErrorType::INVALID_CAST);
+	}
+
+	//Count claims more values than the payload holds.
+	const char Malformed[] = {(char)MsgFormats::FIXEXT2, (char)MsgPackExtTypes::PACKED_INT_ARRAY, 0x7F, 0};
+	try
+	{
+		CMessagePack Pack;
+		Pack.Deserialize(std::vector<char>(Malformed, Malformed + sizeof(Malformed)));
+		Pack.GetValue<std::vector<int>>();
+		CT::Check("Check malformed packing", false, true);
+	}
+	catch(const CMsgPackException& e)
+	{
+		CT::Check("Check malformed packing", (int)e.GetErrType(), (int)MsgPackErrorType::INVALID_COMPRESSION);
+	}
+}
+
+void TestFloatPacking()
+{
+	//A slowly changing sensor series, rounded like a 0.01 resolution reading.
+	std::vector<double> Series;
+	for (int i = 0; i < 1000; i++)
+		Series.push_back(i % 50 == 0 ? 21.5 : std::round((21.5 + 0.3 * std::sin(i / 100.0)) * 100) / 100);
+
+	CMessagePack Plain, Packed;
+	Packed.SetFloatPacking(16);
+	Plain.AddValue(Series);
+	Packed.AddValue(Series);
+
+	CT::Check("Check packed format", (int)Packed.GetNextType(), (int)MsgFormats::EXT16);
+	CT::Check("Check packed size", Packed.GetData().size() * 2 < Plain.GetData().size(), true);
+	CT::Check("Check measured size", Packed.MeasureValue(Series), Packed.GetData().size());
+	CT::Check("Check packed values", Packed.GetValue<std::vector<double>>() == Series, true);
+
+	//Special values stay bit exact.
+	std::vector<double> Special = {0.0, -0.0, std::numeric_limits<double>::infinity(), std::numeric_limits<double>::denorm_min(), DBL_MAX, 1.0, 1.0, -2.5};
+	std::vector<float> Floats = {1.5f, 1.25f, -0.0f, FLT_MAX, 1.25f};
+	std::array<double, 2> NaNs = {{std::numeric_limits<double>::quiet_NaN(), 3.0}};
+	Packed.Clear();
+	Packed.SetFloatPacking(1);
+	Packed.AddValue(Special);
+	Packed.AddValue(Floats);
+	Packed.AddValue(NaNs);
+	Packed.Deserialize(Packed.Serialize());
+
+	std::vector<double> OutSpecial = Packed.GetValue<std::vector<double>>();
+	CT::Check("Check special values", OutSpecial.size() == Special.size() && memcmp(OutSpecial.data(), Special.data(), sizeof(double) * Special.size()) == 0, true);
+	CT::Check("Check packed floats", Packed.GetValue<std::vector<float>>() == Floats, true);
+
+	std::array<double, 2> OutNaNs = Packed.GetValue<std::array<double, 2>>();
+	CT::Check("Check packed NaN", std::isnan(OutNaNs[0]) && OutNaNs[1] == 3.0, true);
+
+	//Floats widen to doubles.
+	Packed.Reset();
+	Packed.SkipValue();
+	std::vector<double> Wide = Packed.GetValue<std::vector<double>>();
+	CT::Check("Check widened floats", Wide.size() == Floats.size() && Wide[1] == 1.25 && Wide[3] == FLT_MAX, true);
+
+	Packed.Clear();
+	Packed.AddValue(std::vector<float>{0.5f, -1.0f, 2.0f});
+	CT::Check("Check packed json", CMsgPackToJson::ToJson(Packed.GetData()), std::string("[0.5,-1,2]"));
+
+	try
+	{
+		Packed.Reset();
+		Packed.GetValue<std::vector<int>>();
+		CT::Check("Check packed ints", false, true);
+	}
+	catch(const CMsgPackException& e)
+	{
+		CT::Check("Check packed ints", (int)e.GetErrType(), (int)MsgPackErrorType::INVALID_CAST);
+	}
+
+	//Count claims more values than the bit stream holds.
+	const char Malformed[] = {(char)MsgFormats::FIXEXT8, (char)MsgPackExtTypes::PACKED_FLOAT_ARRAY, 0x7F, 32, 0, 0, 0, 0, 0, 0};
+	try
+	{
+		CMessagePack Pack;
+		Pack.Deserialize(std::vector<char>(Malformed, Malformed + sizeof(Malformed)));
+		Pack.GetValue<std::vector<float>>();
+		CT::Check("Check malformed packing", false, true);
+	}
+	catch(const CMsgPackException& e)
+	{
+		CT::Check("Check malformed packing", (int)e.GetErrType(), (int)MsgPackErrorType::INVALID_COMPRESSION);
+	}
+}
+
+void TestFloatNarrowing()
+{
+	std::vector<double> Values = {0.5, 3.0, -7.0, 0.1, -0.0, 4294967296.0, 1e300, std::numeric_limits<double>::infinity()};
+
+	CMessagePack Pack;
+	Pack.SetFloatNarrowing(MsgPackFloatNarrowing::FLOAT32);
+	for (auto &&v : Values)
+		Pack.AddValue(v);
+
+	CMsgPackReader Reader(Pack.GetData());
+	const MsgFormats Single[] = {MsgFormats::FLOAT32, MsgFormats::FLOAT32, MsgFormats::FLOAT32, MsgFormats::FLOAT64, MsgFormats::FLOAT32, MsgFormats::FLOAT32, MsgFormats::FLOAT64, MsgFormats::FLOAT32};
+	bool Formats = true;
+	for (auto &&fmt : Single)
+	{
+		Formats = Formats && Reader.Peek().Format == fmt;
+		Reader.SkipValue();
+	}
+	CT::Check("Check float32 formats", Formats, true);
+
+	CMessagePack Integers;
+	Integers.SetFloatNarrowing(MsgPackFloatNarrowing::INTEGER);
+	for (auto &&v : Values)
+		Integers.AddValue(v);
+
+	Integers.AddValue(2.0f);
+	Reader = CMsgPackReader(Integers.GetData());
+	const MsgFormats Whole[] = {MsgFormats::FLOAT32, MsgFormats::POSITIVE_FIXINT, MsgFormats::NEGATIVE_FIXINT, MsgFormats::FLOAT64, MsgFormats::FLOAT32, MsgFormats::FLOAT32, MsgFormats::FLOAT64, MsgFormats::FLOAT32, MsgFormats::POSITIVE_FIXINT};
+	Formats = true;
+	for (auto &&fmt : Whole)
+	{
+		Formats = Formats && Reader.Peek().Format == fmt;
+		Reader.SkipValue();
+	}
+	CT::Check("Check integer formats", Formats, true);
+
+	//Every value reads back bit exact.
+	bool Exact = true;
+	for (auto &&v : Values)
+	{
+		double a = Pack.GetValue<double>(), b = Integers.GetValue<double>();
+		Exact = Exact && memcmp(&a, &v, sizeof(v)) == 0 && memcmp(&b, &v, sizeof(v)) == 0;
+	}
+	CT::Check("Check narrowed values", Exact, true);
+	CT::Check("Check narrowed float", Integers.GetValue<float>(), 2.0f);
+
+	//Whole numbers above INT32_MAX are written as UINT32, not INT64.
+	bool Small = true;
+	for (double v : {3e9, 2147483648.0, (double)UINT32_MAX, (double)INT32_MIN})
+	{
+		CMessagePack Wide, Single;
+		Wide.SetFloatNarrowing(MsgPackFloatNarrowing::INTEGER);
+		Single.SetFloatNarrowing(MsgPackFloatNarrowing::INTEGER);
+		Wide.AddValue(v);
+		Single.AddValue((float)v);
+		Small = Small && Wide.GetData().size() <= 5 && Single.GetData().size() <= 5 && Wide.GetValue<double>() == v && Single.GetValue<float>() == (float)v;
+	}
+	CT::Check("Check large whole numbers", Small, true);
+
+	CMessagePack Plain;
+	Plain.AddValue(Values);
+	Pack.Clear();
+	Pack.AddValue(Values);
+	CT::Check("Check narrowed size", Pack.GetData().size() + 6 * 4, Plain.GetData().size());
+	CT::Check("Check measured size", Pack.MeasureValue(Values), Pack.GetData().size());
+
+	//Integers from other writers are read as well.
+	Pack.Clear();
+	Pack.AddValue(UINT64_MAX);
+	Pack.AddValue(std::map<std::string, int>{{"price", 42}});
+	Pack.Reset();
+	CT::Check("Check uint64 as double", Pack.GetValue<double>(), 18446744073709551615.0);
+	Reader = CMsgPackReader(Pack.GetData());
+	Reader.SkipValue();
+	CT::Check("Check reader int as double", Reader.Find({"price"}) ? Reader.ReadFloat() : 0.0, 42.0);
+	CT::Check("Check int in map as double", (Pack.GetValue<std::map<std::string, double>>()["price"]), 42.0);
+
+	//The fixed width wins.
+	Pack.Clear();
+	Pack.SetFixedWidth(true);
+	Pack.AddValue(1.0);
+	CT::Check("Check fixed width", (int)Pack.GetNextType(), (int)MsgFormats::FLOAT64);
+}
+
 int main(int argc, char const *argv[])
 {
+	for (int i = 1; i < argc; i++)
+	{
+		std::string Arg = argv[i];
+		if(Arg.compare(0, 9, "--corpus=") == 0)
+			CorpusDir = Arg.substr(9);
+	}
+
 	CT::TestFunction("TestSerialPrimitives", TestSerialPrimitives);
 	CT::TestFunction("TestDeserialPrimitives", TestDeserialPrimitives);
 	CT::TestFunction("TestSkipValues", TestSkipValues);
+	CT::TestFunction("TestReferenceOutput", TestReferenceOutput);
+	CT::TestFunction("TestBufferPool", TestBufferPool);
+	CT::TestFunction("TestMeasure", TestMeasure);
+	CT::TestFunction("TestFixedCodec", TestFixedCodec);
+	CT::TestFunction("TestJsonOutput", TestJsonOutput);
+	CT::TestFunction("TestJsonInput", TestJsonInput);
+	CT::TestFunction("TestStats", TestStats);
+	CT::TestFunction("TestMalformedInput", TestMalformedInput);
+	CT::TestFunction("TestContainers", TestContainers);
+	CT::TestFunction("TestMapDecode", TestMapDecode);
+	CT::TestFunction("TestContainerTraits", TestContainerTraits);
+	CT::TestFunction("TestPointersAndSumTypes", TestPointersAndSumTypes);
+	CT::TestFunction("TestStringInterning", TestStringInterning);
+	CT::TestFunction("TestCompression", TestCompression);
+	CT::TestFunction("TestPathExtraction", TestPathExtraction);
+	CT::TestFunction("TestPatching", TestPatching);
+	CT::TestFunction("TestCanonical", TestCanonical);
+	CT::TestFunction("TestDiff", TestDiff);
+	CT::TestFunction("TestSchema", TestSchema);
+	CT::TestFunction("TestColumns", TestColumns);
+	CT::TestFunction("TestIntegerPacking", TestIntegerPacking);
+	CT::TestFunction("TestFloatPacking", TestFloatPacking);
+	CT::TestFunction("TestFloatNarrowing", TestFloatNarrowing);
 
     // CMessagePack Pack;
     // CTest tt;
@@ -881,5 +2464,5 @@ int main(int argc, char const *argv[])
     // Pack1.AddValue(1.5);
     // Pack1.AddValue(-1);
 
-    return 0;
+    return CT::Failures() == 0 ? 0 : 1;
 }